@@ -168,6 +168,11 @@ int main(int argc, char *argv[]) {
         }
 
         size_t len = strlen(line);
+        // The server frames commands by '\n': terminate a last line typed without one
+        if (line[len - 1] != '\n' && len + 1 < sizeof(line)) {
+            line[len++] = '\n';
+            line[len] = '\0';
+        }
         if (send(sockfd, line, len, 0) == -1) {
             perror("send");
             break;
@@ -0,0 +1,123 @@
+/*
+** atoms.c -- the configured atom types (see atoms.h)
+*/
+
+#include "atoms.h"
+
+#include <stdio.h>           // fprintf
+#include <stdint.h>          // uint64_t
+#include <string.h>          // memcpy, memcmp, strlen, strchr
+
+static struct {
+    char     name[ATOM_TYPES_MAX][ATOM_NAME_MAX];    // "NITROGEN"
+    char     label[ATOM_TYPES_MAX][ATOM_NAME_MAX];   // "Nitrogen"
+    unsigned count;
+    unsigned lanes;
+} atoms = {
+    .name  = { "CARBON", "OXYGEN", "HYDROGEN" },
+    .label = { "Carbon", "Oxygen", "Hydrogen" },
+    .count = 3,
+    .lanes = ATOM_LANE_GROUP,
+};
+
+#define BUILTIN_ATOMS 3
+
+int atoms_configure(const char *list) {
+    unsigned count = BUILTIN_ATOMS;
+    const char *p = list;
+    while (*p) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len == 0 || len >= ATOM_NAME_MAX) {
+            fprintf(stderr, "ERROR: --atoms names must be 1 to %d characters\n", ATOM_NAME_MAX - 1);
+            return -1;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if (p[i] < 'A' || p[i] > 'Z') {
+                fprintf(stderr, "ERROR: --atoms name '%.*s' must be upper-case letters\n",
+                        (int)len, p);
+                return -1;
+            }
+        }
+        for (unsigned id = 0; id < count; id++) {
+            if (strlen(atoms.name[id]) == len && memcmp(atoms.name[id], p, len) == 0) {
+                fprintf(stderr, "ERROR: --atoms lists %.*s twice\n", (int)len, p);
+                return -1;
+            }
+        }
+        if (count == ATOM_TYPES_MAX) {
+            fprintf(stderr, "ERROR: --atoms allows at most %d atom types in total\n", ATOM_TYPES_MAX);
+            return -1;
+        }
+        memcpy(atoms.name[count], p, len);
+        atoms.name[count][len] = '\0';
+        atoms.label[count][0] = p[0];
+        for (size_t i = 1; i < len; i++) atoms.label[count][i] = (char)(p[i] - 'A' + 'a');
+        atoms.label[count][len] = '\0';
+        count++;
+        p += comma ? len + 1 : len;
+    }
+    atoms.count = count;
+    atoms.lanes = (count + ATOM_LANE_GROUP - 1) / ATOM_LANE_GROUP * ATOM_LANE_GROUP;
+    return 0;
+}
+
+unsigned atoms_count(void) {
+    return atoms.count;
+}
+
+unsigned atoms_lanes(void) {
+    return atoms.lanes;
+}
+
+const char *atom_name(unsigned id) {
+    return atoms.name[id];
+}
+
+const char *atom_label(unsigned id) {
+    return atoms.label[id];
+}
+
+int atom_find(const char *name, size_t len) {
+    if (len == 0 || len >= ATOM_NAME_MAX) return -1;
+    for (unsigned id = 0; id < atoms.count; id++) {
+        if (memcmp(atoms.name[id], name, len) == 0 && atoms.name[id][len] == '\0') {
+            return (int)id;
+        }
+    }
+    return -1;
+}
+
+size_t atoms_format(char *buf, size_t size, const AtomStock *stock, const char *sep) {
+    size_t sep_len = strlen(sep);
+    size_t used = 0;
+    for (unsigned id = 0; id < atoms.count; id++) {
+        char digits[20];
+        size_t nd = 0;
+        uint64_t v = stock->count[id];
+        do {
+            digits[nd++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v);
+        size_t label_len = strlen(atoms.label[id]);
+        size_t need = (id ? sep_len : 0) + label_len + 1 + nd;
+        if (used + need >= size) {
+            // Cut after the last whole entry
+            if (used + 4 < size) {
+                memcpy(buf + used, " ...", 4);
+                used += 4;
+            }
+            break;
+        }
+        if (id) {
+            memcpy(buf + used, sep, sep_len);
+            used += sep_len;
+        }
+        memcpy(buf + used, atoms.label[id], label_len);
+        used += label_len;
+        buf[used++] = '=';
+        while (nd) buf[used++] = digits[--nd];
+    }
+    buf[used] = '\0';
+    return used;
+}
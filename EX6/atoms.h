@@ -0,0 +1,52 @@
+/*
+** atoms.h -- the atom types one drinks_bar serves (--atoms)
+**
+** CARBON, OXYGEN and HYDROGEN are always atom ids 0, 1 and 2 (ATOM_* in
+** inventory.h, equal to WIRE_ATOM_*): the molecule recipes and the three
+** stock fields of a binary reply rely on that. --atoms appends more types,
+** up to ATOM_TYPES_MAX in total:
+**
+**   ./drinks_bar.out ... --atoms NITROGEN,SULFUR,SODIUM
+**   ADD SODIUM 40            -> OK: Carbon=0 Oxygen=0 Hydrogen=0 Nitrogen=0 Sulfur=0 Sodium=40
+**
+** An extra type is added like the built-in ones (text "ADD <NAME> <N>", or
+** binary item id 3, 4, ... in --atoms order), is listed after Hydrogen in
+** every reply and log line, and is an extra column of a --recipes file.
+**
+** Every AtomStock has ATOM_TYPES_MAX lanes, but only the first atoms_lanes()
+** are ever read or written: the configured types rounded up to a whole
+** vector of ATOM_LANE_GROUP lanes. The lanes past atoms_count() stay zero.
+** The set is fixed before any inventory is used.
+*/
+
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include <stddef.h>          // size_t
+
+#include "inventory.h"       // AtomStock, ATOM_TYPES_MAX
+
+#define ATOM_NAME_MAX 16     // bytes including the NUL (one snapshot table entry)
+
+// Replace the extra atom types with the comma separated, upper-case `list`
+// ("NITROGEN,SULFUR"; "" = only the built-in three). Returns 0, or -1 after
+// printing the reason to stderr.
+int atoms_configure(const char *list);
+
+// Configured atom types, and the lanes the inventory works on
+unsigned atoms_count(void);
+unsigned atoms_lanes(void);
+
+// "NITROGEN" for the upper-case name of atom `id`, "Nitrogen" for how replies show it
+const char *atom_name(unsigned id);
+const char *atom_label(unsigned id);
+
+// Atom id of the `len` bytes at `name`, or -1
+int atom_find(const char *name, size_t len);
+
+// "Carbon=1<sep>Oxygen=2<sep>..." for every configured type into `buf`
+// (always NUL-terminated). A list that does not fit ends in "...".
+// Returns the length written.
+size_t atoms_format(char *buf, size_t size, const AtomStock *stock, const char *sep);
+
+#endif // ATOMS_H
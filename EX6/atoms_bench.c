@@ -0,0 +1,126 @@
+/*
+** atoms_bench.c -- the inventory's compare-and-subtract kernels by atom count
+**
+** For 3, 16 and 64 configured atom types, and for every kernel this CPU runs
+** (avx2, sse4.2, scalar; see inventory.c), one thread measures
+**   • deliver: inventory_take() of a request that needs every atom type,
+**     followed by the inventory_add() that puts it back
+**   • reject:  inventory_take() of a request that the last atom type is one
+**     short for, so only the feasibility check runs
+** At the end of each run the stock must be back at its initial value, or
+** the run fails.
+**
+** Usage: ./atoms_bench.out [-n <ops>]   (default 5000000 per measurement)
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>           // printf, fprintf
+#include <stdlib.h>          // exit, strtoull
+#include <stdint.h>          // uint64_t
+#include <unistd.h>          // getopt
+#include <time.h>            // clock_gettime
+
+#include "inventory.h"
+#include "atoms.h"
+
+#define INITIAL   1000000000000ULL   // every atom type starts with 10^12
+#define REQUESTS  8                  // distinct requests, cycled
+
+static Inventory inv;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Configure `types` atom types: the built-in three plus XAA, XAB, ...
+static void configure(unsigned types) {
+    char list[ATOM_TYPES_MAX * 4 + 1];
+    size_t len = 0;
+    for (unsigned i = 0; i + 3 < types; i++) {
+        len += (size_t)snprintf(list + len, sizeof(list) - len, "%sX%c%c", i ? "," : "",
+                                'A' + i / 26, 'A' + i % 26);
+    }
+    list[len] = '\0';
+    if (atoms_configure(list) < 0 || atoms_count() != types) exit(EXIT_FAILURE);
+}
+
+// ----------------------------------------------------------------------------
+// run_one(): ns per deliver (take + add back) and per rejected take for the
+// configured atom types and the selected kernel
+// ----------------------------------------------------------------------------
+static void run_one(uint64_t ops, double *deliver_ns, double *reject_ns) {
+    unsigned types = atoms_count();
+    AtomStock initial = {{ 0 }}, req[REQUESTS] = {{{ 0 }}}, too_much = {{ 0 }};
+    for (unsigned a = 0; a < types; a++) {
+        initial.count[a] = INITIAL;
+        for (unsigned k = 0; k < REQUESTS; k++) req[k].count[a] = 1 + (a + k) % 7;
+        too_much.count[a] = 1;
+    }
+    too_much.count[types - 1] = INITIAL + 1;
+    inventory_init(&inv, &initial);
+
+    double t0 = now_sec();
+    for (uint64_t i = 0; i < ops; i++) {
+        const AtomStock *r = &req[i % REQUESTS];
+        if (inventory_take(&inv, r, NULL, NULL) != INV_OK ||
+            inventory_add(&inv, r, NULL, NULL) != INV_OK) {
+            fprintf(stderr, "ERROR: %s: deliver %llu failed\n", inventory_kernel(),
+                    (unsigned long long)i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double t1 = now_sec();
+    uint64_t rejected = 0;
+    for (uint64_t i = 0; i < ops; i++) {
+        rejected += inventory_take(&inv, &too_much, NULL, NULL) ==
+                    (InvResult)(INV_NOT_ENOUGH_CARBON + types - 1);
+    }
+    double t2 = now_sec();
+
+    AtomStock final;
+    inventory_read(&inv, &final);
+    for (unsigned a = 0; a < types; a++) {
+        if (final.count[a] != INITIAL || rejected != ops) {
+            fprintf(stderr, "ERROR: %s: atom %u ends at %llu (%llu of %llu rejected)\n",
+                    inventory_kernel(), a, (unsigned long long)final.count[a],
+                    (unsigned long long)rejected, (unsigned long long)ops);
+            exit(EXIT_FAILURE);
+        }
+    }
+    *deliver_ns = (t1 - t0) * 1e9 / (double)ops;
+    *reject_ns  = (t2 - t1) * 1e9 / (double)ops;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t ops = 5000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': ops = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n <ops>]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (ops == 0) {
+        fprintf(stderr, "ERROR: need ops > 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    static const unsigned type_counts[] = { 3, 16, 64 };
+    static const char *const kernels[]  = { "avx2", "sse4.2", "scalar" };
+    printf("%-6s %-8s %12s %12s\n", "atoms", "kernel", "deliver ns", "reject ns");
+    for (size_t t = 0; t < sizeof(type_counts) / sizeof(type_counts[0]); t++) {
+        configure(type_counts[t]);
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            if (!inventory_use_kernel(kernels[k])) continue;
+            double deliver, reject;
+            run_one(ops, &deliver, &reject);
+            printf("%-6u %-8s %12.2f %12.2f\n", type_counts[t], kernels[k], deliver, reject);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+#!/usr/bin/env bash
+#
+# bench.sh
+#
+# Goal: a reproducible throughput / latency matrix for drinks_bar, so that a
+# regression in the event loop, the parser or the persistence layer shows up
+# as a number.
+#
+# Every scenario starts a fresh optimized server (the `make release` build,
+# or BENCH_SERVER) with the same flags and stock, drives it with
+# load_generator for BENCH_SECONDS and appends the generator's JSON report,
+# tagged with the scenario name and the server flags, to one JSON Lines file.
+#
+# Scenarios:
+#   tcp_add, tcp_add_binary         ADD over TCP (text / binary frames)
+#   udp_deliver                     DELIVER over UDP
+#   mixed_tcp_add + mixed_udp_deliver   both at the same time on one server
+#   uds_stream_add, uds_dgram_deliver   the Unix-domain twins
+#   tcp_add_open                    open loop at BENCH_OPEN_RATE req/s (latency)
+#   file_rewrite, file_wal, file_mmap   tcp_add with -f, -f --wal, -f --mmap
+#
+# Usage (normally through `make bench`):
+#   ./bench.sh [report.jsonl]                      (default bench_report.jsonl)
+#   BENCH_BASELINE=old.jsonl ./bench.sh new.jsonl  (compare, exit 1 on regression)
+# Environment:
+#   BENCH_SECONDS    seconds per scenario (default 3)
+#   BENCH_OPEN_RATE  requests/s of tcp_add_open (default 50000)
+#   BENCH_TOLERANCE  % a rate may drop / a p99 may grow vs. the baseline (default 10)
+#   BENCH_BASELINE   earlier report to compare with
+#   BENCH_SERVER     server binary (default ./build/release/drinks_bar.out)
+#
+set -euo pipefail
+
+############################
+# 0. Variables
+############################
+
+SERVER_BIN="${BENCH_SERVER:-./build/release/drinks_bar.out}"
+LOADGEN_BIN="./load_generator.out"
+REPORT="${1:-bench_report.jsonl}"
+
+SECONDS_PER_RUN="${BENCH_SECONDS:-3}"
+OPEN_RATE="${BENCH_OPEN_RATE:-50000}"
+TOLERANCE="${BENCH_TOLERANCE:-10}"
+BASELINE="${BENCH_BASELINE:-}"
+
+TCP_PORT=7700
+UDP_PORT=7701
+FIFO_STDIN="/tmp/bench_stdin_$$"
+UDS_STREAM="/tmp/bench_stream_$$.sock"
+UDS_DGRAM="/tmp/bench_dgram_$$.sock"
+INV_FILE="/tmp/bench_inventory_$$.inv"
+
+# Deep enough that no DELIVER runs out and no ADD hits MAX_ATOMS within a run
+STOCK="-c 1000000000000000 -o 1000000000000000 -h 1000000000000000"
+
+for bin in "$SERVER_BIN" "$LOADGEN_BIN"; do
+    if [[ ! -x "$bin" ]]; then
+        echo "bench.sh: $bin is missing, run 'make bench'" >&2
+        exit 1
+    fi
+done
+
+############################
+# 1. Server helpers (stdin from a FIFO, closed for a clean shutdown)
+############################
+
+SERVER_PID=0
+SERVER_ARGS=""
+
+cleanup_files() {
+    rm -f "$UDS_STREAM" "$UDS_DGRAM" "$INV_FILE" "$INV_FILE.wal" "$INV_FILE.lock"
+}
+
+start_server() {
+    SERVER_ARGS="$STOCK -T $TCP_PORT -U $UDP_PORT -s $UDS_STREAM -d $UDS_DGRAM --log-level warn $*"
+    cleanup_files
+    [[ -p "$FIFO_STDIN" ]] || mkfifo "$FIFO_STDIN"
+    $SERVER_BIN $SERVER_ARGS < "$FIFO_STDIN" > /dev/null 2>&1 &
+    SERVER_PID=$!
+    exec 3> "$FIFO_STDIN"
+    sleep 0.3
+}
+
+stop_server() {
+    if [[ $SERVER_PID -ne 0 ]]; then
+        { exec 3>&-; } 2>/dev/null || true
+        for i in {1..50}; do
+            kill -0 "$SERVER_PID" 2>/dev/null || break
+            sleep 0.1
+        done
+        kill -SIGTERM "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=0
+    fi
+    cleanup_files
+}
+
+trap 'stop_server; rm -f "$FIFO_STDIN"' EXIT
+
+############################
+# 2. One measurement → one JSON line
+############################
+
+# record <scenario> <load_generator arguments...>
+record() {
+    local name="$1"; shift
+    local json
+    json=$("$LOADGEN_BIN" -D "$SECONDS_PER_RUN" -j "$@")
+    echo "${json/#\{/{\"scenario\":\"$name\",\"server\":\"$SERVER_ARGS\",}" >> "$REPORT"
+    printf "  %-20s %s\n" "$name" "$(summary "$json")"
+}
+
+# "<rate> replies/s, p99 <us> us" from a report line
+summary() {
+    local rate p99
+    rate=$(field rate <<< "$1")
+    p99=$(field p99 <<< "$1")
+    echo "$rate replies/s, p99 $p99 us"
+}
+
+# field <name>: the number after "name": on stdin
+field() {
+    sed -n "s/.*\"$1\":\([0-9.]*\).*/\1/p"
+}
+
+TCP="-h 127.0.0.1 -p $TCP_PORT -t tcp"
+UDP="-h 127.0.0.1 -p $UDP_PORT"
+
+############################
+# 3. The matrix
+############################
+
+: > "$REPORT"
+echo "---- drinks_bar benchmark: ${SECONDS_PER_RUN}s per scenario → $REPORT ----"
+
+start_server
+record tcp_add        $TCP -c 4 -w 16
+record tcp_add_binary $TCP -c 4 -w 16 -B
+record udp_deliver    $UDP -c 4 -w 32
+record uds_stream_add    -s "$UDS_STREAM" -c 4 -w 16
+record uds_dgram_deliver -d "$UDS_DGRAM" -c 4 -w 32
+record tcp_add_open   $TCP -c 4 -w 64 -r "$OPEN_RATE"
+stop_server
+
+# Both transports at once: ADD and DELIVER contend on the same inventory
+start_server
+"$LOADGEN_BIN" -D "$SECONDS_PER_RUN" -j $UDP -c 2 -w 32 > "/tmp/bench_mixed_$$.json" &
+MIXED_PID=$!
+record mixed_tcp_add  $TCP -c 2 -w 16 -m "ADD CARBON 1" -m "ADD OXYGEN 1" -m "ADD HYDROGEN 2"
+wait "$MIXED_PID"
+json=$(cat "/tmp/bench_mixed_$$.json")
+rm -f "/tmp/bench_mixed_$$.json"
+echo "${json/#\{/{\"scenario\":\"mixed_udp_deliver\",\"server\":\"$SERVER_ARGS\",}" >> "$REPORT"
+printf "  %-20s %s\n" mixed_udp_deliver "$(summary "$json")"
+stop_server
+
+# Named warehouses: the same ADD load spread over four @warehouse inventories
+start_server --warehouses 1024
+record warehouse_add  $TCP -c 4 -w 16 -m "ADD @bar1 CARBON 1" -m "ADD @bar2 CARBON 1" \
+                      -m "ADD @bar3 CARBON 1" -m "ADD @bar4 CARBON 1"
+stop_server
+
+# Sixteen atom types: ADD of an --atoms type, DELIVER over the wider stock
+start_server --atoms NITROGEN,SULFUR,SODIUM,CHLORINE,IRON,ZINC,COPPER,SILVER,GOLD,TIN,LEAD,NEON,ARGON
+record atoms16_tcp_add    $TCP -c 4 -w 16 -m "ADD SODIUM 1" -m "ADD CARBON 1"
+record atoms16_udp_deliver $UDP -c 4 -w 32
+stop_server
+
+# Persistence: every ADD reaches the -f file
+start_server -f "$INV_FILE"
+record file_rewrite   $TCP -c 4 -w 16
+stop_server
+start_server -f "$INV_FILE" --wal
+record file_wal       $TCP -c 4 -w 16
+stop_server
+start_server -f "$INV_FILE" --mmap
+record file_mmap      $TCP -c 4 -w 16
+stop_server
+start_server -f "$INV_FILE" --save-thread
+record file_save_thread $TCP -c 4 -w 16
+stop_server
+start_server -f "$INV_FILE" --save-thread --ack fsync
+record file_save_fsync  $TCP -c 4 -w 16
+stop_server
+
+############################
+# 4. Compare with a baseline
+############################
+
+if [[ -n "$BASELINE" ]]; then
+    echo "---- Comparing with $BASELINE (tolerance ${TOLERANCE}%) ----"
+    regressions=0
+    while IFS= read -r line; do
+        name=$(sed -n 's/^{"scenario":"\([^"]*\)".*/\1/p' <<< "$line")
+        old=$(grep "^{\"scenario\":\"$name\"," "$BASELINE" || true)
+        if [[ -z "$old" ]]; then
+            printf "  %-20s (not in baseline)\n" "$name"
+            continue
+        fi
+        verdict=$(awk -v tol="$TOLERANCE" \
+                      -v r0="$(field rate <<< "$old")"  -v r1="$(field rate <<< "$line")" \
+                      -v l0="$(field p99 <<< "$old")"   -v l1="$(field p99 <<< "$line")" '
+            BEGIN {
+                bad = ""
+                if (r1 < r0 * (1 - tol / 100)) bad = bad " rate"
+                if (l0 > 0 && l1 > l0 * (1 + tol / 100)) bad = bad " p99"
+                dr = (r0 > 0) ? (r1 - r0) * 100 / r0 : 0
+                dl = (l0 > 0) ? (l1 - l0) * 100 / l0 : 0
+                label = (bad == "") ? "ok" : "REGRESSED (" substr(bad, 2) ")"
+                printf "%-24s rate %+.1f%%, p99 %+.1f%%", label, dr, dl
+            }')
+        printf "  %-20s %s\n" "$name" "$verdict"
+        if [[ "$verdict" == REGRESSED* ]]; then
+            regressions=$((regressions + 1))
+        fi
+    done < "$REPORT"
+    if [[ $regressions -gt 0 ]]; then
+        echo "---- $regressions scenario(s) regressed ----"
+        exit 1
+    fi
+fi
+
+echo "---- Benchmark complete ----"
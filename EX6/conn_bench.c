@@ -0,0 +1,215 @@
+/*
+** conn_bench.c -- many idle TCP connections plus a few hot ones
+**
+** Opens -n connections to the drinks_bar TCP port that never send anything,
+** then runs -k client threads that each send "ADD CARBON 1" lines over their
+** own connection, -P at a time, for -D seconds. The server has to keep every
+** idle session registered while it serves the hot ones, so the replies/s and
+** the round-trip time of the hot clients show what each open connection
+** costs the event loop. The rate of the initial connects is reported too.
+**
+** Usage:
+**   ./conn_bench.out -h <host> -p <tcp_port> [options]
+** Options:
+**   -n <idle>      idle connections (default 10000)
+**   -k <hot>       busy clients (default 4)
+**   -P <depth>     lines in flight per busy client (default 1)
+**   -D <seconds>   duration (default 5)
+**
+** Example (both ends need a descriptor limit above -n):
+**   ./drinks_bar.out -c 0 -o 0 -h 0 -T 5555 -U 6666 --log-level warn &
+**   ./conn_bench.out -h 127.0.0.1 -p 5555 -n 10000 -k 4
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>           // printf, fprintf, perror
+#include <stdlib.h>          // exit, atoi, calloc, free
+#include <string.h>          // memchr, memmove
+#include <stdint.h>          // uint64_t
+#include <unistd.h>          // getopt, close, read, write
+#include <time.h>            // clock_gettime
+#include <pthread.h>         // pthread_create, pthread_join
+#include <netdb.h>           // getaddrinfo
+#include <sys/socket.h>      // socket, connect
+#include <sys/resource.h>    // getrlimit, setrlimit
+#include <netinet/in.h>      // IPPROTO_TCP
+#include <netinet/tcp.h>     // TCP_NODELAY
+
+#define MAX_HOT    256
+#define MAX_DEPTH  1024
+#define LINE       "ADD CARBON 1\n"
+
+typedef struct {
+    int       fd;
+    uint64_t  replies;
+    double    rtt_sum;       // seconds, summed over all replies
+    double    rtt_max;
+} Hot;
+
+static const char *host     = NULL;
+static const char *port     = NULL;
+static int         idle     = 10000;
+static int         hot      = 4;
+static int         depth    = 1;
+static int         duration = 5;
+static double      deadline;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int connect_tcp(const struct addrinfo *ai) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) return -1;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// ----------------------------------------------------------------------------
+// hot_client(): keep `depth` lines in flight and time every reply from the
+// moment its line was sent.
+// ----------------------------------------------------------------------------
+static void *hot_client(void *arg) {
+    Hot *h = (Hot *)arg;
+    double sent_at[MAX_DEPTH];
+    unsigned head = 0, inflight = 0;
+    char buf[4096];
+    size_t have = 0;
+
+    while (1) {
+        double now = now_sec();
+        if (now >= deadline && inflight == 0) break;
+        while (now < deadline && inflight < (unsigned)depth) {
+            if (write(h->fd, LINE, sizeof(LINE) - 1) != (ssize_t)(sizeof(LINE) - 1)) {
+                perror("write");
+                return NULL;
+            }
+            sent_at[(head + inflight) % MAX_DEPTH] = now;
+            inflight++;
+        }
+        ssize_t n = read(h->fd, buf + have, sizeof(buf) - have);
+        if (n <= 0) {
+            fprintf(stderr, "conn_bench: server closed a hot connection\n");
+            return NULL;
+        }
+        have += (size_t)n;
+        now = now_sec();
+        char *p = buf, *nl;
+        while ((nl = memchr(p, '\n', have - (size_t)(p - buf))) != NULL) {
+            double rtt = now - sent_at[head];
+            head = (head + 1) % MAX_DEPTH;
+            inflight--;
+            h->replies++;
+            h->rtt_sum += rtt;
+            if (rtt > h->rtt_max) h->rtt_max = rtt;
+            p = nl + 1;
+        }
+        have -= (size_t)(p - buf);
+        memmove(buf, p, have);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:k:P:D:")) != -1) {
+        switch (opt) {
+            case 'h': host     = optarg;       break;
+            case 'p': port     = optarg;       break;
+            case 'n': idle     = atoi(optarg); break;
+            case 'k': hot      = atoi(optarg); break;
+            case 'P': depth    = atoi(optarg); break;
+            case 'D': duration = atoi(optarg); break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s -h <host> -p <tcp_port> [-n idle] [-k hot] [-P depth] [-D seconds]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!host || !port || idle < 0 || hot < 1 || hot > MAX_HOT ||
+        depth < 1 || depth > MAX_DEPTH || duration < 1) {
+        fprintf(stderr, "ERROR: need -h and -p; 1 <= -k <= %d, 1 <= -P <= %d\n",
+                MAX_HOT, MAX_DEPTH);
+        exit(EXIT_FAILURE);
+    }
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *ai;
+    int rv = getaddrinfo(host, port, &hints, &ai);
+    if (rv != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+
+    // 1) The idle crowd
+    int *idle_fds = calloc((size_t)idle + 1, sizeof(int));
+    if (!idle_fds) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    double t0 = now_sec();
+    int opened = 0;
+    for (; opened < idle; opened++) {
+        idle_fds[opened] = connect_tcp(ai);
+        if (idle_fds[opened] < 0) {
+            perror("connect (idle)");
+            break;
+        }
+    }
+    double t_open = now_sec() - t0;
+
+    // 2) The hot clients
+    Hot hots[MAX_HOT];
+    pthread_t threads[MAX_HOT];
+    for (int i = 0; i < hot; i++) {
+        hots[i] = (Hot){ .fd = connect_tcp(ai) };
+        if (hots[i].fd < 0) {
+            perror("connect (hot)");
+            exit(EXIT_FAILURE);
+        }
+    }
+    freeaddrinfo(ai);
+
+    deadline = now_sec() + duration;
+    t0 = now_sec();
+    for (int i = 0; i < hot; i++) {
+        pthread_create(&threads[i], NULL, hot_client, &hots[i]);
+    }
+    uint64_t replies = 0;
+    double rtt_sum = 0, rtt_max = 0;
+    for (int i = 0; i < hot; i++) {
+        pthread_join(threads[i], NULL);
+        replies += hots[i].replies;
+        rtt_sum += hots[i].rtt_sum;
+        if (hots[i].rtt_max > rtt_max) rtt_max = hots[i].rtt_max;
+        close(hots[i].fd);
+    }
+    double elapsed = now_sec() - t0;
+
+    printf("idle connections: %d (opened in %.2f s, %.0f/s)\n",
+           opened, t_open, t_open > 0 ? opened / t_open : 0.0);
+    printf("hot clients: %d x depth %d, %llu replies in %.2f s = %.0f replies/s\n",
+           hot, depth, (unsigned long long)replies, elapsed, replies / elapsed);
+    printf("round trip: avg %.1f us, max %.1f us\n",
+           replies ? rtt_sum / replies * 1e6 : 0.0, rtt_max * 1e6);
+
+    for (int i = 0; i < opened; i++) {
+        close(idle_fds[i]);
+    }
+    free(idle_fds);
+    return 0;
+}
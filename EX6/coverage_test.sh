@@ -3,7 +3,8 @@
 # coverage_test.sh
 #
 # Goal: achieve ≥85% gcov coverage on:
-#   - drinks_bar.c
+#   - drinks_bar.c (+ its modules: inventory.c, wal.c, shared_inventory.c, parser.c, recipes.c, logger.c, timer_wheel.c,
+#     stats.c, histogram.c, uring.c, saver.c, snapshot.c, crc32c.c, warehouse.c)
 #   - atom_supplier.c
 #   - molecule_requester.c
 #
@@ -19,6 +20,10 @@
 #   chmod +x coverage_test.sh
 #   ./coverage_test.sh
 #
+# PROFILE_RUN=1 (used by `make pgo`) only runs the workload of step 3 with the
+# prebuilt binaries named by DRINKS_BIN / ATOM_BIN / MOL_BIN: nothing is
+# compiled, no profile data is removed and no gcov report is made.
+#
 set -euo pipefail
 
 ############################
@@ -26,12 +31,14 @@ set -euo pipefail
 ############################
 
 DRINKS_SRC="drinks_bar.c"
+DRINKS_MODULES="inventory.c atoms.c wal.c shared_inventory.c parser.c recipes.c logger.c timer_wheel.c stats.c histogram.c uring.c saver.c snapshot.c crc32c.c warehouse.c"
 ATOM_SRC="atom_supplier.c"
 MOL_SRC="molecule_requester.c"
 
-DRINKS_BIN="drinks_bar_dbg"
-ATOM_BIN="atom_supplier_dbg"
-MOL_BIN="molecule_requester_dbg"
+DRINKS_BIN="${DRINKS_BIN:-drinks_bar_dbg}"
+ATOM_BIN="${ATOM_BIN:-atom_supplier_dbg}"
+MOL_BIN="${MOL_BIN:-molecule_requester_dbg}"
+PROFILE_RUN="${PROFILE_RUN:-0}"
 
 # Base ports for drinks_bar tests
 TCP_BASE=50000
@@ -51,24 +58,28 @@ ATOM_TCP_ECHO_PORT=50010
 ATOM_TCP_INTERACTIVE_PORT=50011
 MOL_UDP_ECHO_PORT=60010
 
-echo "---- Step 0: Removing any old *.gcno / *.gcda / *.gcov ----"
-rm -f ./*.gcno ./*.gcda ./*.gcov
-find . -type f \( -name "*.gcno" -o -name "*.gcda" -o -name "*.gcov" \) -delete
-echo "---- Old coverage data removed ----"
-echo
+if [[ "$PROFILE_RUN" != 1 ]]; then
 
-############################
-# 1. Compile each .c with coverage flags
-############################
+    echo "---- Step 0: Removing any old *.gcno / *.gcda / *.gcov ----"
+    rm -f ./*.gcno ./*.gcda ./*.gcov
+    find . -type f \( -name "*.gcno" -o -name "*.gcda" -o -name "*.gcov" \) -delete
+    echo "---- Old coverage data removed ----"
+    echo
 
-CFLAGS="-std=c99 -Wall -Wextra -D_POSIX_C_SOURCE=200809L -fprofile-arcs -ftest-coverage"
+    ############################
+    # 1. Compile each .c with coverage flags
+    ############################
 
-echo "---- Step 1: Compiling with coverage flags ----"
-gcc $CFLAGS -o "$DRINKS_BIN" "$DRINKS_SRC"   -lpthread
-gcc $CFLAGS -o "$ATOM_BIN"   "$ATOM_SRC"
-gcc $CFLAGS -o "$MOL_BIN"    "$MOL_SRC"
-echo "---- Compilation complete ----"
-echo
+    CFLAGS="-std=c99 -Wall -Wextra -D_POSIX_C_SOURCE=200809L -fprofile-arcs -ftest-coverage"
+
+    echo "---- Step 1: Compiling with coverage flags ----"
+    gcc $CFLAGS -o "$DRINKS_BIN" "$DRINKS_SRC" $DRINKS_MODULES -lpthread
+    gcc $CFLAGS -o "$ATOM_BIN"   "$ATOM_SRC"
+    gcc $CFLAGS -o "$MOL_BIN"    "$MOL_SRC"
+    echo "---- Compilation complete ----"
+    echo
+
+fi
 
 ############################
 # 2. Helper functions for drinks_bar_dbg (so STDIN never closes)
@@ -623,8 +634,10 @@ echo "→ $ATOM_FILE_BAD2 now contains:"
 cat "$ATOM_FILE_BAD2" || true
 echo
 
-# (3e.4) Valid file “5 5 5” → load that, then stop (no change if no ADD)
+# (3e.4) Valid file “5 5 5” → load that, then stop (no change if no ADD);
+#        a second server on the same file finds <file>.lock held and exits
 run_drinks "-c 0 -o 0 -h 0 -T 7000 -U 7001 -f $ATOM_FILE_GOOD"
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7002 -U 7003 -f "$ATOM_FILE_GOOD" < /dev/null || true
 stop_drinks
 echo "→ $ATOM_FILE_GOOD still contains:"
 cat "$ATOM_FILE_GOOD" || true
@@ -636,6 +649,167 @@ stop_drinks
 echo "→ $ATOM_FILE_BAD3 now contains (initialized to 4 5 6):"
 cat "$ATOM_FILE_BAD3" || true
 echo
+rm -f atoms_new.txt.lock "$ATOM_FILE_GOOD.lock" "$ATOM_FILE_BAD1.lock" "$ATOM_FILE_BAD2.lock" "$ATOM_FILE_BAD3.lock"
+
+# (3e.6) --wal without -f → explicit error
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 --wal < /dev/null || true
+
+# (3e.7) -f --wal: ADDs go to atoms_wal.bin.wal; the server is killed, the
+#        restart must recover them and a second server must refuse the log
+rm -f atoms_wal.bin atoms_wal.bin.wal
+run_drinks "-c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_wal.bin --wal --wal-sync-ms 1 --wal-sync-ops 2 --wal-compact-ops 3"
+for i in 1 2 3 4 5; do
+    printf "ADD CARBON 10\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+done
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+sleep 0.2
+kill -9 "$SERVER_PID" 2>/dev/null || true
+wait "$SERVER_PID" 2>/dev/null || true
+exec 3>&-
+run_drinks "-c 0 -o 0 -h 0 -T 7000 -U 7001 -f atoms_wal.bin --wal"
+./"$DRINKS_BIN" -c 0 -o 0 -h 0 -T 7002 -U 7003 -f atoms_wal.bin --wal < /dev/null || true
+stop_drinks
+rm -f atoms_wal.bin atoms_wal.bin.wal
+
+# (3e.8) -f --mmap: two servers share one mapped file; the second one joins
+#        the first, and --wal --mmap together is rejected. A claim left in
+#        the file by a dead process is released by the next server to start
+#        and, while one runs, by the first update that waits on it
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_mmap.bin --wal --mmap < /dev/null || true
+rm -f atoms_mmap.bin
+printf "5 5 5" > atoms_mmap.bin
+run_drinks "-c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_mmap.bin --mmap --msync-ms 1"
+sleep 0.1 | ./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7002 -U 7003 -f atoms_mmap.bin --mmap || true
+printf "ADD OXYGEN 3\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+sleep 0.1
+stop_drinks
+true & dead_pid=$!
+wait
+# poke_claim <seq add> – owner = dead_pid, seq += 0 or 1 (Inventory is the
+# 64-byte aligned tail of the file, after 16 + 16 * ATOM_TYPES_MAX bytes)
+poke_claim() {
+python3 - "$dead_pid" "$1" << 'EOF'
+import mmap, struct, sys
+f = open("atoms_mmap.bin", "r+b"); m = mmap.mmap(f.fileno(), 0)
+up = lambda n: (n + 63) // 64 * 64
+at = next(up(16 + 16 * n) for n in range(4, 257, 4)
+          if up(16 + 16 * n) + up(32 + 8 * n) == len(m))
+seq, = struct.unpack_from("<Q", m, at)
+struct.pack_into("<QI", m, at, seq + int(sys.argv[2]), int(sys.argv[1]))
+EOF
+}
+poke_claim 1
+run_drinks "-c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_mmap.bin --mmap"
+poke_claim 1
+printf "ADD OXYGEN 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+poke_claim 0
+printf "ADD OXYGEN 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+rm -f atoms_mmap.bin
+
+# (3e.9) -f --save-thread: updates are saved by the writer thread, with
+#        --ack apply and --ack fsync; a second server on the same file, a bad
+#        --ack and --ack fsync without --save-thread are rejected
+rm -f atoms_saver.bin
+run_drinks "-c 1 -o 1 -h 4 -T 7000 -U 7001 -f atoms_saver.bin --save-thread"
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7002 -U 7003 -f atoms_saver.bin --save-thread < /dev/null || true
+printf "ADD CARBON 2\nADD OXYGEN 2\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+run_drinks "-c 0 -o 0 -h 0 -T 7000 -U 7001 -f atoms_saver.bin --save-thread --ack fsync"
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+printf "ADD HYDROGEN 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+od -An -tu8 atoms_saver.bin || true
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_saver.bin --save-thread --ack later < /dev/null || true
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 --ack fsync < /dev/null || true
+rm -f atoms_saver.bin atoms_saver.bin.lock
+
+# (3e.10) Snapshot format: a legacy raw stock is loaded and converted by the
+#         next write, the snapshot survives a restart, --mmap converts it,
+#         and a snapshot with a flipped byte, a newer version or a damaged
+#         magic, and a raw stock with a count above MAX_ATOMS, are refused
+rm -f atoms_snap.bin
+head -c 24 /dev/zero > atoms_snap.bin
+run_drinks "-c 9 -o 9 -h 9 -T 7000 -U 7001 -f atoms_snap.bin"
+printf "ADD CARBON 3\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+run_drinks "-c 9 -o 9 -h 9 -T 7000 -U 7001 -f atoms_snap.bin"
+stop_drinks
+cp atoms_snap.bin atoms_snap_bad.bin
+printf '\377' | dd of=atoms_snap_bad.bin bs=1 seek=90 conv=notrunc 2>/dev/null
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin < /dev/null || true
+cp atoms_snap.bin atoms_snap_bad.bin
+printf '\002' | dd of=atoms_snap_bad.bin bs=1 seek=12 conv=notrunc 2>/dev/null
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin --save-thread < /dev/null || true
+cp atoms_snap.bin atoms_snap_bad.bin
+printf 'X' | dd of=atoms_snap_bad.bin bs=1 seek=0 conv=notrunc 2>/dev/null
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin < /dev/null || true
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin --mmap < /dev/null || true
+printf '\377\377\377\377\377\377\377\377' > atoms_snap_bad.bin
+head -c 16 /dev/zero >> atoms_snap_bad.bin
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin < /dev/null || true
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_snap_bad.bin --mmap < /dev/null || true
+run_drinks "-c 9 -o 9 -h 9 -T 7000 -U 7001 -f atoms_snap.bin --mmap"
+stop_drinks
+od -An -tu8 -N 24 atoms_snap.bin || true
+rm -f atoms_snap.bin atoms_snap.bin.lock atoms_snap_bad.bin atoms_snap_bad.bin.lock
+
+# (3e.11) --warehouses: ADD creates named warehouses up to the limit, DELIVER
+#         and GEN look them up, and all of them share one snapshot; a
+#         snapshot with more warehouses than allowed, and --warehouses with
+#         --wal or too many, are rejected
+rm -f atoms_wh.bin
+run_drinks "-c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_wh.bin --save-thread --warehouses 2"
+printf "ADD @bar1 HYDROGEN 4\nADD @bar1 OXYGEN 2\nADD @bar2 CARBON 1\nADD @bar3 CARBON 1\nADD @ CARBON 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+printf "DELIVER @bar1 WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+printf "DELIVER @nobar WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+printf "DELIVER @bar2 WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+echo "GEN @bar1 ALL" >&3
+echo "GEN @nobar ALL" >&3
+echo "GEN @bar1" >&3
+stop_drinks
+run_drinks "-T 7000 -U 7001 -f atoms_wh.bin --warehouses 2"
+printf "ADD @bar2 OXYGEN 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+./"$DRINKS_BIN" -T 7000 -U 7001 -f atoms_wh.bin < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 -f atoms_wh.bin --mmap < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 -f atoms_wh.bin --wal --warehouses 2 < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 --warehouses 99999999999 < /dev/null || true
+run_drinks "-T 7000 -U 7001"
+printf "ADD @bar1 CARBON 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+stop_drinks
+rm -f atoms_wh.bin atoms_wh.bin.lock
+
+# (3e.12) --atoms: extra atom types are added, listed in replies, used by a
+#         --recipes column and kept by the snapshot and the WAL; a snapshot
+#         with a type --atoms does not list, bad lists, a --mmap file mapped
+#         with another --atoms order, and plain -f on a mapped file are
+#         rejected
+rm -f atoms_types.bin atoms_types.bin.wal atoms_types.rec
+printf "SALTY DOG 2 1 6 0 3\nBAD GLASS 1 1 1 1 1 1\n" > atoms_types.rec
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T 7000 -U 7001 --atoms SODIUM --recipes atoms_types.rec < /dev/null || true
+printf "SALTY DOG 2 1 6 0 3\n" > atoms_types.rec
+run_drinks "-c 2 -o 1 -h 6 -T 7000 -U 7001 -f atoms_types.bin --wal --atoms NITROGEN,SODIUM --recipes atoms_types.rec"
+printf "ADD SODIUM 5\nADD NITROGEN 2\nADD IRON 1\n" | timeout 1s nc -N 127.0.0.1 7000 || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 7001 || true
+echo "GEN SALTY DOG" >&3
+sleep 0.2
+kill -9 "$SERVER_PID" 2>/dev/null || true
+wait "$SERVER_PID" 2>/dev/null || true
+exec 3>&-
+run_drinks "-T 7000 -U 7001 -f atoms_types.bin --wal --atoms NITROGEN,SODIUM"
+stop_drinks
+./"$DRINKS_BIN" -T 7000 -U 7001 -f atoms_types.bin --atoms SODIUM < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 --atoms SODIUM,SODIUM < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 --atoms sodium < /dev/null || true
+./"$DRINKS_BIN" -T 7000 -U 7001 --atoms NITROGEN,,SODIUM < /dev/null || true
+rm -f atoms_types.bin atoms_types.bin.wal
+run_drinks "-c 1 -o 1 -h 1 -T 7000 -U 7001 -f atoms_types.bin --mmap --atoms NITROGEN,SODIUM"
+./"$DRINKS_BIN" -T 7002 -U 7003 -f atoms_types.bin --mmap --atoms SODIUM,NITROGEN < /dev/null || true
+./"$DRINKS_BIN" -T 7002 -U 7003 -f atoms_types.bin < /dev/null || true
+stop_drinks
+rm -f atoms_types.bin atoms_types.bin.lock atoms_types.bin.wal atoms_types.rec
 
 ########################
 # 3f. drinks_bar_dbg – Stage 1: ADD via TCP
@@ -671,8 +845,20 @@ printf "ADD CARBON 1000000000000000000\n" | timeout 1s nc -N 127.0.0.1 $TCP_BASE
 # (3f.7) Valid “ADD HYDROGEN 42”
 printf "ADD HYDROGEN 42\n" | timeout 1s nc -N 127.0.0.1 $TCP_BASE || true
 
+# (3f.8) Pipelined commands in one segment, the last one without '\n'
+printf "ADD CARBON 1\nADD OXYGEN 2\n\nADD HYDROGEN 3" | timeout 1s nc -N 127.0.0.1 $TCP_BASE || true
+
+# (3f.9) Overlong line → “ERROR: line too long”, the next command still works
+{ head -c 5000 /dev/zero | tr '\0' 'X'; printf "\nADD CARBON 1\n"; } | timeout 1s nc -N 127.0.0.1 $TCP_BASE || true
+
 stop_drinks
 
+# (3f.10) Start counts get the request-count checks: above MAX_ATOMS or not a
+#         number → error plus usage, the server does not start
+./"$DRINKS_BIN" -c 1000000000000000001 -o 1 -h 1 -T $TCP_BASE -U $UDP_BASE < /dev/null || true
+./"$DRINKS_BIN" -c 1 -o 9223372036854775808 -h 1 -T $TCP_BASE -U $UDP_BASE < /dev/null || true
+./"$DRINKS_BIN" -c 1 -o 1 -h -5 -T $TCP_BASE -U $UDP_BASE < /dev/null || true
+
 echo "---- Stage 1 (ADD via TCP) complete ----"
 echo
 
@@ -730,6 +916,20 @@ printf "DELIVER GLUCOSE 1\n"        | timeout 1s nc -u 127.0.0.1 $UDP_BASE || tr
 # (3g.13) “DELIVER ALCOHOL 1” → valid if enough atoms
 printf "DELIVER ALCOHOL 1\n" | timeout 1s nc -u 127.0.0.1 $UDP_BASE || true
 
+# (3g.14) Binary frames (wire.h): magic 0xDB, opcode, item, 0, request id, count (LE)
+#   ADD HYDROGEN 4 + ADD OXYGEN 2 pipelined on one TCP connection, then an
+#   unknown atom id and an unknown opcode
+printf '\xdb\x01\x02\x00\x01\x00\x00\x00\x04\x00\x00\x00\x00\x00\x00\x00\xdb\x01\x01\x00\x02\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00' \
+    | timeout 1s nc -N 127.0.0.1 $TCP_BASE | od -An -tx1 || true
+printf '\xdb\x01\x09\x00\x03\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\xdb\x07\x00\x00\x04\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00' \
+    | timeout 1s nc -N 127.0.0.1 $TCP_BASE | od -An -tx1 || true
+#   DELIVER WATER 2 (ok), DELIVER GLUCOSE 100 (not enough), DELIVER molecule 9 over UDP
+printf '\xdb\x02\x00\x00\x05\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00' | timeout 1s nc -u 127.0.0.1 $UDP_BASE | od -An -tx1 || true
+printf '\xdb\x02\x02\x00\x06\x00\x00\x00\x64\x00\x00\x00\x00\x00\x00\x00' | timeout 1s nc -u 127.0.0.1 $UDP_BASE | od -An -tx1 || true
+printf '\xdb\x02\x09\x00\x07\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00' | timeout 1s nc -u 127.0.0.1 $UDP_BASE | od -An -tx1 || true
+#   count above MAX_ATOMS → number too large
+printf '\xdb\x02\x00\x00\x08\x00\x00\x00\xff\xff\xff\xff\xff\xff\xff\xff' | timeout 1s nc -u 127.0.0.1 $UDP_BASE | od -An -tx1 || true
+
 stop_drinks
 
 echo "---- Stage 2 (DELIVER via UDP) complete ----"
@@ -860,6 +1060,7 @@ printf "DELIVER ALCOHOL 1\n" \
 
 # Clean up
 stop_drinks
+rm -f "$ATOM_FILE_GOOD.lock"
 
 echo "---- Stage 2 UDP-DELIVER branch coverage complete ----"
 echo
@@ -910,6 +1111,22 @@ timeout 1s ./"$DRINKS_BIN" -c 18 -o 18 -h 42 -T $PORT3_TCP -U $PORT3_UDP < <(pri
 # Lowercase “gen” (should be invalid)
 timeout 1s ./"$DRINKS_BIN" -c 18 -o 18 -h 42 -T $PORT3_TCP -U $PORT3_UDP < <(printf "gen soft drink\n") || true
 
+# (3h.7) “GEN ALL” → every molecule and beverage of the recipe table
+timeout 1s ./"$DRINKS_BIN" -c 18 -o 18 -h 42 -T $PORT3_TCP -U $PORT3_UDP < <(printf "GEN ALL\n") || true
+
+# (3h.8) --recipes: a new beverage, a redefined one, then the error paths
+RECIPES_FILE="/tmp/coverage_recipes.txt"
+printf "# name  carbon oxygen hydrogen\nLEMONADE 6 7 12\n\nVODKA 1 1 1\n" > "$RECIPES_FILE"
+timeout 1s ./"$DRINKS_BIN" -c 18 -o 18 -h 42 -T $PORT3_TCP -U $PORT3_UDP --recipes "$RECIPES_FILE" \
+    < <(printf "GEN LEMONADE\nGEN VODKA\n") || true
+for bad in "LEMONADE 1 2" "LEMONADE 1 x 2" "LEMONADE 0 0 0" "WATER 1 1 1" \
+           "A_VERY_LONG_BEVERAGE_NAME_INDEED 1 1 1"; do
+  printf "%s\n" "$bad" > "$RECIPES_FILE"
+  ./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT3_TCP -U $PORT3_UDP --recipes "$RECIPES_FILE" < /dev/null || true
+done
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT3_TCP -U $PORT3_UDP --recipes /nonexistent/recipes < /dev/null || true
+rm -f "$RECIPES_FILE"
+
 echo "---- Stage 3 GEN extra tokens & case check complete ----"
 echo
 
@@ -959,6 +1176,53 @@ kill -0 "$SERVER_PID" 2>/dev/null && echo "⚠️ Server still alive after Timeo
 
 stop_drinks
 
+# Per-connection timers: an idle TCP client is closed after --conn-idle-ms,
+# a half-sent line gets “ERROR: request timeout” after --request-timeout-ms
+run_drinks "-c 0 -o 0 -h 0 -T $PORT4_TCP -U $PORT4_UDP --conn-idle-ms 300 --request-timeout-ms 200"
+(printf "ADD CARBON 1\n"; sleep 0.6) | timeout 2s nc 127.0.0.1 $PORT4_TCP || true
+(printf "ADD CARBON 1\nADD CARB"; sleep 0.5) | timeout 2s nc 127.0.0.1 $PORT4_TCP || true
+(printf "\xdb\x01"; sleep 0.5) | timeout 2s nc 127.0.0.1 $PORT4_TCP | od -An -tx1 || true
+stop_drinks
+
+# Connection limit: the second client is closed, then evicts the idle first one;
+# with --accept-backpressure it waits in the backlog until the first one leaves
+run_drinks "-c 0 -o 0 -h 0 -T $PORT4_TCP -U $PORT4_UDP --max-connections 1 --evict-idle-ms 400 --log-level debug"
+(printf "ADD CARBON 1\n"; sleep 1) | timeout 2s nc 127.0.0.1 $PORT4_TCP &
+NC_PID=$!
+sleep 0.2
+(printf "ADD OXYGEN 1\n"; sleep 0.2) | timeout 2s nc 127.0.0.1 $PORT4_TCP || true
+sleep 0.4
+(printf "ADD OXYGEN 1\n"; sleep 0.2) | timeout 2s nc 127.0.0.1 $PORT4_TCP || true
+wait $NC_PID || true
+stop_drinks
+# The idle client sends again while a new one connects, so its event can
+# follow the accept that evicts it in one batch; the server must survive
+rm -f atoms_evict.bin
+run_drinks "-c 0 -o 0 -h 0 -T $PORT4_TCP -U $PORT4_UDP --max-connections 1 --evict-idle-ms 50 -f atoms_evict.bin"
+python3 - "$PORT4_TCP" << 'EOF' || true
+import socket, sys, time
+port = int(sys.argv[1])
+for _ in range(50):
+    a = socket.create_connection(("127.0.0.1", port))
+    a.sendall(b"ADD CARBON 1\n"); a.recv(100)
+    time.sleep(0.06)
+    b = socket.socket(); b.setblocking(False)
+    b.connect_ex(("127.0.0.1", port))
+    a.sendall(b"ADD CARBON 1\n")
+    time.sleep(0.01)
+    a.close(); b.close()
+EOF
+printf "ADD CARBON 1\n" | timeout 1s nc -N 127.0.0.1 $PORT4_TCP || true
+stop_drinks
+rm -f atoms_evict.bin atoms_evict.bin.lock
+run_drinks "-c 0 -o 0 -h 0 -T $PORT4_TCP -U $PORT4_UDP --max-connections 1 --accept-backpressure"
+(printf "ADD CARBON 1\n"; sleep 0.5) | timeout 2s nc 127.0.0.1 $PORT4_TCP &
+NC_PID=$!
+sleep 0.2
+(printf "ADD HYDROGEN 1\n"; sleep 0.6) | timeout 2s nc 127.0.0.1 $PORT4_TCP || true
+wait $NC_PID || true
+stop_drinks
+
 echo "---- Stage 4 Timeout reset complete ----"
 echo
 
@@ -1041,6 +1305,11 @@ sleep 0.2
 # (a) Send ADD via UDS_STREAM
 printf "ADD HYDROGEN 5\n" | timeout 1s nc -U "$UDS_STREAM" || true
 
+# (a2) UDS_STREAM sessions stay open: pipelined lines, a line split over two
+#      writes and a last line without '\n' are all answered on one connection
+(printf "ADD CARBON 1\nADD OXYGEN 1\nADD CAR"; sleep 0.2; printf "BON 1\nADD OXYGEN 1") \
+  | timeout 1s nc -N -U "$UDS_STREAM" || true
+
 # (b) Send DELIVER WATER 2 via UDS_DGRAM → should succeed (H=10+5=15 → WATER×2 requires 2*2=4 H, leaving 11)
 printf "DELIVER WATER 2\n" | timeout 1s nc -u -U "$UDS_DGRAM" || true
 
@@ -1049,61 +1318,153 @@ printf "DELIVER INVALID 1\n" | timeout 1s nc -u -U "$UDS_DGRAM" || true
 
 stop_drinks
 
+# (d) Same over a batch depth of 1 (one datagram per recvmmsg) and an
+#     out-of-range --dgram-batch → explicit error
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT5_TCP -U $PORT5_UDP --dgram-batch 0 < /dev/null || true
+run_drinks "-c 0 -o 1 -h 2 -T $PORT5_TCP -U $PORT5_UDP -d $UDS_DGRAM --dgram-batch 1"
+printf "DELIVER WATER 1\n" | timeout 1s nc -u -U "$UDS_DGRAM" || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+stop_drinks
+
+# (e) Console log: rate-limited, summarised, filtered by level, bad level
+run_drinks "-c 0 -o 100 -h 200 -T $PORT5_TCP -U $PORT5_UDP --log-rate 1 --log-level debug"
+printf "DELIVER WATER 1\nDELIVER WATER 1\nDELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+sleep 1.1
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+stop_drinks
+run_drinks "-c 0 -o 100 -h 200 -T $PORT5_TCP -U $PORT5_UDP --log-summary-ms 100 --log-level error"
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+printf "ADD CARBON 1\n" | timeout 1s nc -N 127.0.0.1 $PORT5_TCP || true
+sleep 0.3
+stop_drinks
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT5_TCP -U $PORT5_UDP --log-level loud < /dev/null || true
+
+# (f) Statistics: errors and latency per transport, STATS over TCP and on the
+#     console, the metrics endpoint (/metrics, unknown path, not a GET) and a
+#     request timeout; then an out-of-range --metrics-port
+PORT5_METRICS=$((TCP_BASE+301))
+run_drinks "-c 0 -o 0 -h 0 -T $PORT5_TCP -U $PORT5_UDP -s $UDS_STREAM -d $UDS_DGRAM --metrics-port $PORT5_METRICS --request-timeout-ms 200"
+printf "ADD CARBON 1\nADD NEON 1\nSTATS\n" | timeout 1s nc -N 127.0.0.1 $PORT5_TCP || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+printf "ADD OXYGEN 1\n STATS \n" | timeout 1s nc -N -U "$UDS_STREAM" || true
+printf "\xdb\x02\x09\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00" \
+  | timeout 1s nc -u -U "$UDS_DGRAM" | od -An -tx1 || true
+(printf "ADD CARB"; sleep 0.5) | timeout 2s nc 127.0.0.1 $PORT5_TCP || true
+echo "STATS" >&3
+printf "GET /metrics HTTP/1.0\r\n\r\n" | timeout 1s nc -N 127.0.0.1 $PORT5_METRICS | grep -v " 0$" || true
+printf "GET /nothing HTTP/1.0\r\n\r\n" | timeout 1s nc -N 127.0.0.1 $PORT5_METRICS || true
+printf "POST /metrics HTTP/1.0\r\n\r\n" | timeout 1s nc -N 127.0.0.1 $PORT5_METRICS || true
+sleep 0.2
+stop_drinks
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT5_TCP -U $PORT5_UDP --metrics-port 70000 < /dev/null || true
+
+# (g) A client that does not read its replies: 200000 pipelined ADDs fill its
+#     receive window, the rest queue on the server up to --out-high-water and
+#     its reads pause; every reply still arrives once it reads. Then an
+#     out-of-range --out-high-water
+run_drinks "-c 0 -o 0 -h 0 -T $PORT5_TCP -U $PORT5_UDP --out-high-water 4096 --log-level warn"
+exec 5<>"/dev/tcp/127.0.0.1/$PORT5_TCP"
+(yes "ADD HYDROGEN 1" | head -n 200000 >&5) &
+WRITER_PID=$!
+sleep 0.5
+timeout 5s head -n 200000 <&5 | tail -n 1 || true
+wait $WRITER_PID || true
+exec 5>&-
+stop_drinks
+./"$DRINKS_BIN" -c 1 -o 1 -h 1 -T $PORT5_TCP -U $PORT5_UDP --out-high-water 0 < /dev/null || true
+
+# (h) --io-uring (epoll if the kernel has no io_uring): every transport, a
+#     split line, a client that does not read with a small --out-high-water,
+#     a full server with --accept-backpressure and two workers
+run_drinks "-c 0 -o 1 -h 2 -T $PORT5_TCP -U $PORT5_UDP -s $UDS_STREAM -d $UDS_DGRAM --io-uring --out-high-water 4096 --log-level warn"
+(printf "ADD CARBON 1\nADD OXY"; sleep 0.2; printf "GEN 1\nSTATS\n") | timeout 1s nc -N 127.0.0.1 $PORT5_TCP | head -n 2 || true
+printf "ADD HYDROGEN 2\nADD OXYGEN 1" | timeout 1s nc -N -U "$UDS_STREAM" || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u 127.0.0.1 $PORT5_UDP || true
+printf "DELIVER WATER 1\n" | timeout 1s nc -u -U "$UDS_DGRAM" || true
+exec 5<>"/dev/tcp/127.0.0.1/$PORT5_TCP"
+(yes "ADD HYDROGEN 1" | head -n 200000 >&5) &
+WRITER_PID=$!
+sleep 0.5
+timeout 5s head -n 200000 <&5 | tail -n 1 || true
+wait $WRITER_PID || true
+exec 5>&-
+stop_drinks
+run_drinks "-c 0 -o 0 -h 0 -T $PORT5_TCP -U $PORT5_UDP --io-uring --workers 2 --max-connections 1 --accept-backpressure"
+exec 5<>"/dev/tcp/127.0.0.1/$PORT5_TCP"
+printf "ADD CARBON 1\n" >&5
+(printf "ADD OXYGEN 1\n"; sleep 0.2) | timeout 1s nc 127.0.0.1 $PORT5_TCP || true
+exec 5>&-
+sleep 0.2
+stop_drinks
+
 echo "---- Stage 5 UDS real test complete ----"
 echo
 
-########################
-# 4. Rename any *.gcno and *.gcda (if needed)
-########################
+if [[ "$PROFILE_RUN" != 1 ]]; then
 
-echo "---- Step 4: Renaming any newly-generated .gcno/.gcda ----"
+    ########################
+    # 4. Rename any *.gcno and *.gcda (if needed)
+    ########################
 
-for src in "$DRINKS_SRC" "$ATOM_SRC" "$MOL_SRC"; do
-    base="${src%.c}"
+    echo "---- Step 4: Renaming any newly-generated .gcno/.gcda ----"
 
-    # Sometimes coverage tools name them "<base>.gcno" directly.
-    # If, however, they end up as e.g. "<something>-${base}.gcno", catch both:
-    for note in ./"${base}"*.gcno*; do
-        [[ -f "$note" ]] || continue
-        mv -f "$note" "./${base}.gcno"
-        echo "  → Renamed $(basename "$note") → ${base}.gcno"
-    done
+    for src in "$DRINKS_SRC" $DRINKS_MODULES "$ATOM_SRC" "$MOL_SRC"; do
+        base="${src%.c}"
+
+        # Sometimes coverage tools name them "<base>.gcno" directly.
+        # If, however, they end up as e.g. "<binary>-${base}.gcno" (several sources
+        # linked into one binary), catch both:
+        for note in ./"${base}"*.gcno* ./*-"${base}".gcno; do
+            [[ -f "$note" && "$note" != "./${base}.gcno" ]] || continue
+            [[ "$note" == ./"${base}"*-*.gcno && "$note" != *-"${base}".gcno ]] && continue
+            mv -f "$note" "./${base}.gcno"
+            echo "  → Renamed $(basename "$note") → ${base}.gcno"
+        done
 
-    for data in ./"${base}"*.gcda*; do
-        [[ -f "$data" ]] || continue
-        mv -f "$data" "./${base}.gcda"
-        echo "  → Renamed $(basename "$data") → ${base}.gcda"
+        for data in ./"${base}"*.gcda* ./*-"${base}".gcda; do
+            [[ -f "$data" && "$data" != "./${base}.gcda" ]] || continue
+            [[ "$data" == ./"${base}"*-*.gcda && "$data" != *-"${base}".gcda ]] && continue
+            mv -f "$data" "./${base}.gcda"
+            echo "  → Renamed $(basename "$data") → ${base}.gcda"
+        done
     done
-done
 
-echo "---- Renaming of .gcno/.gcda complete ----"
-echo
+    echo "---- Renaming of .gcno/.gcda complete ----"
+    echo
 
-########################
-# 5. Generate gcov output
-########################
+    ########################
+    # 5. Generate gcov output
+    ########################
 
-echo "========================================"
-echo "5. Generating gcov reports"
-echo "========================================"
+    echo "========================================"
+    echo "5. Generating gcov reports"
+    echo "========================================"
 
-gcov -o . "$DRINKS_SRC"   || true
-gcov -o . "$ATOM_SRC"     || true
-gcov -o . "$MOL_SRC"      || true
+    gcov -o . "$DRINKS_SRC"   || true
+    for mod in $DRINKS_MODULES; do
+        gcov -o . "$mod"      || true
+    done
+    gcov -o . "$ATOM_SRC"     || true
+    gcov -o . "$MOL_SRC"      || true
 
-echo
-echo "---- Coverage summary (grep \"Lines executed\") ----"
-grep "Lines executed" *.gcov || true
+    echo
+    echo "---- Coverage summary (grep \"Lines executed\") ----"
+    grep "Lines executed" *.gcov || true
 
-echo
-echo "---- All done. Check the *.gcov files for ≥85% coverage. ----"
-echo
+    echo
+    echo "---- All done. Check the *.gcov files for ≥85% coverage. ----"
+    echo
+
+fi
 
 ########################
 # 6. Cleanup
 ########################
 
-# Kill any leftover processes, remove FIFOs/UDS sockets
+# Kill any leftover processes (but not this script, so that it exits 0),
+# remove FIFOs/UDS sockets
+trap '' TERM
 kill 0 2>/dev/null || true
+trap - TERM
 rm -f "$FIFO_STDIN" "$UDS_STREAM" "$UDS_DGRAM" /tmp/mol_dgram.sock /tmp/atom_stream.sock
 echo "---- CLEANUP complete ----"
@@ -0,0 +1,79 @@
+/*
+** crc32c.c -- CRC-32C with hardware acceleration (see crc32c.h)
+*/
+
+#include "crc32c.h"
+
+#include <string.h>          // memcpy
+#include <pthread.h>         // pthread_once
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>       // _mm_crc32_u64, _mm_crc32_u8
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>        // __crc32cd, __crc32cb
+#endif
+
+typedef uint32_t (*crc_fn)(uint32_t c, const unsigned char *p, size_t len);
+
+// ----------------------------------------------------------------------------
+// Portable fallback, table driven (reflected polynomial 0x82F63B78)
+// ----------------------------------------------------------------------------
+static uint32_t crc_table[256];
+
+static uint32_t crc_sw(uint32_t c, const unsigned char *p, size_t len) {
+    while (len--) {
+        c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    }
+    return c;
+}
+
+// ----------------------------------------------------------------------------
+// One CRC32 instruction per 8 bytes
+// ----------------------------------------------------------------------------
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc_hw(uint32_t c, const unsigned char *p, size_t len) {
+    uint64_t c64 = c;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c64 = _mm_crc32_u64(c64, v);
+    }
+    c = (uint32_t)c64;
+    while (len--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc_hw(uint32_t c, const unsigned char *p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = __crc32cd(c, v);
+    }
+    while (len--) c = __crc32cb(c, *p++);
+    return c;
+}
+#endif
+
+static crc_fn crc_impl = crc_sw;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+        }
+        crc_table[i] = c;
+    }
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) crc_impl = crc_hw;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc_impl = crc_hw;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    return ~crc_impl(~crc, data, len);
+}
@@ -0,0 +1,19 @@
+/*
+** crc32c.h -- CRC-32C (Castagnoli), shared by the WAL records and snapshots
+**
+** Uses the CPU's CRC32 instruction (SSE4.2 on x86-64, the CRC extension on
+** AArch64) when the CPU has it and a lookup table otherwise; both give the
+** same value, so files move freely between machines.
+*/
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint32_t
+
+// Extend `crc` (0 to start) over `len` bytes of `data`, zlib style:
+// crc32c(crc32c(0, a, n), b, m) == CRC of a followed by b.
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32C_H
@@ -3,6 +3,9 @@
 **   • TCP ADD CARBON / ADD OXYGEN / ADD HYDROGEN (Stage 1)
 **   • UDP DELIVER WATER / CARBON DIOXIDE / GLUCOSE / ALCOHOL (Stage 2)
 **   • console commands to tell how many beverages (SOFT DRINK, VODKA, CHAMPAGNE) can be made (Stage 3)
+**     (“GEN ALL” lists every molecule and beverage of the recipe table)
+**   • “STATS” on the console or a stream connection: request, error, byte,
+**     connection and latency counters per transport
 **   • optionally also accept UDS‐STREAM (‐s) or UDS‐DGRAM (‐d) like UDP/TCP
 **
 ** Mandatory flags: 
@@ -13,9 +16,42 @@
 **   -U <udp_port>
 **
 ** Optional: 
-**   -t <timeout_seconds>
+**   -t <timeout_seconds>   (shut down after that long without any request)
 **   -s <uds_stream_path>   (if you want a Unix‐domain STREAM socket in addition to TCP+UDP)
 **   -d <uds_dgram_path>    (if you want a Unix‐domain DGRAM socket in addition to TCP+UDP)
+**   -w, --workers <N>      (N event-loop threads, each with its own SO_REUSEPORT TCP+UDP sockets)
+**   -f <file path>         (keep the inventory in a file, rewritten after every update)
+**   --wal                  (with -f: append updates to "<file>.wal" with group commit instead)
+**   --wal-sync-ms <ms>     (group commit interval, default 2)
+**   --wal-sync-ops <N>     (group commit as soon as N records are pending, default 4096)
+**   --wal-compact-ops <N>  (fold the log into the -f snapshot every N records, default 1000000)
+**   --mmap                 (with -f: map the file MAP_SHARED, every process works on it directly)
+**   --msync-ms <ms>        (with --mmap: msync the file this often, default 0 = on shutdown only)
+**   --save-thread          (with -f: a writer thread saves the latest inventory, coalescing updates)
+**   --ack <apply|fsync>    (with --save-thread: reply once an update is applied (default) or
+**                          only once it is on disk)
+**   --dgram-batch <N>      (UDP / UDS-DGRAM datagrams per recvmmsg/sendmmsg, default 32)
+**   --recipes <file>       (add or redefine GEN beverages, see recipes.h)
+**   --log-level <level>    (error, warn, info (default) or debug; inventory lines are info)
+**   --log-rate <N>         (print at most N log lines per second, default 0 = no limit)
+**   --log-summary-ms <ms>  (one inventory line per period instead of one per update)
+**   --conn-idle-ms <ms>    (close a stream connection that sent nothing for that long)
+**   --request-timeout-ms <ms> (close a stream connection whose started request is not
+**                          complete in time; text clients get "ERROR: request timeout")
+**   --max-connections <N>  (at most N open TCP / UDS-STREAM connections, default 0 = no limit)
+**   --evict-idle-ms <ms>   (when full, a new client replaces the least recently active
+**                          connection idle for that long; default 0 = never evict)
+**   --accept-backpressure  (when full, leave new clients in the listen backlog instead
+**                          of accepting and closing them)
+**   --metrics-port <port>  (Prometheus text metrics over HTTP on that port, see stats.h)
+**   --out-high-water <bytes> (stop reading from a stream client while that many reply
+**                          bytes wait for it to read them, default 262144)
+**   --io-uring             (io_uring event loops: multishot accept and receive, replies
+**                          submitted in batches; epoll if the kernel lacks support)
+**   --warehouses <N>       (serve up to N named inventories: "ADD @bar42 CARBON 10",
+**                          "DELIVER @bar42 WATER 1", console "GEN @bar42 ALL")
+**   --atoms <A,B,...>      (atom types besides carbon, oxygen and hydrogen, e.g.
+**                          NITROGEN,SULFUR,SODIUM; see atoms.h)
 **
 ** Examples:
 **   ./drinks_bar -c 100 -o 50 -h 200 -T 5555 -U 6666
@@ -27,8 +63,16 @@
 **   ./drinks_bar -c 10 -o 10 -h 10 -T 5555 -U 6666 -d /tmp/my_dgram.sock
 **     (TCP/UDP plus a UDS-DGRAM socket at /tmp/my_dgram.sock)
 **
+**   ./drinks_bar -c 10 -o 10 -h 10 -T 5555 -U 6666 --workers 4
+**     (TCP/UDP spread by the kernel over 4 event-loop threads)
+**
+**   ./drinks_bar -c 10 -o 10 -h 10 -T 5555 -U 6666 -f /tmp/bar.inv --wal
+**     (inventory in /tmp/bar.inv, updates logged to /tmp/bar.inv.wal)
+**
 */
 
+#define _GNU_SOURCE          // SO_REUSEPORT and other Linux extensions
+
 #include <stdio.h>           // printf, fprintf, perror
 #include <stdlib.h>          // exit, malloc, free
 #include <string.h>          // strlen, strcmp, strtok_r, strncpy, snprintf, memset, memcpy
@@ -42,38 +86,179 @@
 #include <netdb.h>           // getaddrinfo, freeaddrinfo, struct addrinfo
 #include <arpa/inet.h>       // inet_ntop
 #include <netinet/in.h>      // sockaddr_in, sockaddr_in6
-#include <sys/select.h>      // select, fd_set, FD_ZERO, FD_SET, FD_ISSET
+#include <sys/epoll.h>       // epoll_create1, epoll_ctl, epoll_wait
+#include <poll.h>            // POLLIN (io_uring poll requests)
+#include <sys/uio.h>         // readv, struct iovec
+#include <sys/resource.h>    // getrlimit, setrlimit, RLIMIT_NOFILE
 #include <sys/wait.h>        // waitpid, WNOHANG
-#include <signal.h>          // sigaction, SIGCHLD, SIGALRM
+#include <signal.h>          // sigaction, SIGCHLD
 #include <getopt.h>          // getopt_long
 #include <stddef.h>          // offsetof
-#include <sys/file.h>   // flock
 #include <fcntl.h>
 #include <sys/stat.h>
-
-#define MAX_ATOMS  ((uint64_t)1000000000000000000ULL)  // 10^18 maximum quantity
-#define BACKLOG    10                                   // TCP listen backlog
-#define MAX_CLIENTS FD_SETSIZE                           // max simultaneous TCP clients
+#include <sys/eventfd.h>     // eventfd (stop the worker threads)
+#include <pthread.h>         // pthread_create, pthread_join, pthread_mutex_t
+
+#include "inventory.h"       // AtomStock, Inventory, MAX_ATOMS
+#include "wal.h"             // wal_open, wal_append, wal_close
+#include "shared_inventory.h" // shared_inventory_open, shared_inventory_close
+#include "wire.h"            // WireRequest, WireReply (binary protocol)
+#include "parser.h"          // parse_command (text protocol)
+#include "recipes.h"         // recipe table (DELIVER molecules, GEN beverages)
+#include "logger.h"          // log_msg (asynchronous console log)
+#include "timer_wheel.h"     // per-worker timers (idle timeouts, request deadlines)
+#include "stats.h"           // per-worker counters, STATS, metrics endpoint
+#include "uring.h"           // io_uring rings (--io-uring)
+#include "saver.h"           // saver_open, saver_publish, saver_wait (--save-thread)
+#include "snapshot.h"        // snapshot_load, snapshot_write, snapshot_lock (-f file)
+#include "warehouse.h"       // named inventories (--warehouses)
+#include "atoms.h"           // configured atom types (--atoms)
+
+#define BACKLOG    SOMAXCONN                            // TCP listen backlog
+#define MAX_EVENTS 64                                    // epoll events handled per wakeup
 #define MAXBUF     1024                                  // buffer size for recv/send
+#define MAX_WORKERS 64                                   // upper bound for --workers
+#define CONN_INBUF  4096                                 // per-connection input ring (power of two)
+#define CONN_CHUNK  64                                   // Conn slots a worker allocates at a time
+#define REPLY_BUF   65536                                // replies batched per readiness event
+#define DEFAULT_OUT_HIGH_WATER 262144                    // unsent reply bytes before a client's reads pause
+#define DEFAULT_DGRAM_BATCH 32                           // datagrams per recvmmsg / sendmmsg
+#define MAX_DGRAM_BATCH     1024                         // upper bound for --dgram-batch
+#define ACCEPT_RETRY_MS     50                           // --accept-backpressure: recheck a paused listener
+#define STATS_TEXT_MAX      16384                        // reply to one STATS command
+#define UR_ENTRIES          256                          // --io-uring: SQEs per worker ring
+#define UR_CQ_ENTRIES       4096                         // CQEs (multishot requests post many)
+#define UR_STREAM_BUFS      256                          // provided buffers for stream clients ...
+#define UR_DGRAM_BUFS       256                          // ... and for datagrams (powers of two)
+
+// getopt_long values for options without a short form
+enum {
+    OPT_WAL = 256,
+    OPT_WAL_SYNC_MS,
+    OPT_WAL_SYNC_OPS,
+    OPT_WAL_COMPACT_OPS,
+    OPT_MMAP,
+    OPT_MSYNC_MS,
+    OPT_DGRAM_BATCH,
+    OPT_RECIPES,
+    OPT_LOG_LEVEL,
+    OPT_LOG_RATE,
+    OPT_LOG_SUMMARY_MS,
+    OPT_CONN_IDLE_MS,
+    OPT_REQUEST_TIMEOUT_MS,
+    OPT_MAX_CONNECTIONS,
+    OPT_EVICT_IDLE_MS,
+    OPT_ACCEPT_BACKPRESSURE,
+    OPT_METRICS_PORT,
+    OPT_OUT_HIGH_WATER,
+    OPT_IO_URING,
+    OPT_SAVE_THREAD,
+    OPT_ACK,
+    OPT_WAREHOUSES,
+    OPT_ATOMS
+};
+
+// Global atomic stock (initialized via flags -c, -o, -h).
+// Shared by all workers without a mutex, see inventory.h. With -f --mmap it
+// points into the mapped file instead (shared_inventory.h).
+static Inventory local_inventory;
+static Inventory *inventory = &local_inventory;
+
+//if we will have -f flag than we will save here the path of the file to load/save the atoms from.
+static char *save_file_path = NULL;
+
+// How updates reach the -f file
+typedef enum {
+    PERSIST_NONE,       // no -f: memory only
+    PERSIST_REWRITE,    // -f: reload + rewrite the whole file per request
+    PERSIST_WAL,        // -f --wal: append to <file>.wal, group commit (wal.c)
+    PERSIST_MMAP,       // -f --mmap: the inventory lives in the mapped file
+    PERSIST_THREAD      // -f --save-thread: a writer thread saves the latest stock (saver.c)
+} PersistMode;
+static PersistMode persist_mode = PERSIST_NONE;
+
+// --ack fsync: replies to updates wait until saver_durable() covers them.
+// Each worker thread remembers the newest saver ticket it has answered but
+// not yet waited for, and waits once before it sends a batch of replies.
+static bool ack_fsync = false;
+static __thread uint64_t unacked_ticket = 0;
+
+// Inactivity timeout in seconds (-t), 0 = disabled. Every worker stamps
+// last_activity_ms once per wakeup; worker 0's idle timer compares against it.
+static int timeout_secs = 0;
+static uint64_t last_activity_ms = 0;
+
+// Per-connection limits in ms, 0 = disabled:
+//   conn_idle_ms        close a stream connection that sent nothing for that long
+//   request_timeout_ms  close it if a started request is not complete in time
+static unsigned conn_idle_ms = 0;
+static unsigned request_timeout_ms = 0;
+
+// Connection limit over all workers (--max-connections, 0 = only the fd limit).
+// When it is reached, a new client takes the place of the worker's least
+// recently active connection if that one has been idle for evict_idle_ms
+// (0 = never evict); otherwise it is accepted and closed right away or, with
+// --accept-backpressure, left in the listen backlog until a slot frees up.
+static size_t max_connections = 0;
+static unsigned evict_idle_ms = 0;
+static bool accept_backpressure = false;
+static size_t open_connections = 0;        // atomic, every worker's stream clients
+
+// Updates since the last --log-summary-ms line (0 when every update is logged)
+static uint64_t updates_since_summary = 0;
+static unsigned log_summary_ms = 0;
+
+// Replies a stream client has not read yet are queued on its connection
+// (never waited for). Once out_high_water bytes are queued the server stops
+// reading that client's requests until half of them are sent (--out-high-water).
+static size_t out_high_water = DEFAULT_OUT_HIGH_WATER;
+
+// --io-uring: workers run run_uring_loop() instead of run_event_loop(), unless
+// the kernel cannot (see uring_probe())
+static bool use_io_uring = false;
+
+// Datagrams received / answered per system call on UDP and UDS_DGRAM (--dgram-batch)
+static unsigned dgram_batch = DEFAULT_DGRAM_BATCH;
+
+// With plain -f every request reloads the file, updates and saves it again;
+// this serializes that round trip between the worker threads. Without -f or
+// with --wal the inventory needs no lock at all.
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// eventfd written by worker 0 to stop the other workers (only with --workers > 1)
+static int shutdown_fd = -1;
 
 // ----------------------------------------------------------------------------
-// Struct to store counts of each atom type (Stage 1)
+// One event-loop thread. Each worker has its own epoll instance and its own
+// SO_REUSEPORT TCP/UDP sockets; accepted TCP clients stay on the worker that
+// accepted them. Worker 0 runs on the main thread and also owns the console
+// and the optional UDS sockets.
 // ----------------------------------------------------------------------------
 typedef struct {
-    uint64_t carbon;    // count of carbon atoms
-    uint64_t oxygen;    // count of oxygen atoms
-    uint64_t hydrogen;  // count of hydrogen atoms
-} AtomStock;
-
-
-// Global atomic stock (initialized via flags -c, -o, -h)
-static AtomStock atom_stock = { 0, 0, 0 };
-
-// A simple flag set by SIGALRM to signal “timeout” (Stage 4)
-static volatile sig_atomic_t timed_out = 0;
-
-//if we will have -f flag than we will save here the path of the file to load/save the atoms from.
-static char *save_file_path = NULL;
+    int       id;             // 0 .. num_workers-1
+    int       epfd;           // this worker's epoll instance
+    int       tcp_listen_fd;  // TCP listener on -T
+    int       udp_fd;         // UDP socket on -U
+    int       uds_stream_fd;  // -1 unless worker 0 and -s was given
+    int       uds_dgram_fd;   // -1 unless worker 0 and -d was given
+    bool      console;        // watch STDIN_FILENO (worker 0 only)
+    pthread_t thread;         // unused for worker 0
+    TimerWheel *wheel;        // this worker's timers (run_event_loop)
+    Timer     idle_timer;     // -t, worker 0 only
+    bool      timed_out;      // set by idle_timer
+    uint64_t  now;            // timer_now_ms() of the current wakeup
+    struct Conn **live;       // this worker's open connections, densely packed
+    size_t    live_count;
+    size_t    live_cap;
+    struct Conn *free_conns;  // recycled Conn slots
+    struct ConnChunk *chunks; // every slot block, freed when the loop ends
+    struct Conn *lru_head;    // this worker's connections, least recently active first
+    struct Conn *lru_tail;    // ... and most recently active last
+    bool      accept_paused;  // --accept-backpressure: tcp_listen_fd is not polled
+    Timer     accept_timer;   // retries a paused listener every ACCEPT_RETRY_MS
+    StatsShard *stats;        // this worker's counters (stats.h)
+    struct UringLoop *uring;  // --io-uring: this worker's ring, NULL with epoll
+} Worker;
 
 // ----------------------------------------------------------------------------
 // Prototypes
@@ -82,463 +267,2359 @@ static char *save_file_path = NULL;
 // SIGCHLD handler: reap any zombie children
 void sigchld_handler(int sig);
 
-// SIGALRM handler: mark that timeout occurred
-void alarm_handler(int sig);
-
 // Get the “address field” portion (IPv4 or IPv6) from sockaddr*
 void *get_in_addr(struct sockaddr *sa);
 
 // Print the current stock of atoms to stdout
 void print_inventory(void);
 
-// Handle exactly one TCP client command on `client_fd` (an “ADD …” line).
-// - Reads one line, parses “ADD <TYPE> <NUM>\n”
-// - Updates atom_stock
-// - Sends back either “OK: Carbon=… Oxygen=… Hydrogen=…\n” or “ERROR: …\n”
-// Returns false if the client closed connection or a read‐error occurred.
-bool handle_tcp_client(int client_fd);
+// Result of one handle_tcp_client() call
+typedef enum {
+    CLIENT_ACTIVE,       // data was read and answered, there may be more
+    CLIENT_WOULD_BLOCK,  // non-blocking socket has nothing more to read right now
+    CLIENT_CLOSED        // client closed the connection or a read-error occurred
+} ClientStatus;
+
+// Protocol of a stream connection, chosen by its first byte (see wire.h)
+typedef enum {
+    PROTO_UNKNOWN,            // nothing received yet
+    PROTO_TEXT,               // “ADD …\n” lines
+    PROTO_BINARY              // fixed-size WireRequest frames
+} ConnProto;
+
+// One stream connection (TCP client or UDS_STREAM). Bytes are collected in a
+// ring buffer and cut into commands at '\n' (or into WireRequest frames), so
+// pipelined commands are all served and a command split over two reads is
+// put back together.
+typedef struct Conn {
+    int       fd;
+    ConnProto proto;
+    size_t    head;           // index of the first buffered byte in `in`
+    size_t    len;            // number of buffered bytes
+    bool      discard;        // skip up to the next '\n' (rest of an overlong line)
+    uint64_t  requests;       // requests served so far
+    uint64_t  last_active;    // ms of the last read (--conn-idle-ms)
+    Timer     idle_timer;     // --conn-idle-ms
+    Timer     deadline_timer; // --request-timeout-ms: a buffered request must complete
+    Worker   *owner;          // the worker that accepted it
+    size_t    live_index;     // position in owner->live
+    struct Conn *lru_prev;    // owner's LRU list, ordered by last_active
+    struct Conn *lru_next;    // (next free slot while on owner->free_conns)
+    StatsTransport transport; // STATS_TCP or STATS_UDS_STREAM
+    char     *pend;           // replies the socket did not take yet (NULL if none)
+    size_t    pend_head;      // first unsent byte in `pend`
+    size_t    pend_len;       // unsent bytes
+    size_t    pend_cap;
+    bool      want_write;     // EPOLLOUT is registered (pend_len > 0)
+    bool      read_paused;    // pend_len reached out_high_water: requests wait in the socket
+    bool      closing;        // peer has finished sending: close once `pend` is sent
+    // --io-uring only: the kernel owns `sbuf` until its send completes, so
+    // new replies collect in `pend` meanwhile
+    char     *sbuf;
+    size_t    sbuf_off;       // bytes of sbuf already sent
+    size_t    sbuf_len;
+    size_t    sbuf_cap;
+    bool      recv_armed;     // a multishot recv is pending
+    bool      send_inflight;  // a send of sbuf is pending
+    bool      dead;           // closed, the fd stays open until both have completed
+    char      in[CONN_INBUF];  // must stay last, see conn_alloc()
+} Conn;
+
+// Conn slots are carved out of these blocks and recycled through a per-worker
+// free list, so accepting and closing does not go through malloc / free.
+typedef struct ConnChunk {
+    struct ConnChunk *next;
+    Conn              slots[CONN_CHUNK];
+} ConnChunk;
+
+// Open stream connections (TCP and UDS_STREAM) indexed by fd, for O(1) dispatch of epoll events (an fd
+// is only ever used by the worker that accepted it, so the slots need no
+// locking). Walking the connections goes through the workers' `live` arrays.
+static Conn **conn_table = NULL;
+static size_t conn_table_size = 0;
+
+// Replies produced while serving one readiness event, sent with one write
+typedef struct {
+    size_t len;
+    char   data[REPLY_BUF];
+} ReplyBuf;
 
-// Parse a single “ADD <TYPE> <NUM>” line (no trailing newline), update atom_stock.
+// One worker's buffers for batched datagram I/O: up to `depth` requests are
+// taken with one recvmmsg() and their replies sent with one sendmmsg().
+typedef struct {
+    unsigned                 depth;
+    struct mmsghdr          *in;
+    struct mmsghdr          *reply;
+    struct iovec            *in_iov;
+    struct iovec            *reply_iov;
+    struct sockaddr_storage *addr;       // sender of in[i] (IPv4/IPv6 or sockaddr_un)
+    char                   (*buf)[MAXBUF];
+    char                   (*resp)[MAXBUF];
+} DgramBatch;
+
+// --io-uring state of one worker (run_uring_loop())
+typedef struct UringLoop {
+    Uring           ring;
+    UringBufRing    stream_bufs;      // multishot recv on stream clients
+    UringBufRing    dgram_bufs;       // multishot recvmsg on UDP / UDS_DGRAM
+    struct msghdr   dgram_msg;        // layout of a dgram_bufs buffer (sender, then payload)
+    DgramBatch     *replies;          // reply slot i: reply[i], addr[i], resp[i]
+    unsigned       *free_slots;       // stack of unused reply slots
+    unsigned        free_count;
+    StatsTransport *slot_transport;   // transport of the reply in slot i
+    bool            accept_armed[2];  // tcp_listen_fd, uds_stream_fd
+    bool            dgram_armed[2];   // udp_fd, uds_dgram_fd
+    bool            stopping;         // leaving the loop: nothing is re-armed
+} UringLoop;
+
+// cqe->user_data of every io_uring request: what it is, and its fd (or the
+// reply slot of a UR_SENDMSG)
+typedef enum {
+    UR_ACCEPT = 1,
+    UR_RECV,
+    UR_SEND,
+    UR_RECVMSG,
+    UR_SENDMSG,
+    UR_CONSOLE,
+    UR_SHUTDOWN,
+    UR_CANCEL
+} UringOp;
+#define UR_DATA(op, fd)  ((uint64_t)(op) << 32 | (uint32_t)(fd))
+#define UR_OP(data)      ((UringOp)((data) >> 32))
+#define UR_FD(data)      ((int)(uint32_t)(data))
+
+// Read once from `c` and run every complete “ADD …” line (or binary frame)
+// received so far.
+// - Each line is parsed as “ADD <TYPE> <NUM>”
+// - Updates the inventory
+// - Appends either “OK: Carbon=… Oxygen=… Hydrogen=…\n” or “ERROR: …\n” to `out`
+// On end of stream a final line without '\n' is served as well.
+// Returns CLIENT_CLOSED if the client closed connection or a read‐error occurred.
+ClientStatus handle_tcp_client(Conn *c, ReplyBuf *out);
+
+// Run one binary ADD / DELIVER frame and fill in its reply (see wire.h).
+void handle_wire_request(const WireRequest *req, WireReply *reply);
+
+// Send everything in `out` to `c` and empty it; what the socket does not take
+// right now is queued on `c` for EPOLLOUT. Returns false if the client is gone.
+bool reply_flush(Conn *c, ReplyBuf *out);
+
+// Read one line from stdin and run the “GEN …” console command in it.
+// Returns false on EOF / read error (the server should shut down).
+bool handle_console_input(void);
+
+// Put `fd` into O_NONBLOCK mode (needed for edge-triggered epoll). Returns -1 on error.
+int set_nonblocking(int fd);
+
+// Register `fd` for EPOLLIN (plus `extra_flags`, e.g. EPOLLET) on `epfd`.
+int epoll_add(int epfd, int fd, uint32_t extra_flags);
+
+// Parse a single “ADD <TYPE> <NUM>” line of `len` bytes, update the inventory.
 // Fill `response` with either
 //   “OK: Carbon=.. Oxygen=.. Hydrogen=..\n”
 // or “ERROR: ...\n”
-void parse_and_update_tcp(const char *line, char *response, size_t resp_size);
+// Returns the command that was recognized (CMD_NONE if neither ADD nor DELIVER).
+CmdKind parse_and_update_tcp(const char *line, size_t len, char *response, size_t resp_size);
 
-// Parse a single “DELIVER <MOLECULE> <NUM>” line, check atom stock,
-// subtract required atoms if possible, and fill `response` with
+// Parse a single “DELIVER <MOLECULE> <NUM>” line of `len` bytes, check atom
+// stock, subtract required atoms if possible, and fill `response` with
 //   “OK: Atoms left – Carbon=.. Oxygen=.. Hydrogen=..\n”
 // or “ERROR: ...\n”
-void parse_and_update_udp(const char *line, char *response, size_t resp_size);
+// Returns the command that was recognized, like parse_and_update_tcp().
+CmdKind parse_and_update_udp(const char *line, size_t len, char *response, size_t resp_size);
 
-//if the file exists and big enough , reads sizeof (atomStock) to the global var.
-//else creating a new file , fills it with the values of the atoms and read the full struct to the file.
+//if the file holds a valid snapshot, loads its stock into the inventory.
+//else (missing or too small) creates it from the initial values; exits if it is damaged.
 static void load_atoms_from_file(const char *path, uint64_t init_c,uint64_t init_o,uint64_t init_h);
 
 
-//opens / creates the file in rb or wb. locks the file with flock to prevent parallel changes.
-//writes a block of our atoms struct with fwrite.
-//releases the lock and closes the files.
+//writes the current stock to a temporary snapshot and renames it over the file (see snapshot.h).
 static void save_atoms_to_file(const char *path);
 
 // ----------------------------------------------------------------------------
-// SIGALRM handler: marks that we timed out (no activity for <timeout> seconds).
-// We use write() (async‐signal safe) just to print a quick message.
+// Print the current atom inventory on stdout.
 // ----------------------------------------------------------------------------
-void alarm_handler(int sig) {
-    (void)sig;
-    const char msg[] = ">>> Alarm handler invoked! Server shutting down due to inactivity.\n";
-    write(STDOUT_FILENO, msg, sizeof(msg) - 1);
-    timed_out = 1;
+void print_inventory(void) {
+    AtomStock snap;
+    char list[MAXBUF];
+    inventory_read(inventory, &snap);
+    atoms_format(list, sizeof(list), &snap, "  ");
+    printf("SERVER INVENTORY (atoms): %s\n", list);
 }
 
 // ----------------------------------------------------------------------------
-// Print the current atom inventory on stdout.
+// --log-summary-ms: one inventory line per period instead of one per update.
+// Runs on the logger thread.
 // ----------------------------------------------------------------------------
-void print_inventory(void) {
-    printf("SERVER INVENTORY (atoms): Carbon=%llu  Oxygen=%llu  Hydrogen=%llu\n",
-           (unsigned long long)atom_stock.carbon,
-           (unsigned long long)atom_stock.oxygen,
-           (unsigned long long)atom_stock.hydrogen);
+static size_t inventory_summary(char *buf, size_t size) {
+    uint64_t n = __atomic_exchange_n(&updates_since_summary, 0, __ATOMIC_RELAXED);
+    if (n == 0) return 0;
+    AtomStock snap;
+    char list[MAXBUF];
+    inventory_read(inventory, &snap);
+    atoms_format(list, sizeof(list), &snap, "  ");
+    int len = snprintf(buf, size, "SERVER INVENTORY (atoms): %s  (%llu updates)",
+                       list, (unsigned long long)n);
+    return len > 0 ? (size_t)len : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Persistence hooks around every ADD / DELIVER.
+//   PERSIST_REWRITE: pick up the file, then rewrite it after the update.
+//   PERSIST_WAL:     memory is authoritative; queue one log record.
+//   PERSIST_MMAP:    nothing to do, the update already is in the file.
+//   PERSIST_THREAD:  take a ticket from the writer thread.
+// ----------------------------------------------------------------------------
+static void persist_before_update(void) {
+    if (persist_mode == PERSIST_REWRITE) {
+        load_atoms_from_file(save_file_path, 0, 0, 0);
+    }
+}
+
+static void persist_after_update(uint64_t version, const AtomStock *after) {
+    if (persist_mode == PERSIST_REWRITE) {
+        save_atoms_to_file(save_file_path);
+    } else if (persist_mode == PERSIST_WAL) {
+        wal_append(version, after);
+    } else if (persist_mode == PERSIST_THREAD) {
+        uint64_t ticket = saver_publish();
+        if (ack_fsync) unacked_ticket = ticket;
+    }
+}
+
+// --ack fsync: called before replies leave the worker
+static void persist_wait_durable(void) {
+    if (unacked_ticket == 0) return;
+    saver_wait(unacked_ticket);
+    unacked_ticket = 0;
+}
+
+// ----------------------------------------------------------------------------
+// apply_add() / apply_deliver(): the inventory update shared by the text and
+// the binary protocol, on `inv` (the default inventory or the warehouse
+// named by the wh_len bytes at `wh`). The caller runs persist_before_update()
+// first. On success the new stock is printed and persisted; `after`
+// receives it (or, on failure, the stock that was checked).
+// ----------------------------------------------------------------------------
+static void report_update(const char *wh, size_t wh_len, uint64_t version, const AtomStock *after) {
+    // Log the updated atom inventory (or just count it for the next summary)
+    if (log_summary_ms > 0) {
+        __atomic_fetch_add(&updates_since_summary, 1, __ATOMIC_RELAXED);
+    } else if (log_enabled(LOG_LEVEL_INFO)) {
+        char list[LOG_LINE_MAX];
+        atoms_format(list, sizeof(list), after, "  ");
+        log_msg(LOG_LEVEL_INFO, "SERVER INVENTORY%s%.*s (atoms): %s",
+                wh ? " @" : "", (int)wh_len, wh ? wh : "", list);
+    }
+
+    //if there is a save flag , we will save the atoms to the file.
+    persist_after_update(version, after);
+}
+
+static InvResult apply_add(Inventory *inv, const char *wh, size_t wh_len,
+                           const AtomStock *delta, AtomStock *after) {
+    uint64_t version = 0;
+    InvResult res = inventory_add(inv, delta, after, &version);
+    if (res == INV_OK) report_update(wh, wh_len, version, after);
+    return res;
+}
+
+static InvResult apply_deliver(Inventory *inv, const char *wh, size_t wh_len,
+                               int molecule, uint64_t count, AtomStock *after) {
+    AtomStock req;
+    recipe_scale(recipe_molecule(molecule), count, &req);
+    uint64_t version = 0;
+    InvResult res = inventory_take(inv, &req, after, &version);
+    if (res == INV_OK) report_update(wh, wh_len, version, after);
+    return res;
+}
+
+// ----------------------------------------------------------------------------
+// "<prefix>Carbon=.. Oxygen=.. Hydrogen=..[ <Extra>=..]\n", one entry per
+// configured atom type (see atoms.h)
+// ----------------------------------------------------------------------------
+static void format_stock_reply(char *response, size_t resp_size, const char *prefix,
+                               const AtomStock *stock) {
+    size_t used = strlen(prefix);
+    memcpy(response, prefix, used);
+    used += atoms_format(response + used, resp_size - used - 1, stock, " ");
+    response[used++] = '\n';
+    response[used]   = '\0';
+}
+
+// ----------------------------------------------------------------------------
+// The inventory a text command works on: the default one, or its @warehouse
+// (an ADD creates a missing one). NULL with the ERROR line in `response`.
+// ----------------------------------------------------------------------------
+static Inventory *command_inventory(const Command *cmd, char *response, size_t resp_size) {
+    if (!cmd->warehouse) return inventory;
+    if (warehouses_capacity() == 0) {
+        snprintf(response, resp_size, "ERROR: invalid warehouse\n");
+        return NULL;
+    }
+    Inventory *inv = warehouse_get(cmd->warehouse, cmd->warehouse_len, cmd->kind == CMD_ADD);
+    if (!inv) {
+        snprintf(response, resp_size, cmd->kind == CMD_ADD ? "ERROR: too many warehouses\n"
+                                                           : "ERROR: unknown warehouse\n");
+    }
+    return inv;
 }
 
 // ----------------------------------------------------------------------------
 // Parse and update a TCP “ADD <TYPE> <NUM>” command.
 // Fills `response` with either “OK: Carbon=.. Oxygen=.. Hydrogen=..\n”
-// or an ERROR line.
+// or an ERROR line; returns the command kind for the statistics.
 // ----------------------------------------------------------------------------
-void parse_and_update_tcp(const char *line, char *response, size_t resp_size) {
+static CmdKind parse_and_update_tcp_locked(const char *line, size_t len, char *response, size_t resp_size) {
+    Command cmd;
+    ParseStatus st = parse_command(line, len, &cmd);
+    if (cmd.kind != CMD_ADD) {
+        snprintf(response, resp_size, "ERROR: invalid command\n");
+        return cmd.kind;
+    }
+    if (st != PARSE_OK) {
+        snprintf(response, resp_size, "%s", parse_error_text(st));
+        return cmd.kind;
+    }
 
-    if (save_file_path) {
-        load_atoms_from_file(save_file_path, 0, 0, 0);
+    // Attempt to add to the correct stock, checking for overflow.
+    AtomStock delta;
+    memset(delta.count, 0, atoms_lanes() * sizeof(delta.count[0]));
+    delta.count[cmd.item] = cmd.count;
+    persist_before_update();
+    Inventory *inv = command_inventory(&cmd, response, resp_size);
+    if (!inv) return cmd.kind;
+    AtomStock after;
+    if (apply_add(inv, cmd.warehouse, cmd.warehouse_len, &delta, &after) != INV_OK) {
+        snprintf(response, resp_size, "ERROR: capacity exceeded\n");
+        return cmd.kind;
     }
-    
-    
-    char temp[MAXBUF];
-    strncpy(temp, line, sizeof(temp));
-    temp[sizeof(temp)-1] = '\0';
 
-    char *saveptr = NULL;
-    char *token_cmd  = strtok_r(temp, " \t\r\n", &saveptr);  // “ADD”
-    char *token_type = strtok_r(NULL,   " \t\r\n", &saveptr);  // “CARBON”|“OXYGEN”|“HYDROGEN”
-    char *token_num  = strtok_r(NULL,   " \t\r\n", &saveptr);  // e.g. “100”
+    // Build success response
+    format_stock_reply(response, resp_size, "OK: ", &after);
+    return cmd.kind;
+}
 
-    if (!token_cmd || !token_type || !token_num) {
+// ----------------------------------------------------------------------------
+// Parse and update a UDP “DELIVER <MOLECULE> <NUM>” command.
+// Molecule → needs certain numbers of atoms; subtract if enough atoms; else error.
+// Print the resulting inventory, then respond with a short “OK: Atoms left …\n”
+// ----------------------------------------------------------------------------
+static CmdKind parse_and_update_udp_locked(const char *line, size_t len, char *response, size_t resp_size) {
+    Command cmd;
+    ParseStatus st = parse_command(line, len, &cmd);
+    if (cmd.kind != CMD_DELIVER) {
         snprintf(response, resp_size, "ERROR: invalid command\n");
-        return;
+        return cmd.kind;
     }
-    if (strcmp(token_cmd, "ADD") != 0) {
-        snprintf(response, resp_size, "ERROR: invalid command\n");
-        return;
+    if (st != PARSE_OK) {
+        snprintf(response, resp_size, "%s", parse_error_text(st));
+        return cmd.kind;
     }
 
-    enum { CARBON, OXYGEN, HYDROGEN, TYPE_UNKNOWN } type = TYPE_UNKNOWN;
-    if (strcmp(token_type, "CARBON") == 0)      type = CARBON;
-    else if (strcmp(token_type, "OXYGEN") == 0) type = OXYGEN;
-    else if (strcmp(token_type, "HYDROGEN") == 0) type = HYDROGEN;
-    else {
-        snprintf(response, resp_size, "ERROR: invalid atom type\n");
-        return;
+    // Check if enough atoms exist and subtract them, all in one step
+    persist_before_update();
+    Inventory *inv = command_inventory(&cmd, response, resp_size);
+    if (!inv) return cmd.kind;
+    AtomStock after;
+    InvResult res = apply_deliver(inv, cmd.warehouse, cmd.warehouse_len, cmd.item, cmd.count, &after);
+    if (res >= INV_NOT_ENOUGH_CARBON) {
+        // "not enough carbon atoms", ... for the atom that ran short
+        const char *label = atom_label(res - INV_NOT_ENOUGH_CARBON);
+        snprintf(response, resp_size, "ERROR: not enough %c%s atoms\n",
+                 label[0] - 'A' + 'a', label + 1);
+        return cmd.kind;
+    }
+    if (res != INV_OK) {
+        snprintf(response, resp_size, "ERROR: unknown error\n");
+        return cmd.kind;
     }
 
-    char *endptr = NULL;
-    unsigned long long val = strtoull(token_num, &endptr, 10);
-    if (endptr == token_num || *endptr != '\0') {
-        snprintf(response, resp_size, "ERROR: invalid number\n");
-        return;
+    // Respond with a short “OK: Atoms left – Carbon=.. Oxygen=.. Hydrogen=..\n”
+    format_stock_reply(response, resp_size, "OK: Atoms left – ", &after);
+    return cmd.kind;
+}
+
+// ----------------------------------------------------------------------------
+// Thread-safe entry points. The inventory itself is lock-free; only the plain
+// -f load → check → update → save round trip runs under file_lock so
+// concurrent workers never overwrite each other's file contents.
+// ----------------------------------------------------------------------------
+CmdKind parse_and_update_tcp(const char *line, size_t len, char *response, size_t resp_size) {
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_lock(&file_lock);
+    CmdKind kind = parse_and_update_tcp_locked(line, len, response, resp_size);
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_unlock(&file_lock);
+    return kind;
+}
+
+CmdKind parse_and_update_udp(const char *line, size_t len, char *response, size_t resp_size) {
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_lock(&file_lock);
+    CmdKind kind = parse_and_update_udp_locked(line, len, response, resp_size);
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_unlock(&file_lock);
+    return kind;
+}
+
+// ----------------------------------------------------------------------------
+// handle_wire_request(): one binary ADD / DELIVER frame (see wire.h), any
+// transport. No text is parsed or formatted on this path.
+// ----------------------------------------------------------------------------
+_Static_assert((int)WIRE_ATOM_CARBON == ATOM_CARBON && (int)WIRE_ATOM_OXYGEN == ATOM_OXYGEN &&
+               (int)WIRE_ATOM_HYDROGEN == ATOM_HYDROGEN, "binary atom ids are atom ids");
+
+// Molecules only need carbon, oxygen and hydrogen
+static uint8_t wire_status(InvResult res) {
+    switch (res) {
+        case INV_OK:                  return WIRE_OK;
+        case INV_CAPACITY_EXCEEDED:   return WIRE_ERR_CAPACITY;
+        case INV_NOT_ENOUGH_CARBON:   return WIRE_ERR_NOT_ENOUGH_C;
+        case INV_NOT_ENOUGH_OXYGEN:   return WIRE_ERR_NOT_ENOUGH_O;
+        default:                      return WIRE_ERR_NOT_ENOUGH_H;
     }
-    if (val > MAX_ATOMS) {
-        snprintf(response, resp_size, "ERROR: number too large\n");
-        return;
+}
+
+static void handle_wire_request_locked(const WireRequest *req, WireReply *reply) {
+    uint64_t count = le64toh(req->count);
+    AtomStock after;
+    uint8_t status;
+    after.count[ATOM_CARBON] = after.count[ATOM_OXYGEN] = after.count[ATOM_HYDROGEN] = 0;
+
+    // Binary frames always address the default inventory
+    if (count > MAX_ATOMS) {
+        status = WIRE_ERR_NUMBER_TOO_LARGE;
+    } else if (req->opcode == WIRE_OP_ADD) {
+        if (req->item < atoms_count()) {
+            AtomStock delta;
+            memset(delta.count, 0, atoms_lanes() * sizeof(delta.count[0]));
+            delta.count[req->item] = count;
+            persist_before_update();
+            status = wire_status(apply_add(inventory, NULL, 0, &delta, &after));
+        } else {
+            status = WIRE_ERR_INVALID_ITEM;
+        }
+    } else if (req->opcode == WIRE_OP_DELIVER) {
+        if (req->item < NUM_MOLECULES) {
+            persist_before_update();
+            status = wire_status(apply_deliver(inventory, NULL, 0, req->item, count, &after));
+        } else {
+            status = WIRE_ERR_INVALID_ITEM;
+        }
+    } else {
+        status = WIRE_ERR_INVALID_OPCODE;
     }
 
-    // Attempt to add to the correct stock, checking for overflow.
-    switch (type) {
-        case CARBON:
-            if (atom_stock.carbon + val > MAX_ATOMS) {
-                snprintf(response, resp_size, "ERROR: capacity exceeded\n");
-                return;
-            }
-            atom_stock.carbon += val;
-            break;
-        case OXYGEN:
-            if (atom_stock.oxygen + val > MAX_ATOMS) {
-                snprintf(response, resp_size, "ERROR: capacity exceeded\n");
-                return;
-            }
-            atom_stock.oxygen += val;
-            break;
-        case HYDROGEN:
-            if (atom_stock.hydrogen + val > MAX_ATOMS) {
-                snprintf(response, resp_size, "ERROR: capacity exceeded\n");
-                return;
-            }
-            atom_stock.hydrogen += val;
-            break;
-        default:
-            snprintf(response, resp_size, "ERROR: unknown error\n");
-            return;
+    reply->magic      = WIRE_MAGIC;
+    reply->status     = status;
+    reply->reserved   = 0;
+    reply->request_id = req->request_id;   // already little-endian
+    reply->carbon     = htole64(after.count[ATOM_CARBON]);
+    reply->oxygen     = htole64(after.count[ATOM_OXYGEN]);
+    reply->hydrogen   = htole64(after.count[ATOM_HYDROGEN]);
+}
+
+void handle_wire_request(const WireRequest *req, WireReply *reply) {
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_lock(&file_lock);
+    handle_wire_request_locked(req, reply);
+    if (persist_mode == PERSIST_REWRITE) pthread_mutex_unlock(&file_lock);
+}
+
+// The statistics' view of a binary request and its reply
+static StatsOp wire_stats_op(const WireRequest *req) {
+    return req->opcode == WIRE_OP_ADD ? STATS_OP_ADD
+         : req->opcode == WIRE_OP_DELIVER ? STATS_OP_DELIVER : STATS_OP_OTHER;
+}
+
+static StatsError wire_stats_error(const WireRequest *req, const WireReply *reply) {
+    switch (reply->status) {
+        case WIRE_OK:                   return STATS_ERR_NONE;
+        case WIRE_ERR_INVALID_OPCODE:   return STATS_ERR_INVALID_COMMAND;
+        case WIRE_ERR_INVALID_ITEM:     return req->opcode == WIRE_OP_ADD ? STATS_ERR_INVALID_ATOM
+                                                                          : STATS_ERR_INVALID_MOLECULE;
+        case WIRE_ERR_NUMBER_TOO_LARGE: return STATS_ERR_NUMBER_TOO_LARGE;
+        case WIRE_ERR_CAPACITY:         return STATS_ERR_CAPACITY_EXCEEDED;
+        case WIRE_ERR_NOT_ENOUGH_C:     return STATS_ERR_NOT_ENOUGH_CARBON;
+        case WIRE_ERR_NOT_ENOUGH_O:     return STATS_ERR_NOT_ENOUGH_OXYGEN;
+        case WIRE_ERR_NOT_ENOUGH_H:     return STATS_ERR_NOT_ENOUGH_HYDROGEN;
+        default:                        return STATS_ERR_UNKNOWN;
     }
+}
 
-    // Print updated atom inventory to server console
-    printf("SERVER INVENTORY (atoms): Carbon=%llu  Oxygen=%llu  Hydrogen=%llu\n",
-           (unsigned long long)atom_stock.carbon,
-           (unsigned long long)atom_stock.oxygen,
-           (unsigned long long)atom_stock.hydrogen);
+// ----------------------------------------------------------------------------
+// Output queue of one stream connection. Sockets are non-blocking and the
+// server never waits for a client to read: bytes that send() does not take
+// are kept in c->pend and EPOLLOUT is registered until they are all sent.
+// ----------------------------------------------------------------------------
 
-    //if there is a save flag , we will save the atoms to the file.
-    if (save_file_path) {
-        save_atoms_to_file(save_file_path);
+// Register (or drop) interest in EPOLLOUT for `c`
+static bool conn_want_write(Conn *c, bool on) {
+    if (c->want_write == on) return true;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLET | (on ? EPOLLOUT : 0), .data.fd = c->fd };
+    if (epoll_ctl(c->owner->epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) {
+        log_msg(LOG_LEVEL_ERROR, "epoll_ctl (EPOLLOUT): %s", strerror(errno));
+        return false;
     }
+    c->want_write = on;
+    return true;
+}
 
-    // Build success response
-    snprintf(response, resp_size,
-             "OK: Carbon=%llu Oxygen=%llu Hydrogen=%llu\n",
-             (unsigned long long)atom_stock.carbon,
-             (unsigned long long)atom_stock.oxygen,
-             (unsigned long long)atom_stock.hydrogen);
+static bool pend_append(Conn *c, const char *data, size_t n) {
+    if (c->pend_head + c->pend_len + n > c->pend_cap) {
+        memmove(c->pend, c->pend + c->pend_head, c->pend_len);
+        c->pend_head = 0;
+    }
+    if (c->pend_len + n > c->pend_cap) {
+        size_t cap = c->pend_cap ? c->pend_cap : REPLY_BUF;
+        while (cap < c->pend_len + n) cap *= 2;
+        char *p = realloc(c->pend, cap);
+        if (!p) {
+            log_msg(LOG_LEVEL_ERROR, "realloc (output queue): out of memory");
+            return false;
+        }
+        c->pend     = p;
+        c->pend_cap = cap;
+    }
+    memcpy(c->pend + c->pend_head + c->pend_len, data, n);
+    c->pend_len += n;
+    return true;
+}
+
+// Send as much of `data` as the socket takes now; returns the bytes sent,
+// or -1 if the client is gone.
+static ssize_t send_some(Conn *c, const char *data, size_t n) {
+    size_t off = 0;
+    while (off < n) {
+        ssize_t w = send(c->fd, data + off, n - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w >= 0) {
+            off += (size_t)w;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        log_msg(LOG_LEVEL_DEBUG, "send (fd %d): %s", c->fd, strerror(errno));
+        return -1;
+    }
+    return (ssize_t)off;
+}
+
+// EPOLLOUT: send queued replies. Returns false if the client is gone.
+static bool conn_send_pending(Conn *c) {
+    ssize_t sent = send_some(c, c->pend + c->pend_head, c->pend_len);
+    if (sent < 0) return false;
+    c->pend_head += (size_t)sent;
+    c->pend_len  -= (size_t)sent;
+    if (c->pend_len > 0) return true;
+    // Drained: give the memory back, a fast reader never needs it
+    free(c->pend);
+    c->pend = NULL;
+    c->pend_head = c->pend_cap = 0;
+    return conn_want_write(c, false);
 }
 
 // ----------------------------------------------------------------------------
-// Parse and update a UDP “DELIVER <MOLECULE> <NUM>” command.
-// Molecule → needs certain numbers of atoms; subtract if enough atoms; else error.
-// Print the resulting inventory, then respond with a short “OK: Atoms left …\n”
+// The same queue with --io-uring: replies always collect in c->pend, and one
+// IORING_OP_SEND at a time carries them off. Swapping pend and sbuf before
+// each send means the bytes the kernel reads never move; the send itself goes
+// out with the loop's next io_uring_enter(), together with everything else.
 // ----------------------------------------------------------------------------
-void parse_and_update_udp(const char *line, char *response, size_t resp_size) {  
-    
-    if (save_file_path) {
-        load_atoms_from_file(save_file_path, 0, 0, 0);
+static struct io_uring_sqe *ur_sqe(Worker *w) {
+    // A full queue is submitted right away, replies included
+    if (uring_sq_full(&w->uring->ring)) persist_wait_durable();
+    struct io_uring_sqe *sqe = uring_sqe(&w->uring->ring);
+    if (!sqe) {
+        perror("io_uring_enter");
+        exit(EXIT_FAILURE);
     }
-    
-    char temp[MAXBUF];
-    strncpy(temp, line, sizeof(temp));
-    temp[sizeof(temp)-1] = '\0';
+    return sqe;
+}
 
-    char *saveptr = NULL;
-    char *token_cmd = strtok_r(temp, " \t\r\n", &saveptr);  // “DELIVER”
-    char *token_mol = strtok_r(NULL,   " \t\r\n", &saveptr);  // e.g. “WATER” or “CARBON”
+// Reply bytes queued or in flight
+static size_t conn_unsent(const Conn *c) {
+    return c->pend_len + (c->sbuf_len - c->sbuf_off);
+}
 
-    if (!token_cmd || !token_mol) {
-        snprintf(response, resp_size, "ERROR: invalid command\n");
-        return;
+static void uring_send(Conn *c) {
+    uring_prep_send(ur_sqe(c->owner), c->fd, c->sbuf + c->sbuf_off, c->sbuf_len - c->sbuf_off,
+                    MSG_NOSIGNAL, UR_DATA(UR_SEND, c->fd));
+    c->send_inflight = true;
+}
+
+static void uring_send_pending(Conn *c) {
+    char  *buf = c->sbuf;
+    size_t cap = c->sbuf_cap;
+    c->sbuf      = c->pend;
+    c->sbuf_cap  = c->pend_cap;
+    c->sbuf_off  = c->pend_head;
+    c->sbuf_len  = c->pend_head + c->pend_len;
+    c->pend      = buf;
+    c->pend_cap  = cap;
+    c->pend_head = c->pend_len = 0;
+    uring_send(c);
+}
+
+static bool uring_conn_flush(Conn *c, ReplyBuf *out) {
+    size_t n = out->len;
+    out->len = 0;
+    if (n > 0 && !pend_append(c, out->data, n)) return false;
+    if (!c->send_inflight && c->pend_len > 0) uring_send_pending(c);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// reply_flush() / reply_append(): batched replies for one connection. Replies
+// go behind anything still queued, so their order is kept.
+// ----------------------------------------------------------------------------
+bool reply_flush(Conn *c, ReplyBuf *out) {
+    if (c->owner->uring) return uring_conn_flush(c, out);
+    size_t n = out->len;
+    out->len = 0;
+    if (n == 0) return true;
+    persist_wait_durable();
+    if (c->pend_len > 0) {
+        // EPOLLOUT is registered and will pick these up
+        return pend_append(c, out->data, n);
     }
-    if (strcmp(token_cmd, "DELIVER") != 0) {
-        snprintf(response, resp_size, "ERROR: invalid command\n");
-        return;
+    ssize_t sent = send_some(c, out->data, n);
+    if (sent < 0) return false;
+    if ((size_t)sent == n) return true;
+    return pend_append(c, out->data + sent, n - (size_t)sent) && conn_want_write(c, true);
+}
+
+static bool reply_append_bytes(Conn *c, ReplyBuf *out, const void *reply, size_t n) {
+    if (out->len + n > sizeof(out->data) && !reply_flush(c, out)) {
+        return false;
+    }
+    memcpy(out->data + out->len, reply, n);
+    out->len += n;
+    stats_add(&c->owner->stats->t[c->transport].bytes_out, n);
+    return true;
+}
+
+static bool reply_append(Conn *c, ReplyBuf *out, const char *reply) {
+    return reply_append_bytes(c, out, reply, strlen(reply));
+}
+
+static StatsOp stats_op(CmdKind kind) {
+    return kind == CMD_ADD ? STATS_OP_ADD : kind == CMD_DELIVER ? STATS_OP_DELIVER : STATS_OP_OTHER;
+}
+
+// “STATS” (surrounding blanks allowed)
+static bool is_stats_command(const char *line, size_t len) {
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+    while (len > 0 && (*line == ' ' || *line == '\t')) {
+        line++;
+        len--;
     }
+    return len == 5 && memcmp(line, "STATS", 5) == 0;
+}
 
-    // Build full molecule name if needed (“CARBON DIOXIDE” → two tokens)
-    char full_mol[MAXBUF];
-    if (strcmp(token_mol, "CARBON") == 0) {
-        char *token_next = strtok_r(NULL, " \t\r\n", &saveptr);
-        if (!token_next || strcmp(token_next, "DIOXIDE") != 0) {
-            snprintf(response, resp_size, "ERROR: invalid molecule type\n");
-            return;
+// Run one command line taken out of the ring (without its '\n').
+// len == MAXBUF means it was cut short.
+static bool serve_line(Conn *c, ReplyBuf *out, const char *line, size_t len) {
+    char response[MAXBUF];
+    StatsShard *stats = c->owner->stats;
+    uint64_t t0 = stats_now_ns();
+    c->requests++;
+    if (len >= MAXBUF) {
+        snprintf(response, sizeof(response), "ERROR: line too long\n");
+        stats_request(stats, c->transport, STATS_OP_OTHER, stats_now_ns() - t0, STATS_ERR_LINE_TOO_LONG);
+    } else if (len == 0 || (len == 1 && line[0] == '\r')) {
+        return true;   // empty line: nothing to answer
+    } else if (is_stats_command(line, len)) {
+        char text[STATS_TEXT_MAX];
+        size_t n = stats_format_text(text, sizeof(text));
+        stats_request(stats, c->transport, STATS_OP_OTHER, stats_now_ns() - t0, STATS_ERR_NONE);
+        return reply_append_bytes(c, out, text, n);
+    } else {
+        CmdKind kind = parse_and_update_tcp(line, len, response, sizeof(response));
+        stats_request(stats, c->transport, stats_op(kind), stats_now_ns() - t0,
+                      stats_error_of(response));
+    }
+    return reply_append(c, out, response);
+}
+
+// Copy the first `n` buffered bytes (at most MAXBUF) into `line`, then drop
+// `consume` bytes from the ring. Returns the number of bytes copied.
+static size_t ring_take(Conn *c, char *line, size_t n, size_t consume) {
+    if (n > MAXBUF) n = MAXBUF;
+    for (size_t k = 0; k < n; k++) {
+        line[k] = c->in[(c->head + k) & (CONN_INBUF - 1)];
+    }
+    c->head = (c->head + consume) & (CONN_INBUF - 1);
+    c->len -= consume;
+    return n;
+}
+
+// Cut every complete line out of the ring. With `at_eof`, the rest is the
+// final command. A full ring without any '\n' can never become a valid
+// command: it is answered once and dropped up to the next '\n'.
+static bool serve_buffered_lines(Conn *c, ReplyBuf *out, bool at_eof) {
+    char line[MAXBUF];
+    size_t i = 0;
+    while (i < c->len) {
+        if (c->in[(c->head + i) & (CONN_INBUF - 1)] != '\n') {
+            i++;
+            continue;
+        }
+        size_t n = ring_take(c, line, i, i + 1);
+        if (c->discard) {
+            c->discard = false;
+        } else if (!serve_line(c, out, line, n)) {
+            return false;
         }
-        strcpy(full_mol, "CARBON DIOXIDE");
+        i = 0;
     }
-    else if (strcmp(token_mol, "WATER") == 0) {
-        strcpy(full_mol, "WATER");
+    if (c->len > 0 && (at_eof || c->len == CONN_INBUF)) {
+        size_t n = ring_take(c, line, c->len, c->len);
+        if (!c->discard && !serve_line(c, out, line, n)) return false;
+        c->discard = !at_eof;
     }
-    else if (strcmp(token_mol, "GLUCOSE") == 0) {
-        strcpy(full_mol, "GLUCOSE");
+    return true;
+}
+
+// Run every complete WireRequest in the ring; a partial frame waits for more
+// data (and is dropped at end of stream).
+static bool serve_buffered_frames(Conn *c, ReplyBuf *out) {
+    while (c->len >= sizeof(WireRequest)) {
+        WireRequest req;
+        WireReply   reply;
+        ring_take(c, (char *)&req, sizeof(req), sizeof(req));
+        uint64_t t0 = stats_now_ns();
+        handle_wire_request(&req, &reply);
+        stats_request(c->owner->stats, c->transport, wire_stats_op(&req),
+                      stats_now_ns() - t0, wire_stats_error(&req, &reply));
+        c->requests++;
+        if (!reply_append_bytes(c, out, &reply, sizeof(reply))) return false;
     }
-    else if (strcmp(token_mol, "ALCOHOL") == 0) {
-        strcpy(full_mol, "ALCOHOL");
+    return true;
+}
+
+// `n` bytes have just been stored behind the buffered ones: serve what is
+// complete. Returns false if the client is gone.
+static bool conn_received(Conn *c, ReplyBuf *out, size_t n) {
+    if (c->proto == PROTO_UNKNOWN) {
+        c->proto = ((unsigned char)c->in[c->head] == WIRE_MAGIC) ? PROTO_BINARY : PROTO_TEXT;
     }
-    else {
-        snprintf(response, resp_size, "ERROR: invalid molecule type\n");
-        return;
+    c->len += n;
+    stats_add(&c->owner->stats->t[c->transport].bytes_in, (uint64_t)n);
+    return (c->proto == PROTO_BINARY) ? serve_buffered_frames(c, out)
+                                      : serve_buffered_lines(c, out, false);
+}
+
+// ----------------------------------------------------------------------------
+// handle_tcp_client():
+//   - read whatever is available into the connection's ring (one readv),
+//   - run every complete “ADD …” line through parse_and_update_tcp(…), or
+//     every binary frame through handle_wire_request(…) if the connection
+//     started with WIRE_MAGIC,
+//   - queue the responses in `out` (the caller flushes them in one write).
+// Return CLIENT_CLOSED if client closed or a recv‐error occurred, and
+// CLIENT_WOULD_BLOCK if a non-blocking socket has been drained.
+// ----------------------------------------------------------------------------
+ClientStatus handle_tcp_client(Conn *c, ReplyBuf *out) {
+    size_t tail = (c->head + c->len) & (CONN_INBUF - 1);
+    size_t room = CONN_INBUF - c->len;
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = c->in + tail;
+    iov[0].iov_len  = (tail + room <= CONN_INBUF) ? room : CONN_INBUF - tail;
+    if (iov[0].iov_len < room) {
+        iov[1].iov_base = c->in;
+        iov[1].iov_len  = room - iov[0].iov_len;
+        iovcnt = 2;
     }
 
-    // Next token must be a number
-    char *token_num = strtok_r(NULL, " \t\r\n", &saveptr);
-    if (!token_num) {
-        snprintf(response, resp_size, "ERROR: missing number\n");
-        return;
+    ssize_t numbytes = readv(c->fd, iov, iovcnt);
+    if (numbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return CLIENT_WOULD_BLOCK;
+    }
+    if (numbytes < 0 && errno == EINTR) {
+        return CLIENT_ACTIVE;
+    }
+    if (numbytes <= 0) {
+        // 0 => client closed; <0 => recv error. Answer a last unterminated line.
+        if (numbytes == 0 && c->proto == PROTO_TEXT) serve_buffered_lines(c, out, true);
+        return CLIENT_CLOSED;
+    }
+    return conn_received(c, out, (size_t)numbytes) ? CLIENT_ACTIVE : CLIENT_CLOSED;
+}
+
+// ----------------------------------------------------------------------------
+// Connection table. Each worker hands out Conn slots from its free list
+// (refilled one ConnChunk at a time) and keeps the open ones in a dense array:
+// allocating, releasing (swap with the last entry) and walking only the live
+// connections are all O(1) per connection, however many fds the process may
+// open. Returns NULL if memory is exhausted.
+// ----------------------------------------------------------------------------
+static Conn *conn_alloc(Worker *w) {
+    if (!w->free_conns) {
+        ConnChunk *chunk = malloc(sizeof(ConnChunk));
+        if (!chunk) return NULL;
+        chunk->next = w->chunks;
+        w->chunks   = chunk;
+        for (size_t i = CONN_CHUNK; i-- > 0; ) {
+            chunk->slots[i].lru_next = w->free_conns;
+            w->free_conns = &chunk->slots[i];
+        }
+    }
+    if (w->live_count == w->live_cap) {
+        size_t cap = w->live_cap ? w->live_cap * 2 : CONN_CHUNK;
+        Conn **live = realloc(w->live, cap * sizeof(*live));
+        if (!live) return NULL;
+        w->live     = live;
+        w->live_cap = cap;
     }
-    // Ensure no extra tokens
-    char *token_extra = strtok_r(NULL, " \t\r\n", &saveptr);
-    if (token_extra) {
-        snprintf(response, resp_size, "ERROR: too many arguments\n");
+    Conn *c = w->free_conns;
+    w->free_conns = c->lru_next;
+    // Everything but the input ring, which is only read up to `len`
+    memset(c, 0, offsetof(Conn, in));
+    c->owner      = w;
+    c->live_index = w->live_count;
+    w->live[w->live_count++] = c;
+    return c;
+}
+
+static void conn_release(Conn *c) {
+    Worker *w = c->owner;
+    Conn *last = w->live[--w->live_count];
+    w->live[c->live_index] = last;
+    last->live_index = c->live_index;
+    c->lru_next   = w->free_conns;
+    w->free_conns = c;
+}
+
+// ----------------------------------------------------------------------------
+// Connection LRU. Every read moves the connection to the tail of its worker's
+// list, so the list stays sorted by last_active and the eviction candidate is
+// always the head.
+// ----------------------------------------------------------------------------
+static void lru_unlink(Conn *c) {
+    Worker *w = c->owner;
+    if (c->lru_prev) c->lru_prev->lru_next = c->lru_next;
+    else             w->lru_head = c->lru_next;
+    if (c->lru_next) c->lru_next->lru_prev = c->lru_prev;
+    else             w->lru_tail = c->lru_prev;
+    c->lru_prev = c->lru_next = NULL;
+}
+
+static void lru_append(Conn *c) {
+    Worker *w = c->owner;
+    c->lru_prev = w->lru_tail;
+    c->lru_next = NULL;
+    if (w->lru_tail) w->lru_tail->lru_next = c;
+    else             w->lru_head = c;
+    w->lru_tail = c;
+}
+
+static void lru_touch(Conn *c) {
+    if (c->owner->lru_tail != c) {
+        lru_unlink(c);
+        lru_append(c);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// --accept-backpressure: a saturated worker stops polling its listeners, so
+// the kernel keeps new clients in the backlog (and drops SYNs once that is
+// full) instead of the server accepting and closing them. The listeners are
+// re-armed when one of the worker's connections closes or, for slots freed
+// by other workers, by accept_timer. With --io-uring, pausing cancels the
+// accept request instead.
+// ----------------------------------------------------------------------------
+
+// Stream listener i (0 = TCP, 1 = UDS_STREAM) of `w`, -1 if it has none
+static int stream_listener(const Worker *w, int i) {
+    return i == 0 ? w->tcp_listen_fd : w->uds_stream_fd;
+}
+
+// --io-uring: one multishot accept per listener. With --accept-backpressure
+// every accept is a single one, re-armed only while there is room, so that
+// waiting clients stay in the backlog as they do with epoll.
+static void uring_arm_accept(Worker *w, int i) {
+    int fd = stream_listener(w, i);
+    if (fd < 0 || w->uring->accept_armed[i] || w->uring->stopping) return;
+    uring_prep_accept(ur_sqe(w), fd, !accept_backpressure, SOCK_NONBLOCK, UR_DATA(UR_ACCEPT, fd));
+    w->uring->accept_armed[i] = true;
+}
+
+static void accept_set_polled(Worker *w, bool polled) {
+    if (w->uring) {
+        for (int i = 0; i < 2; i++) {
+            int fd = stream_listener(w, i);
+            if (polled) {
+                uring_arm_accept(w, i);
+            } else if (w->uring->accept_armed[i]) {
+                uring_prep_cancel(ur_sqe(w), UR_DATA(UR_ACCEPT, fd), UR_DATA(UR_CANCEL, fd));
+            }
+        }
         return;
     }
+    int listen_fds[] = { w->tcp_listen_fd, w->uds_stream_fd };
+    for (size_t i = 0; i < sizeof(listen_fds) / sizeof(listen_fds[0]); i++) {
+        if (listen_fds[i] < 0) continue;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        // Re-enabling an edge-triggered fd reports a backlog that is already waiting
+        ev.events  = polled ? (EPOLLIN | EPOLLET) : EPOLLET;
+        ev.data.fd = listen_fds[i];
+        if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, listen_fds[i], &ev) < 0) {
+            perror("epoll_ctl (stream listener)");
+        }
+    }
+}
+
+static void accept_pause(Worker *w) {
+    if (w->accept_paused) return;
+    accept_set_polled(w, false);
+    w->accept_paused = true;
+    timer_arm(w->wheel, &w->accept_timer, w->now + ACCEPT_RETRY_MS);
+}
+
+static void accept_resume(Worker *w) {
+    if (!w->accept_paused) return;
+    timer_cancel(&w->accept_timer);
+    w->accept_paused = false;
+    accept_set_polled(w, true);
+}
+
+static void accept_retry_fired(Timer *t, uint64_t now) {
+    (void)now;
+    accept_resume((Worker *)((char *)t - offsetof(Worker, accept_timer)));
+}
+
+// ----------------------------------------------------------------------------
+// Timers. They run inside timer_wheel_advance() on the worker that owns the
+// connection, so they may close it directly. Reads only stamp last_active;
+// the idle timers compare against it when they fire and re-arm if needed.
+// ----------------------------------------------------------------------------
+static void conn_close(Conn *c) {
+    Worker *w = c->owner;
+    bool busy = c->recv_armed || c->send_inflight;
+    if (!c->dead) {
+        c->dead = true;
+        timer_cancel(&c->idle_timer);
+        timer_cancel(&c->deadline_timer);
+        lru_unlink(c);
+        stats_add(&w->stats->t[c->transport].conns_closed, 1);
+        __atomic_fetch_sub(&open_connections, 1, __ATOMIC_RELAXED);
+        accept_resume(w);
+        // --io-uring: the kernel still holds the fd (and sbuf). shutdown()
+        // ends its requests; their completions call conn_close() again.
+        if (busy) shutdown(c->fd, SHUT_RDWR);
+    }
+    if (busy) return;
+    conn_table[c->fd] = NULL;
+    close(c->fd);
+    free(c->pend);
+    free(c->sbuf);
+    conn_release(c);
+}
+
+// ----------------------------------------------------------------------------
+// conn_reserve(): take one of the --max-connections slots for a new client.
+// With `evict`, make room by closing this worker's least recently active
+// connections that have been idle for evict_idle_ms (only once a client is
+// really waiting). Returns false if the server is full.
+// ----------------------------------------------------------------------------
+static bool conn_evictable(const Worker *w) {
+    const Conn *lru = w->lru_head;
+    return evict_idle_ms > 0 && lru && w->now - lru->last_active >= evict_idle_ms;
+}
+
+static bool conn_reserve(Worker *w, bool evict) {
+    if (max_connections == 0) {
+        __atomic_fetch_add(&open_connections, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    for (;;) {
+        size_t n = __atomic_load_n(&open_connections, __ATOMIC_RELAXED);
+        while (n < max_connections) {
+            if (__atomic_compare_exchange_n(&open_connections, &n, n + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+        if (!evict || !conn_evictable(w)) {
+            return false;
+        }
+        log_msg(LOG_LEVEL_DEBUG, "Evicting idle connection (fd %d) for a new client",
+                w->lru_head->fd);
+        conn_close(w->lru_head);
+    }
+}
+
+// The connection limit is reached and no connection can be evicted
+static bool conn_limit_reached(const Worker *w) {
+    return max_connections > 0 &&
+           __atomic_load_n(&open_connections, __ATOMIC_RELAXED) >= max_connections &&
+           !conn_evictable(w);
+}
 
-    char *endptr = NULL;
-    unsigned long long count = strtoull(token_num, &endptr, 10);
-    if (endptr == token_num || *endptr != '\0') {
-        snprintf(response, resp_size, "ERROR: invalid number\n");
+static void conn_idle_fired(Timer *t, uint64_t now) {
+    Conn *c = (Conn *)((char *)t - offsetof(Conn, idle_timer));
+    uint64_t due = c->last_active + conn_idle_ms;
+    if (now < due) {
+        timer_arm(t->wheel, t, due);
         return;
     }
-    if (count > MAX_ATOMS) {
-        snprintf(response, resp_size, "ERROR: number too large\n");
+    log_msg(LOG_LEVEL_DEBUG, "Closing idle connection (fd %d)", c->fd);
+    conn_close(c);
+}
+
+static void conn_deadline_fired(Timer *t, uint64_t now) {
+    (void)now;
+    Conn *c = (Conn *)((char *)t - offsetof(Conn, deadline_timer));
+    // Only on an empty output queue: behind queued replies it could land mid-reply
+    if (c->proto == PROTO_TEXT && conn_unsent(c) == 0) {
+        static const char msg[] = "ERROR: request timeout\n";
+        send(c->fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    stats_error(c->owner->stats, c->transport, STATS_ERR_REQUEST_TIMEOUT);
+    log_msg(LOG_LEVEL_INFO, "Request timeout, closing connection (fd %d)", c->fd);
+    conn_close(c);
+}
+
+// After a read: bytes of an unfinished request must be completed within
+// request_timeout_ms of the previous completed request (or of their arrival).
+static void conn_update_deadline(Worker *w, Conn *c, uint64_t served_before) {
+    if (request_timeout_ms == 0) return;
+    if (c->len == 0 && !c->discard) {
+        timer_cancel(&c->deadline_timer);
+    } else if (!timer_armed(&c->deadline_timer) || c->requests != served_before) {
+        timer_arm(w->wheel, &c->deadline_timer, w->now + request_timeout_ms);
+    }
+}
+
+// -t: no worker saw any activity for timeout_secs
+static void global_idle_fired(Timer *t, uint64_t now) {
+    Worker *w = (Worker *)((char *)t - offsetof(Worker, idle_timer));
+    uint64_t due = __atomic_load_n(&last_activity_ms, __ATOMIC_RELAXED) +
+                   (uint64_t)timeout_secs * 1000u;
+    if (now < due) {
+        timer_arm(w->wheel, t, due);
+    } else {
+        w->timed_out = true;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// set_nonblocking(): add O_NONBLOCK to the descriptor's file status flags.
+// ----------------------------------------------------------------------------
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// ----------------------------------------------------------------------------
+// epoll_add(): watch `fd` for input. The fd itself is stored in the event data
+// so the main loop can tell listeners and clients apart.
+// ----------------------------------------------------------------------------
+int epoll_add(int epfd, int fd, uint32_t extra_flags) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN | extra_flags;
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// ----------------------------------------------------------------------------
+// raise_fd_limit(): lift the soft RLIMIT_NOFILE up to the hard limit, so the
+// number of simultaneous clients is bounded by the system and not by 1024.
+// Returns the resulting limit (the size of conn_table).
+// ----------------------------------------------------------------------------
+static size_t raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        return 1024;
+    }
+    if (rl.rlim_cur < rl.rlim_max) {
+        rlim_t old = rl.rlim_cur;
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+            perror("setrlimit (RLIMIT_NOFILE)");
+            rl.rlim_cur = old;
+        }
+    }
+    return rl.rlim_cur == RLIM_INFINITY ? (size_t)1 << 20 : (size_t)rl.rlim_cur;
+}
+
+// ----------------------------------------------------------------------------
+// load_atoms_from_file():
+//      if the file holds a valid snapshot (or a legacy raw stock), loads its stocks into the
+//      default inventory and the named warehouses.
+//      if it is missing or too small, creates it from the initial values.
+//      a damaged snapshot is never overwritten: the server exits instead.
+// ----------------------------------------------------------------------------
+static void load_atoms_from_file(const char *path, uint64_t init_c, uint64_t init_o,uint64_t init_h)
+{
+    SnapshotEntry *loaded;
+    size_t count;
+    switch (snapshot_load(path, &loaded, &count)) {
+    case SNAPSHOT_OK:
+    case SNAPSHOT_RAW:
+        for (size_t i = 0; i < count; i++) {
+            Inventory *inv = loaded[i].name[0] == '\0'
+                           ? inventory
+                           : warehouse_get(loaded[i].name, strlen(loaded[i].name), true);
+            if (!inv) {
+                fprintf(stderr,"Error: %s holds more warehouses than --warehouses allows\n", path);
+                exit(EXIT_FAILURE);
+            }
+            inventory_store(inv, &loaded[i].stock);
+        }
+        free(loaded);
+        return;
+    case SNAPSHOT_INVALID:
+        fprintf(stderr,"Error: could not load Atoms from %s\n", path);
+        exit(EXIT_FAILURE);
+    case SNAPSHOT_MISSING:
+        break;
+    }
+
+    //if we reach here , file not exists or too small -> creating a new file :
+    SnapshotEntry initial = { .name = "", .stock = {{ init_c, init_o, init_h }} };
+    inventory_store(inventory, &initial.stock);
+    if (!snapshot_write(path, &initial, 1, false)) {
+        fprintf(stderr,"Error: could not write Atoms to %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// collect_inventories():
+//      every inventory as snapshot entries: the default one first, then the
+//      warehouses in creation order. Returns a malloc()ed array of *count entries.
+// ----------------------------------------------------------------------------
+_Static_assert(WAREHOUSE_NAME_MAX <= SNAPSHOT_NAME_MAX, "warehouse names must fit the snapshot");
+
+static SnapshotEntry *collect_inventories(size_t *count) {
+    size_t n = warehouse_count();
+    SnapshotEntry *entries = calloc(n + 1, sizeof(*entries));
+    if (!entries) {
+        perror("calloc (snapshot)");
+        return NULL;
+    }
+    inventory_read(inventory, &entries[0].stock);
+    for (size_t i = 0; i < n; i++) {
+        strcpy(entries[i + 1].name, warehouse_name(i));
+        inventory_read(warehouse_at(i), &entries[i + 1].stock);
+    }
+    *count = n + 1;
+    return entries;
+}
+
+static bool save_inventories(const char *path, bool durable) {
+    size_t count;
+    SnapshotEntry *entries = collect_inventories(&count);
+    if (!entries) return false;
+    bool ok = snapshot_write(path, entries, count, durable);
+    free(entries);
+    return ok;
+}
+
+// The --save-thread writer (saver.h)
+static bool save_inventories_durably(const char *path) {
+    return save_inventories(path, true);
+}
+
+// ----------------------------------------------------------------------------
+// save_atoms_to_file():
+//writes every inventory as a new snapshot and renames it over the file,
+//so a process loading the file concurrently sees the old or the new stocks, never half of them.
+// ----------------------------------------------------------------------------
+static void save_atoms_to_file(const char *path){
+    if (!save_inventories(path, false))
+        fprintf(stderr, "Error: could not write Atoms to %s\n", path);
+}
+
+// ----------------------------------------------------------------------------
+// handle_console_input():
+//   read one line from stdin and interpret “GEN …” and “STATS” console commands.
+//   Returns false on EOF (Ctrl+D) or a read error.
+// ----------------------------------------------------------------------------
+bool handle_console_input(void) {
+    char linebuf[MAXBUF];
+    if (fgets(linebuf, sizeof(linebuf), stdin) == NULL) {
+        return false;
+    }
+    if (persist_mode == PERSIST_REWRITE) {
+        pthread_mutex_lock(&file_lock);
+        load_atoms_from_file(save_file_path, 0, 0, 0);
+        pthread_mutex_unlock(&file_lock);
+    }
+    // strip trailing newline
+    size_t L = strlen(linebuf);
+    if (L > 0 && linebuf[L-1] == '\n') {
+        linebuf[L-1] = '\0';
+    }
+    // Expect “GEN [@warehouse] <BEVERAGE>”, “GEN [@warehouse] ALL” or “STATS”
+    char *cmd = strtok(linebuf, " \t");
+    if (cmd && strcmp(cmd, "STATS") == 0) {
+        char text[STATS_TEXT_MAX];
+        stats_format_text(text, sizeof(text));
+        fputs(text, stdout);
+        return true;
+    }
+    if (!cmd || strcmp(cmd, "GEN") != 0) {
+        printf("ERROR: invalid console command\n");
+        return true;
+    }
+    char *words[8];
+    int nwords = 0;
+    for (char *w = strtok(NULL, " \t"); w && nwords < 8; w = strtok(NULL, " \t")) {
+        words[nwords++] = w;
+    }
+    Inventory *inv = inventory;
+    if (nwords > 0 && words[0][0] == '@') {
+        inv = warehouse_get(words[0] + 1, strlen(words[0] + 1), false);
+        if (!inv) {
+            printf("ERROR: unknown warehouse '%s'\n", words[0] + 1);
+            return true;
+        }
+        for (int k = 1; k < nwords; k++) words[k - 1] = words[k];
+        nwords--;
+    }
+    if (nwords == 0) {
+        printf("ERROR: missing drink type after GEN\n");
+        return true;
+    }
+    AtomStock atom_stock;
+    inventory_read(inv, &atom_stock);
+    if (strcmp(words[0], "ALL") == 0) {
+        // Every product in one pass over the recipe table
+        uint64_t units[MAX_RECIPES];
+        recipes_max_makeable(&atom_stock, units);
+        for (size_t i = 0; i < recipes_count(); i++) {
+            printf("You can make up to %llu %s(s)\n",
+                   (unsigned long long)units[i], recipe_at(i)->name);
+        }
+        return true;
+    }
+
+    // The longest beverage name made of the leading words wins; words after
+    // it are ignored. A name cut short gets a hint.
+    char name[RECIPE_NAME_MAX] = "";
+    const Recipe *drink = NULL;
+    const char *hint = NULL;
+    size_t used = 0;
+    for (int k = 0; k < nwords; k++) {
+        size_t n = strlen(words[k]);
+        if (used + (k ? 1 : 0) + n >= sizeof(name)) break;
+        if (k) name[used++] = ' ';
+        memcpy(name + used, words[k], n + 1);
+        used += n;
+        const Recipe *r = recipe_find(RECIPE_BEVERAGE, name);
+        if (r) drink = r;
+    }
+    if (!drink) {
+        size_t first = strlen(words[0]);
+        for (size_t i = 0; i < recipes_count() && !hint; i++) {
+            const Recipe *r = recipe_at(i);
+            if (r->kind == RECIPE_BEVERAGE && strncmp(r->name, words[0], first) == 0 &&
+                r->name[first] == ' ') {
+                hint = r->name;
+            }
+        }
+    }
+    if (drink) {
+        printf("You can make up to %llu %s(s)\n",
+               (unsigned long long)recipe_max_makeable(drink, &atom_stock), drink->name);
+    } else if (hint) {
+        printf("ERROR: did you mean 'GEN %s'?\n", hint);
+    } else {
+        printf("ERROR: unknown drink type '%s'\n", words[0]);
+    }
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// create_tcp_listener():
+//   getaddrinfo + socket + bind + listen on `port_str` (IPv4).
+//   With `reuseport`, SO_REUSEPORT is set so several workers can bind the same
+//   port and the kernel spreads incoming connections across them.
+// ----------------------------------------------------------------------------
+static int create_tcp_listener(const char *port_str, bool reuseport) {
+    int tcp_listen_fd = -1;
+    struct addrinfo hints_tcp;
+    struct addrinfo *servinfo_tcp, *p_tcp;
+    memset(&hints_tcp, 0, sizeof(hints_tcp));
+    hints_tcp.ai_family   = AF_INET;      // IPv4 only (for simplicity)
+    hints_tcp.ai_socktype = SOCK_STREAM;  // TCP
+    hints_tcp.ai_flags    = AI_PASSIVE;   // use local IP
+
+    int rv;
+    if ((rv = getaddrinfo(NULL, port_str, &hints_tcp, &servinfo_tcp)) != 0) {
+        fprintf(stderr, "getaddrinfo (TCP): %s\n", gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+
+    int yes = 1;
+    for (p_tcp = servinfo_tcp; p_tcp != NULL; p_tcp = p_tcp->ai_next) {
+        tcp_listen_fd = socket(p_tcp->ai_family, p_tcp->ai_socktype, p_tcp->ai_protocol);
+        if (tcp_listen_fd < 0) {
+            perror("socket (TCP)");
+            continue;
+        }
+        if (setsockopt(tcp_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+            perror("setsockopt (TCP)");
+            close(tcp_listen_fd);
+            exit(EXIT_FAILURE);
+        }
+        if (reuseport &&
+            setsockopt(tcp_listen_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+            perror("setsockopt SO_REUSEPORT (TCP)");
+            close(tcp_listen_fd);
+            exit(EXIT_FAILURE);
+        }
+        if (bind(tcp_listen_fd, p_tcp->ai_addr, p_tcp->ai_addrlen) < 0) {
+            perror("bind (TCP)");
+            close(tcp_listen_fd);
+            continue;
+        }
+        // Bound successfully
+        break;
+    }
+    if (p_tcp == NULL) {
+        fprintf(stderr, "Error: failed to bind TCP on port %s\n", port_str);
+        exit(EXIT_FAILURE);
+    }
+    freeaddrinfo(servinfo_tcp);
+
+    if (listen(tcp_listen_fd, BACKLOG) < 0) {
+        perror("listen (TCP)");
+        exit(EXIT_FAILURE);
+    }
+    return tcp_listen_fd;
+}
+
+// ----------------------------------------------------------------------------
+// create_udp_socket():
+//   getaddrinfo + socket + bind on `port_str` (IPv4), optionally SO_REUSEPORT
+//   so that datagrams are hashed across the workers' sockets.
+// ----------------------------------------------------------------------------
+static int create_udp_socket(const char *port_str, bool reuseport) {
+    int udp_fd = -1;
+    struct addrinfo hints_udp;
+    struct addrinfo *servinfo_udp, *p_udp;
+    memset(&hints_udp, 0, sizeof(hints_udp));
+    hints_udp.ai_family   = AF_INET;      // IPv4 only
+    hints_udp.ai_socktype = SOCK_DGRAM;   // UDP
+    hints_udp.ai_flags    = AI_PASSIVE;   // use local IP
+
+    int rv2;
+    if ((rv2 = getaddrinfo(NULL, port_str, &hints_udp, &servinfo_udp)) != 0) {
+        fprintf(stderr, "getaddrinfo (UDP): %s\n", gai_strerror(rv2));
+        exit(EXIT_FAILURE);
+    }
+    int yes = 1;
+    for (p_udp = servinfo_udp; p_udp != NULL; p_udp = p_udp->ai_next) {
+        udp_fd = socket(p_udp->ai_family, p_udp->ai_socktype, p_udp->ai_protocol);
+        if (udp_fd < 0) {
+            perror("socket (UDP)");
+            continue;
+        }
+        if (reuseport &&
+            setsockopt(udp_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+            perror("setsockopt SO_REUSEPORT (UDP)");
+            close(udp_fd);
+            exit(EXIT_FAILURE);
+        }
+        if (bind(udp_fd, p_udp->ai_addr, p_udp->ai_addrlen) < 0) {
+            perror("bind (UDP)");
+            close(udp_fd);
+            continue;
+        }
+        // Bound successfully
+        break;
+    }
+    if (p_udp == NULL) {
+        fprintf(stderr, "Error: failed to bind UDP on port %s\n", port_str);
+        exit(EXIT_FAILURE);
+    }
+    freeaddrinfo(servinfo_udp);
+    return udp_fd;
+}
+
+// ----------------------------------------------------------------------------
+// worker_init_epoll():
+//   create the worker's epoll instance and register every socket it owns once.
+//   Sockets are edge-triggered, so they must be non-blocking and every
+//   handler in run_event_loop() drains its descriptor until EAGAIN.
+//   Returns false if the console could not be polled (see below).
+// ----------------------------------------------------------------------------
+// dgram_batch_alloc(): buffers for `depth` datagrams in each direction.
+// ----------------------------------------------------------------------------
+static DgramBatch *dgram_batch_alloc(unsigned depth) {
+    DgramBatch *b = calloc(1, sizeof(*b));
+    if (b) {
+        b->depth     = depth;
+        b->in        = calloc(depth, sizeof(*b->in));
+        b->reply     = calloc(depth, sizeof(*b->reply));
+        b->in_iov    = calloc(depth, sizeof(*b->in_iov));
+        b->reply_iov = calloc(depth, sizeof(*b->reply_iov));
+        b->addr      = calloc(depth, sizeof(*b->addr));
+        b->buf       = calloc(depth, sizeof(*b->buf));
+        b->resp      = calloc(depth, sizeof(*b->resp));
+    }
+    if (!b || !b->in || !b->reply || !b->in_iov || !b->reply_iov ||
+        !b->addr || !b->buf || !b->resp) {
+        perror("calloc (DgramBatch)");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned i = 0; i < depth; i++) {
+        b->in_iov[i].iov_base          = b->buf[i];
+        b->in[i].msg_hdr.msg_iov       = &b->in_iov[i];
+        b->in[i].msg_hdr.msg_iovlen    = 1;
+        b->in[i].msg_hdr.msg_name      = &b->addr[i];
+        b->reply_iov[i].iov_base       = b->resp[i];
+        b->reply[i].msg_hdr.msg_iov    = &b->reply_iov[i];
+        b->reply[i].msg_hdr.msg_iovlen = 1;
+        b->reply[i].msg_hdr.msg_name   = &b->addr[i];
+    }
+    return b;
+}
+
+static void dgram_batch_free(DgramBatch *b) {
+    free(b->in);
+    free(b->reply);
+    free(b->in_iov);
+    free(b->reply_iov);
+    free(b->addr);
+    free(b->buf);
+    free(b->resp);
+    free(b);
+}
+
+// ----------------------------------------------------------------------------
+// serve_datagram(): run the request in one datagram of `len` bytes and put
+// the reply (at most MAXBUF bytes) into `resp`. Returns the reply length.
+// ----------------------------------------------------------------------------
+static size_t serve_datagram(Worker *w, StatsTransport transport, const char *req, size_t len, char *resp) {
+    uint64_t t0 = stats_now_ns();
+    if (len == sizeof(WireRequest) && (unsigned char)req[0] == WIRE_MAGIC) {
+        // Binary frame: reply with a WireReply, no text involved
+        WireRequest wreq;
+        WireReply   reply;
+        memcpy(&wreq, req, sizeof(wreq));
+        handle_wire_request(&wreq, &reply);
+        memcpy(resp, &reply, sizeof(reply));
+        stats_request(w->stats, transport, wire_stats_op(&wreq), stats_now_ns() - t0,
+                      wire_stats_error(&wreq, &reply));
+        return sizeof(reply);
+    }
+    CmdKind kind = parse_and_update_udp(req, len, resp, MAXBUF);
+    stats_request(w->stats, transport, stats_op(kind), stats_now_ns() - t0, stats_error_of(resp));
+    return strlen(resp);
+}
+
+// ----------------------------------------------------------------------------
+// serve_datagrams(): drain a UDP or UDS_DGRAM socket `depth` datagrams at a
+// time. Every datagram goes through serve_datagram() and the replies of one
+// batch go back to their senders with one sendmmsg().
+// ----------------------------------------------------------------------------
+static void serve_datagrams(Worker *w, int fd, DgramBatch *b, StatsTransport transport, const char *what) {
+    StatsCounters *counters = &w->stats->t[transport];
+    for (;;) {
+        for (unsigned i = 0; i < b->depth; i++) {
+            b->in_iov[i].iov_len         = MAXBUF - 1;
+            b->in[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        int n = recvmmsg(fd, b->in, b->depth, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_msg(LOG_LEVEL_ERROR, "recvmmsg (%s): %s", what, strerror(errno));
+            }
+            return;
+        }
+
+        uint64_t bytes_in = 0, bytes_out = 0;
+        for (int i = 0; i < n; i++) {
+            b->reply_iov[i].iov_len = serve_datagram(w, transport, b->buf[i], b->in[i].msg_len, b->resp[i]);
+            b->reply[i].msg_hdr.msg_namelen = b->in[i].msg_hdr.msg_namelen;
+            bytes_in  += b->in[i].msg_len;
+            bytes_out += b->reply_iov[i].iov_len;
+        }
+        stats_add(&counters->bytes_in, bytes_in);
+
+        persist_wait_durable();
+
+        // reply to exactly those client addresses; a sender that cannot be
+        // reached is skipped instead of dropping the rest of the batch. A
+        // full receive queue (a UDS_DGRAM client that stopped reading) drops
+        // that one reply rather than stalling the worker: datagram replies
+        // may always be lost.
+        int sent = 0;
+        while (sent < n) {
+            int r = sendmmsg(fd, b->reply + sent, (unsigned)(n - sent), MSG_DONTWAIT);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    log_msg(LOG_LEVEL_DEBUG, "sendmmsg (%s): client queue full, reply dropped", what);
+                } else {
+                    log_msg(LOG_LEVEL_ERROR, "sendmmsg (%s): %s", what, strerror(errno));
+                }
+                stats_add(&counters->replies_dropped, 1);
+                bytes_out -= b->reply_iov[sent].iov_len;
+                sent++;
+            } else {
+                sent += r;
+            }
+        }
+        stats_add(&counters->bytes_out, bytes_out);
+
+        // A short batch means the queue is empty (edge-triggered: the next
+        // datagram raises a new event)
+        if ((unsigned)n < b->depth) return;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static bool worker_init_epoll(Worker *w) {
+    w->epfd = epoll_create1(0);
+    if (w->epfd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    int listen_fds[] = { w->tcp_listen_fd, w->udp_fd, w->uds_stream_fd, w->uds_dgram_fd };
+    for (size_t i = 0; i < sizeof(listen_fds) / sizeof(listen_fds[0]); i++) {
+        if (listen_fds[i] < 0) continue;   // optional UDS socket not requested
+        if (set_nonblocking(listen_fds[i]) < 0) {
+            perror("fcntl (O_NONBLOCK)");
+            exit(EXIT_FAILURE);
+        }
+        if (epoll_add(w->epfd, listen_fds[i], EPOLLET) < 0) {
+            perror("epoll_ctl (listener)");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Level-triggered: it stays readable until main() tells everybody to stop.
+    if (shutdown_fd >= 0 && epoll_add(w->epfd, shutdown_fd, 0) < 0) {
+        perror("epoll_ctl (shutdown)");
+        exit(EXIT_FAILURE);
+    }
+
+    // The console stays level-triggered because fgets() may buffer more input.
+    // A regular file or /dev/null cannot be polled (EPERM): it is always readable,
+    // so the caller consumes it right away.
+    if (w->console && epoll_add(w->epfd, STDIN_FILENO, 0) < 0) {
+        if (errno != EPERM) {
+            perror("epoll_ctl (STDIN)");
+            exit(EXIT_FAILURE);
+        }
+        return false;
+    }
+    return true;
+}
+
+// --io-uring: one multishot recv per connection, into the stream buffer ring
+static void uring_arm_recv(Conn *c) {
+    uring_prep_recv_multishot(ur_sqe(c->owner), c->fd, c->owner->uring->stream_bufs.bgid,
+                              UR_DATA(UR_RECV, c->fd));
+    c->recv_armed = true;
+}
+
+// ----------------------------------------------------------------------------
+// conn_open(): register the accepted client `fd` (its --max-connections slot
+// is already taken) as a session in conn_table. `addr` is its address, or
+// NULL if the accept did not report it.
+// ----------------------------------------------------------------------------
+static void conn_open(Worker *w, int fd, StatsTransport transport, const char *what,
+                      const struct sockaddr_storage *addr) {
+    Conn *c = ((size_t)fd < conn_table_size) ? conn_alloc(w) : NULL;
+    if (!c) {
+        perror("conn_alloc");
+        close(fd);
+        __atomic_fetch_sub(&open_connections, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    c->fd = fd;
+    c->transport = transport;
+    c->last_active = w->now;
+    timer_init(&c->idle_timer, conn_idle_fired);
+    timer_init(&c->deadline_timer, conn_deadline_fired);
+    conn_table[fd] = c;
+    if (w->uring) {
+        uring_arm_recv(c);
+    } else if (epoll_add(w->epfd, fd, EPOLLET) < 0) {
+        fprintf(stderr, "register (%s client): %s\n", what, strerror(errno));
+        conn_table[fd] = NULL;
+        conn_release(c);
+        close(fd);
+        __atomic_fetch_sub(&open_connections, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    lru_append(c);
+    stats_add(&w->stats->t[transport].conns_opened, 1);
+    // log the new client's IPv4 address
+    struct sockaddr_storage peer;
+    socklen_t peer_len = sizeof(peer);
+    if (!addr && transport == STATS_TCP && log_enabled(LOG_LEVEL_INFO) &&
+        getpeername(fd, (struct sockaddr *)&peer, &peer_len) == 0) {
+        addr = &peer;
+    }
+    if (addr && addr->ss_family == AF_INET && log_enabled(LOG_LEVEL_INFO)) {
+        char ipstr[INET_ADDRSTRLEN];
+        const struct sockaddr_in *sa = (const struct sockaddr_in *)addr;
+        inet_ntop(AF_INET, &sa->sin_addr, ipstr, sizeof(ipstr));
+        log_msg(LOG_LEVEL_INFO, "New TCP client from %s", ipstr);
+    } else {
+        log_msg(LOG_LEVEL_DEBUG, "New %s client (fd %d)", what, fd);
+    }
+    if (conn_idle_ms > 0) {
+        timer_arm(w->wheel, &c->idle_timer, w->now + conn_idle_ms);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// accept_stream_clients():
+//   accept() on a TCP or UDS_STREAM listener until its backlog is empty and
+//   register every client as a session in conn_table. Over --max-connections
+//   a client is closed right away, or left in the backlog with
+//   --accept-backpressure.
+// ----------------------------------------------------------------------------
+static void accept_stream_clients(Worker *w, int listen_fd, StatsTransport transport, const char *what) {
+    while (1) {
+        bool reserved = conn_reserve(w, false);
+        if (!reserved && accept_backpressure && !conn_evictable(w)) {
+            log_msg(LOG_LEVEL_INFO, "Connection limit (%zu) reached, worker %d pauses accept",
+                    max_connections, w->id);
+            accept_pause(w);
+            break;
+        }
+        struct sockaddr_storage client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int new_fd = accept4(listen_fd, (struct sockaddr*)&client_addr, &addr_len, SOCK_NONBLOCK);
+        if (new_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "accept (%s): %s\n", what, strerror(errno));
+            }
+            if (reserved) __atomic_fetch_sub(&open_connections, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (!reserved) reserved = conn_reserve(w, true);
+        if (!reserved) {
+            log_msg(LOG_LEVEL_DEBUG, "Connection limit (%zu) reached, closing new %s client",
+                    max_connections, what);
+            close(new_fd);
+            continue;
+        }
+        conn_open(w, new_fd, transport, what, &client_addr);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// conn_serve(): read and serve commands until the socket would block or the
+// client's unsent replies reach out_high_water, then send all replies at
+// once. Whatever the client is slow to read stays queued on the connection;
+// its remaining requests wait in the socket until the queue drains.
+// ----------------------------------------------------------------------------
+static void conn_serve(Worker *w, Conn *c, ReplyBuf *out) {
+    uint64_t served = c->requests;
+    c->last_active = w->now;
+    lru_touch(c);
+    ClientStatus st = CLIENT_ACTIVE;
+    while (st == CLIENT_ACTIVE && c->pend_len < out_high_water) {
+        st = handle_tcp_client(c, out);
+    }
+    if (!reply_flush(c, out)) {
+        conn_close(c);
+        return;
+    }
+    if (st == CLIENT_CLOSED) {
+        // The client has finished sending; its last replies still go out
+        if (c->pend_len == 0) {
+            conn_close(c);
+            return;
+        }
+        c->closing = true;
+    }
+    c->read_paused = (st == CLIENT_ACTIVE);
+    conn_update_deadline(w, c, served);
+}
+
+// ----------------------------------------------------------------------------
+// conn_ready(): epoll event `events` for stream connection `c`. On close or
+// error the connection is dropped (close() also removes the fd from the
+// epoll set).
+// ----------------------------------------------------------------------------
+static void conn_ready(Worker *w, Conn *c, uint32_t events, ReplyBuf *out) {
+    if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && c->pend_len > 0) {
+        if (!conn_send_pending(c)) {
+            conn_close(c);
+            return;
+        }
+        c->last_active = w->now;
+        lru_touch(c);
+        if (c->closing) {
+            if (c->pend_len == 0) conn_close(c);
+            return;
+        }
+        if (c->read_paused && c->pend_len <= out_high_water / 2) {
+            c->read_paused = false;
+            conn_serve(w, c, out);   // the requests that waited in the socket
+            return;
+        }
+    }
+    if ((events & ~EPOLLOUT) && !c->read_paused && !c->closing) {
+        conn_serve(w, c, out);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// loop_begin() / loop_end(): what both event loops set up and tear down, the
+// timer wheel, the reply buffer and the connections.
+// ----------------------------------------------------------------------------
+static ReplyBuf *loop_begin(Worker *w) {
+    ReplyBuf *out = malloc(sizeof(ReplyBuf));
+    if (!out) {
+        perror("malloc (ReplyBuf)");
+        exit(EXIT_FAILURE);
+    }
+    out->len = 0;
+    w->wheel = malloc(sizeof(TimerWheel));
+    if (!w->wheel) {
+        perror("malloc (TimerWheel)");
+        exit(EXIT_FAILURE);
+    }
+    w->now = timer_now_ms();
+    timer_wheel_init(w->wheel, w->now);
+    if (w->console && timeout_secs > 0) {
+        timer_init(&w->idle_timer, global_idle_fired);
+        timer_arm(w->wheel, &w->idle_timer, w->now + (uint64_t)timeout_secs * 1000u);
+    }
+    timer_init(&w->accept_timer, accept_retry_fired);
+    return out;
+}
+
+static void loop_end(Worker *w, ReplyBuf *out) {
+    // Close the clients that are still connected before their timers' wheel goes
+    while (w->live_count > 0) {
+        conn_close(w->live[w->live_count - 1]);
+    }
+    free(w->live);
+    while (w->chunks) {
+        ConnChunk *next = w->chunks->next;
+        free(w->chunks);
+        w->chunks = next;
+    }
+    free(w->wheel);
+    w->wheel = NULL;
+    free(out);
+}
+
+// After a wakeup: stamp -t activity and run the timers that are due. Returns
+// false once the inactivity timeout has fired.
+static bool loop_tick(Worker *w, bool active) {
+    // One shared store per wakeup instead of an alarm() per event
+    if (active && timeout_secs > 0) {
+        __atomic_store_n(&last_activity_ms, w->now, __ATOMIC_RELAXED);
+    }
+    timer_wheel_advance(w->wheel, w->now);
+    if (w->timed_out) {
+        // No activity within the last <timeout_secs> seconds
+        printf("TIMEOUT: no activity for %d seconds. Shutting down.\n", timeout_secs);
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// run_event_loop():
+//   serve everything registered on w->epfd until the console closes, the
+//   inactivity timeout fires (worker 0) or shutdown_fd becomes readable.
+//   Each wakeup only visits the ready descriptors.
+// ----------------------------------------------------------------------------
+static void run_event_loop(Worker *w) {
+    struct epoll_event events[MAX_EVENTS];
+    ReplyBuf *out = loop_begin(w);
+    DgramBatch *dgrams = dgram_batch_alloc(dgram_batch);
+    bool running = true;
+    while (running) {
+        // Wait until at least one descriptor is ready or the next timer is due
+        int ready = epoll_wait(w->epfd, events, MAX_EVENTS, timer_wheel_timeout_ms(w->wheel));
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        w->now = timer_now_ms();
+        bool active = false;
+
+        for (int n = 0; n < ready && running; n++) {
+            int fd = events[n].data.fd;
+
+            // -------------------------------------------------------
+            // 1) New incoming TCP connection(s)?
+            // accept() until the backlog is empty and register each client.
+            // -------------------------------------------------------
+            if (fd == w->tcp_listen_fd) {
+                accept_stream_clients(w, w->tcp_listen_fd, STATS_TCP, "TCP");
+            }
+
+            // -------------------------------------------------------
+            // 2) Incoming UDP datagram(s)?
+            // recvmmsg() a batch, parse_and_update_udp() each, sendmmsg() the replies.
+            // -------------------------------------------------------
+            else if (fd == w->udp_fd) {
+                serve_datagrams(w, w->udp_fd, dgrams, STATS_UDP, "UDP");
+            }
+
+            // -------------------------------------------------------
+            // 3) Console keyboard input (STDIN_FILENO)?
+            // If ready, read one line, interpret “GEN …” commands.
+            // -------------------------------------------------------
+            else if (w->console && fd == STDIN_FILENO) {
+                if (!handle_console_input()) {
+                    // EOF (Ctrl+D) or error reading stdin ⇒ exit loop
+                    printf("Console closed or error – exiting.\n");
+                    running = false;
+                }
+            }
+
+            // -------------------------------------------------------
+            // 4) main() asked every worker to stop
+            // -------------------------------------------------------
+            else if (fd == shutdown_fd) {
+                running = false;
+            }
+
+            // -------------------------------------------------------
+            // 5) Accept new UDS_STREAM connection(s) (if that socket exists)
+            // They become persistent sessions just like TCP clients.
+            // -------------------------------------------------------
+            else if (fd == w->uds_stream_fd) {
+                accept_stream_clients(w, w->uds_stream_fd, STATS_UDS_STREAM, "UDS_STREAM");
+            }
+
+            // -------------------------------------------------------
+            // 6) Receive UDS_DGRAM datagram(s) “DELIVER …” (if that socket exists)
+            // Parse & respond to each client’s address over UDS datagram, in batches.
+            // -------------------------------------------------------
+            else if (fd == w->uds_dgram_fd) {
+                serve_datagrams(w, w->uds_dgram_fd, dgrams, STATS_UDS_DGRAM, "UDS_DGRAM");
+            }
+
+            // -------------------------------------------------------
+            // 7) An accepted stream client is readable and/or writable:
+            // send queued replies, serve commands (see conn_serve()).
+            // An accept earlier in this batch may have evicted it
+            // (--evict-idle-ms): its events are then dropped. Should the
+            // new client have got the same fd, a stale event only makes
+            // it read or send, which finds nothing to do.
+            // -------------------------------------------------------
+            else {
+                Conn *c = conn_table[fd];
+                if (c) conn_ready(w, c, events[n].events, out);
+            }
+
+            if (fd != shutdown_fd) {
+                active = true;
+            }
+        }
+
+        if (!loop_tick(w, active)) {
+            running = false;
+        }
+    }
+    loop_end(w, out);
+    dgram_batch_free(dgrams);
+}
+
+// ----------------------------------------------------------------------------
+// worker_init_uring():
+//   --io-uring: create the worker's ring and its two provided buffer rings.
+//   Buffer group 0 feeds the stream clients' multishot recvs; group 1 the
+//   multishot recvmsgs on UDP / UDS_DGRAM, each buffer laid out as
+//   io_uring_recvmsg_out, sender address, payload (see dgram_msg).
+//   Returns false (and leaves w->uring NULL) if the ring cannot be set up,
+//   so the worker falls back to epoll.
+// ----------------------------------------------------------------------------
+static bool worker_init_uring(Worker *w) {
+    UringLoop *u = calloc(1, sizeof(*u));
+    if (!u) {
+        perror("calloc (UringLoop)");
+        exit(EXIT_FAILURE);
+    }
+    if (uring_init(&u->ring, UR_ENTRIES, UR_CQ_ENTRIES) < 0) {
+        fprintf(stderr, "worker %d: io_uring_setup: %s\n", w->id, strerror(errno));
+        free(u);
+        return false;
+    }
+    unsigned dgram_size = (unsigned)(sizeof(struct io_uring_recvmsg_out) +
+                                     sizeof(struct sockaddr_storage) + MAXBUF);
+    if (uring_buf_ring_init(&u->ring, &u->stream_bufs, 0, UR_STREAM_BUFS, CONN_INBUF) < 0 ||
+        uring_buf_ring_init(&u->ring, &u->dgram_bufs, 1, UR_DGRAM_BUFS, dgram_size) < 0) {
+        fprintf(stderr, "worker %d: provided buffer ring: %s\n", w->id, strerror(errno));
+        uring_buf_ring_free(&u->ring, &u->stream_bufs);
+        uring_free(&u->ring);
+        free(u);
+        return false;
+    }
+    u->dgram_msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+    // One reply slot per datagram buffer: a reply lives until its sendmsg completes
+    u->replies        = dgram_batch_alloc(UR_DGRAM_BUFS);
+    u->free_slots     = calloc(UR_DGRAM_BUFS, sizeof(*u->free_slots));
+    u->slot_transport = calloc(UR_DGRAM_BUFS, sizeof(*u->slot_transport));
+    if (!u->free_slots || !u->slot_transport) {
+        perror("calloc (reply slots)");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned i = 0; i < UR_DGRAM_BUFS; i++) {
+        u->free_slots[u->free_count++] = UR_DGRAM_BUFS - 1 - i;
+    }
+
+    int listen_fds[] = { w->tcp_listen_fd, w->udp_fd, w->uds_stream_fd, w->uds_dgram_fd };
+    for (size_t i = 0; i < sizeof(listen_fds) / sizeof(listen_fds[0]); i++) {
+        if (listen_fds[i] >= 0 && set_nonblocking(listen_fds[i]) < 0) {
+            perror("fcntl (O_NONBLOCK)");
+            exit(EXIT_FAILURE);
+        }
+    }
+    w->uring = u;
+    return true;
+}
+
+static void worker_free_uring(Worker *w) {
+    UringLoop *u = w->uring;
+    uring_buf_ring_free(&u->ring, &u->stream_bufs);
+    uring_buf_ring_free(&u->ring, &u->dgram_bufs);
+    uring_free(&u->ring);
+    dgram_batch_free(u->replies);
+    free(u->free_slots);
+    free(u->slot_transport);
+    free(u);
+    w->uring = NULL;
+}
+
+// Same rule as worker_init_epoll(): a regular file or /dev/null on stdin
+// cannot be polled, the caller consumes it right away.
+static bool stdin_pollable(void) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    bool ok = epoll_add(epfd, STDIN_FILENO, 0) == 0 || errno != EPERM;
+    close(epfd);
+    return ok;
+}
+
+// Multishot recvmsg on datagram socket i (0 = UDP, 1 = UDS_DGRAM) of `w`
+static void uring_arm_dgram(Worker *w, int i) {
+    UringLoop *u = w->uring;
+    int fd = (i == 0) ? w->udp_fd : w->uds_dgram_fd;
+    if (fd < 0 || u->dgram_armed[i] || u->stopping) return;
+    uring_prep_recvmsg_multishot(ur_sqe(w), fd, &u->dgram_msg, u->dgram_bufs.bgid, UR_DATA(UR_RECVMSG, fd));
+    u->dgram_armed[i] = true;
+}
+
+// ----------------------------------------------------------------------------
+// uring_accepted(): completion of the accept on stream listener i. `res` is
+// the new client's fd or -errno.
+// ----------------------------------------------------------------------------
+static void uring_accepted(Worker *w, int i, int res, bool more) {
+    UringLoop *u = w->uring;
+    StatsTransport transport = (i == 0) ? STATS_TCP : STATS_UDS_STREAM;
+    const char *what = (i == 0) ? "TCP" : "UDS_STREAM";
+    if (!more) u->accept_armed[i] = false;
+    if (res >= 0) {
+        if (u->stopping) {
+            close(res);
+        } else if (!conn_reserve(w, true)) {
+            log_msg(LOG_LEVEL_DEBUG, "Connection limit (%zu) reached, closing new %s client",
+                    max_connections, what);
+            close(res);
+        } else {
+            conn_open(w, res, transport, what, NULL);
+        }
+    } else if (res != -ECANCELED) {
+        log_msg(LOG_LEVEL_ERROR, "accept (%s): %s", what, strerror(-res));
+    }
+    if (u->accept_armed[i] || w->accept_paused || u->stopping) return;
+    if (accept_backpressure && conn_limit_reached(w)) {
+        log_msg(LOG_LEVEL_INFO, "Connection limit (%zu) reached, worker %d pauses accept",
+                max_connections, w->id);
+        accept_pause(w);
+    } else {
+        // The next single accept, or a multishot one the kernel ended
+        uring_arm_accept(w, i);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// uring_received(): completion of the multishot recv on `c`. `n` bytes are
+// in provided buffer `bid`; they are copied into the connection's ring (a
+// part at a time if it has less room) and served like a readv() would be.
+// ----------------------------------------------------------------------------
+static void uring_received(Worker *w, Conn *c, const struct io_uring_cqe *cqe, ReplyBuf *out) {
+    UringLoop *u = w->uring;
+    int res = cqe->res;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) c->recv_armed = false;
+    if (c->dead) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) uring_buf_recycle(&u->stream_bufs, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        conn_close(c);
         return;
     }
-
-    // Compute needed atoms for one molecule × count
-    uint64_t req_carbon = 0, req_oxygen = 0, req_hydrogen = 0;
-    if (strcmp(full_mol, "WATER") == 0) {
-        // H2O: needs 2 H + 1 O per molecule
-        req_hydrogen = 2ULL * count;
-        req_oxygen   = 1ULL * count;
-        req_carbon   = 0ULL;
-    }
-    else if (strcmp(full_mol, "CARBON DIOXIDE") == 0) {
-        // CO2: needs 1 C + 2 O per molecule
-        req_carbon   = 1ULL * count;
-        req_oxygen   = 2ULL * count;
-        req_hydrogen = 0ULL;
-    }
-    else if (strcmp(full_mol, "GLUCOSE") == 0) {
-        // C6H12O6: needs 6 C + 12 H + 6 O per molecule
-        req_carbon   = 6ULL * count;
-        req_hydrogen = 12ULL * count;
-        req_oxygen   = 6ULL * count;
-    }
-    else if (strcmp(full_mol, "ALCOHOL") == 0) {
-        // C2H6O: needs 2 C + 6 H + 1 O per molecule
-        req_carbon   = 2ULL * count;
-        req_hydrogen = 6ULL * count;
-        req_oxygen   = 1ULL * count;
+    uint64_t served = c->requests;
+    c->last_active = w->now;
+    lru_touch(c);
+    bool ok = true;
+    if (res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        const char *data = uring_buf(&u->stream_bufs, bid);
+        size_t left = (size_t)res;
+        while (ok && left > 0) {
+            size_t tail = (c->head + c->len) & (CONN_INBUF - 1);
+            size_t n = CONN_INBUF - c->len;
+            if (n > left) n = left;
+            size_t first = (tail + n <= CONN_INBUF) ? n : CONN_INBUF - tail;
+            memcpy(c->in + tail, data, first);
+            memcpy(c->in, data + first, n - first);
+            data += n;
+            left -= n;
+            ok = conn_received(c, out, n);
+        }
+        uring_buf_recycle(&u->stream_bufs, bid);
+    } else if (res == 0) {
+        // The client has finished sending; a last unterminated line is served
+        if (c->proto == PROTO_TEXT) serve_buffered_lines(c, out, true);
+        c->closing = true;
+    } else if (res != -ENOBUFS && res != -ECANCELED) {
+        log_msg(LOG_LEVEL_DEBUG, "recv (fd %d): %s", c->fd, strerror(-res));
+        ok = false;
     }
-    else {
-        snprintf(response, resp_size, "ERROR: unknown molecule\n");
+    if (!ok || !reply_flush(c, out) || (c->closing && conn_unsent(c) == 0)) {
+        conn_close(c);
         return;
     }
+    if (c->closing) return;
+    // Too many unsent replies: the requests wait in the socket
+    if (conn_unsent(c) >= out_high_water) {
+        if (!c->read_paused && c->recv_armed) {
+            uring_prep_cancel(ur_sqe(w), UR_DATA(UR_RECV, c->fd), UR_DATA(UR_CANCEL, c->fd));
+        }
+        c->read_paused = true;
+    } else if (!c->recv_armed && !c->read_paused) {
+        // ENOBUFS ended the multishot recv: every buffer was in use
+        uring_arm_recv(c);
+    }
+    conn_update_deadline(w, c, served);
+}
 
-    // Check if enough atoms exist
-    if (atom_stock.carbon   < req_carbon) {
-        snprintf(response, resp_size, "ERROR: not enough carbon atoms\n");
+// Completion of the send of c->sbuf: send the rest, or whatever was queued
+// meanwhile, and resume reading once the queue is down to half the mark.
+static void uring_sent(Worker *w, Conn *c, int res) {
+    c->send_inflight = false;
+    if (c->dead) {
+        conn_close(c);
         return;
     }
-    if (atom_stock.oxygen   < req_oxygen) {
-        snprintf(response, resp_size, "ERROR: not enough oxygen atoms\n");
+    if (res < 0) {
+        log_msg(LOG_LEVEL_DEBUG, "send (fd %d): %s", c->fd, strerror(-res));
+        conn_close(c);
         return;
     }
-    if (atom_stock.hydrogen < req_hydrogen) {
-        snprintf(response, resp_size, "ERROR: not enough hydrogen atoms\n");
-        return;
+    c->sbuf_off += (size_t)res;
+    c->last_active = w->now;
+    lru_touch(c);
+    if (c->sbuf_off < c->sbuf_len) {
+        uring_send(c);
+    } else if (c->pend_len > 0) {
+        uring_send_pending(c);
+    } else {
+        // Drained: give the memory back, a fast reader never needs it
+        free(c->sbuf);
+        free(c->pend);
+        c->sbuf = c->pend = NULL;
+        c->sbuf_off = c->sbuf_len = c->sbuf_cap = 0;
+        c->pend_head = c->pend_cap = 0;
     }
-
-    // Subtract the required atoms
-    atom_stock.carbon   -= req_carbon;
-    atom_stock.oxygen   -= req_oxygen;
-    atom_stock.hydrogen -= req_hydrogen;
-
-    // Print updated inventory 
-    print_inventory();
-
-    //if there is a save flag , we will save the atoms to the file.
-    if (save_file_path) {
-        save_atoms_to_file(save_file_path);
+    if (c->closing) {
+        if (conn_unsent(c) == 0) conn_close(c);
+    } else if (c->read_paused && conn_unsent(c) <= out_high_water / 2) {
+        c->read_paused = false;
+        if (!c->recv_armed) uring_arm_recv(c);
     }
-
-    // Respond with a short “OK: Atoms left – Carbon=.. Oxygen=.. Hydrogen=..\n”
-    snprintf(response, resp_size,
-             "OK: Atoms left – Carbon=%llu Oxygen=%llu Hydrogen=%llu\n",
-             (unsigned long long)atom_stock.carbon,
-             (unsigned long long)atom_stock.oxygen,
-             (unsigned long long)atom_stock.hydrogen);
 }
 
 // ----------------------------------------------------------------------------
-// handle_tcp_client():
-//   - read exactly one “ADD …” line (via recv), 
-//   - call parse_and_update_tcp(…), 
-//   - send the response back over that same TCP socket.
-// Return false if client closed or a recv‐error occurred.
-// ----------------------------------------------------------------------------
-bool handle_tcp_client(int client_fd) {
-    char buf[MAXBUF];
-    ssize_t numbytes = recv(client_fd, buf, sizeof(buf)-1, 0);
-    if (numbytes <= 0) {
-        // 0 => client closed; <0 => recv error
-        return false;
+// uring_datagram(): completion of the multishot recvmsg on datagram socket
+// i. The request is served right away and its reply goes back to the sender
+// with a sendmsg that leaves with the next io_uring_enter(). With every
+// reply slot in flight the reply is dropped, like a full client queue.
+// ----------------------------------------------------------------------------
+static void uring_datagram(Worker *w, int i, const struct io_uring_cqe *cqe) {
+    UringLoop *u = w->uring;
+    int fd = (i == 0) ? w->udp_fd : w->uds_dgram_fd;
+    StatsTransport transport = (i == 0) ? STATS_UDP : STATS_UDS_DGRAM;
+    const char *what = (i == 0) ? "UDP" : "UDS_DGRAM";
+    StatsCounters *counters = &w->stats->t[transport];
+    if (!(cqe->flags & IORING_CQE_F_MORE)) u->dgram_armed[i] = false;
+    if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        char *buf = uring_buf(&u->dgram_bufs, bid);
+        const struct io_uring_recvmsg_out *rmsg = (const struct io_uring_recvmsg_out *)buf;
+        const char *name = buf + sizeof(*rmsg);
+        const char *payload = name + u->dgram_msg.msg_namelen;
+        size_t len = rmsg->payloadlen;
+        if (len > (size_t)cqe->res - (size_t)(payload - buf)) len = (size_t)cqe->res - (size_t)(payload - buf);
+        if (len > MAXBUF - 1) len = MAXBUF - 1;   // as recvmmsg() truncates
+        stats_add(&counters->bytes_in, (uint64_t)len);
+        if (u->free_count == 0 || u->stopping) {
+            log_msg(LOG_LEVEL_DEBUG, "sendmsg (%s): every reply slot in flight, reply dropped", what);
+            stats_add(&counters->replies_dropped, 1);
+            char resp[MAXBUF];
+            serve_datagram(w, transport, payload, len, resp);
+        } else {
+            unsigned slot = u->free_slots[--u->free_count];
+            DgramBatch *b = u->replies;
+            b->reply_iov[slot].iov_len = serve_datagram(w, transport, payload, len, b->resp[slot]);
+            socklen_t namelen = rmsg->namelen;
+            if (namelen > sizeof(b->addr[slot])) namelen = sizeof(b->addr[slot]);
+            memcpy(&b->addr[slot], name, namelen);
+            b->reply[slot].msg_hdr.msg_namelen = namelen;
+            u->slot_transport[slot] = transport;
+            uring_prep_sendmsg(ur_sqe(w), fd, &b->reply[slot].msg_hdr, MSG_DONTWAIT,
+                               UR_DATA(UR_SENDMSG, slot));
+        }
+        uring_buf_recycle(&u->dgram_bufs, bid);
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+        log_msg(LOG_LEVEL_ERROR, "recvmsg (%s): %s", what, strerror(-cqe->res));
     }
-    buf[numbytes] = '\0';
-
-    char response[MAXBUF];
-    parse_and_update_tcp(buf, response, sizeof(response));
+    uring_arm_dgram(w, i);
+}
 
-    if (send(client_fd, response, strlen(response), 0) < 0) {
-        perror("send (TCP)");
+static void uring_dgram_sent(Worker *w, unsigned slot, int res) {
+    UringLoop *u = w->uring;
+    StatsCounters *counters = &w->stats->t[u->slot_transport[slot]];
+    if (res < 0) {
+        log_msg(LOG_LEVEL_DEBUG, "sendmsg: %s, reply dropped", strerror(-res));
+        stats_add(&counters->replies_dropped, 1);
+    } else {
+        stats_add(&counters->bytes_out, (uint64_t)res);
     }
-    return true;
+    u->free_slots[u->free_count++] = slot;
 }
+
 // ----------------------------------------------------------------------------
-// load_atoms_from_file():
-//      if the file exists and big enough , reads sizeof (atomStock) to the global var.
-//      else creating a new file , fills it with the values of the atoms and read the full struct to the file.
+// uring_complete(): dispatch one completion. Returns false once the loop
+// has to end (console closed, shutdown_fd readable).
 // ----------------------------------------------------------------------------
-static void load_atoms_from_file(const char *path, uint64_t init_c, uint64_t init_o,uint64_t init_h)
-{
-    struct stat st;
-    FILE *fp;
-
-    //if the file exists
-    if (stat(path,&st) == 0){
-        if(st.st_size >= (off_t)sizeof(atom_stock)){
-            //reading all the struct from the file:
-            fp = fopen(path,"rb");
-            if (!fp){
-                perror("fopen (for read)");
-                exit(EXIT_FAILURE);
-            }
-            size_t n = fread(&atom_stock,1,sizeof(AtomStock),fp);
-            if (n != sizeof(AtomStock)){
-                fprintf(stderr,"Error:could not read Atoms from file \n");
-                fclose(fp);
-                exit(EXIT_FAILURE);
+static bool uring_complete(Worker *w, const struct io_uring_cqe *cqe, ReplyBuf *out) {
+    int fd = UR_FD(cqe->user_data);
+    bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    switch (UR_OP(cqe->user_data)) {
+        case UR_ACCEPT:
+            uring_accepted(w, fd == w->tcp_listen_fd ? 0 : 1, cqe->res, more);
+            break;
+        case UR_RECV:
+            uring_received(w, conn_table[fd], cqe, out);
+            break;
+        case UR_SEND:
+            uring_sent(w, conn_table[fd], cqe->res);
+            break;
+        case UR_RECVMSG:
+            uring_datagram(w, fd == w->udp_fd ? 0 : 1, cqe);
+            break;
+        case UR_SENDMSG:
+            uring_dgram_sent(w, (unsigned)fd, cqe->res);
+            break;
+        case UR_CONSOLE:
+            if (w->uring->stopping) break;
+            if (!handle_console_input()) {
+                // EOF (Ctrl+D) or error reading stdin ⇒ exit loop
+                printf("Console closed or error – exiting.\n");
+                return false;
             }
-            fclose(fp);
-            return;
-        }
-        //if file is too small , we will drop to create a new file.
+            uring_prep_poll(ur_sqe(w), STDIN_FILENO, POLLIN, UR_DATA(UR_CONSOLE, STDIN_FILENO));
+            break;
+        case UR_SHUTDOWN:
+            return false;
+        case UR_CANCEL:
+            break;
     }
+    return true;
+}
 
-    //if we reach here , file not exists or too small -> creating a new file :
-    atom_stock.carbon = init_c;
-    atom_stock.oxygen = init_o;
-    atom_stock.hydrogen = init_h;
-
-    fp = fopen(path, "wb");
-    if (!fp) {
-        perror("fopen for write");
-        exit(EXIT_FAILURE);
-    }
-    size_t w = fwrite(&atom_stock,1,sizeof(AtomStock),fp);
-    if (w != sizeof(AtomStock)){
-        fprintf(stderr,"Error: could not write full Atoms struct to file \n");
-        fclose(fp);
-        exit(EXIT_FAILURE);
+// Run every completion that is ready; *active is set unless only shutdown_fd fired
+static bool uring_drain(Worker *w, ReplyBuf *out, bool *active) {
+    Uring *ring = &w->uring->ring;
+    bool running = true;
+    struct io_uring_cqe *next;
+    while ((next = uring_cqe(ring)) != NULL) {
+        // Handlers may submit (a full SQ), so the CQE is copied and released first
+        struct io_uring_cqe cqe = *next;
+        uring_cqe_seen(ring);
+        if (UR_OP(cqe.user_data) != UR_SHUTDOWN) *active = true;
+        if (!uring_complete(w, &cqe, out)) running = false;
     }
-    fclose(fp);
+    return running;
 }
 
-
 // ----------------------------------------------------------------------------
-// save_atoms_to_file():
-//opens / creates the file in rb or wb. locks the file with flock to prevent parallel changes.
-//writes a block of our atoms struct with fwrite.
-//releases the lock and closes the files.
+// run_uring_loop():
+//   --io-uring: the same service as run_event_loop() with the worker's
+//   ring instead of epoll. Listeners have a multishot accept, every stream
+//   client and datagram socket a multishot receive into provided buffers,
+//   and replies are sends queued as SQEs. The SQEs a wakeup prepared are
+//   submitted by the same io_uring_enter() that waits for the next
+//   completions, so one system call serves a whole batch of requests.
 // ----------------------------------------------------------------------------
-static void save_atoms_to_file(const char *path){
-    FILE *fp = fopen(path,"r+b");
-    if (!fp) { //if file does not exits we will try to create it
-        fp = fopen(path,"w+b");
-        if(!fp){
-            perror("fopen for save");
-            return;
+static void run_uring_loop(Worker *w) {
+    UringLoop *u = w->uring;
+    if (uring_enable(&u->ring) < 0) {
+        perror("io_uring_register (enable)");
+        exit(EXIT_FAILURE);
+    }
+    ReplyBuf *out = loop_begin(w);
+    accept_set_polled(w, true);
+    uring_arm_dgram(w, 0);
+    uring_arm_dgram(w, 1);
+    if (w->console) {
+        uring_prep_poll(ur_sqe(w), STDIN_FILENO, POLLIN, UR_DATA(UR_CONSOLE, STDIN_FILENO));
+    }
+    if (shutdown_fd >= 0) {
+        uring_prep_poll(ur_sqe(w), shutdown_fd, POLLIN, UR_DATA(UR_SHUTDOWN, shutdown_fd));
+    }
+    bool running = true;
+    while (running) {
+        // Submit what the last wakeup prepared and wait for a completion or the next timer
+        persist_wait_durable();
+        int rc = uring_submit_and_wait(&u->ring, 1, timer_wheel_timeout_ms(w->wheel));
+        if (rc < 0 && rc != -ETIME && rc != -EINTR && rc != -EBUSY) {
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(-rc));
+            exit(EXIT_FAILURE);
+        }
+        w->now = timer_now_ms();
+        bool active = false;
+        running = uring_drain(w, out, &active);
+        if (!loop_tick(w, active)) {
+            running = false;
         }
     }
 
-    int fd = fileno(fp); // should understand later
-    if (fd < 0) {
-        perror("fileno");
-        fclose(fp);
-        return;
+    // Stop accepting and receiving, close every client and wait until the
+    // kernel has let go of their buffers and of the datagram replies
+    u->stopping = true;
+    for (int i = 0; i < 2; i++) {
+        int fd = stream_listener(w, i);
+        if (u->accept_armed[i]) uring_prep_cancel(ur_sqe(w), UR_DATA(UR_ACCEPT, fd), UR_DATA(UR_CANCEL, fd));
+        fd = (i == 0) ? w->udp_fd : w->uds_dgram_fd;
+        if (u->dgram_armed[i]) uring_prep_cancel(ur_sqe(w), UR_DATA(UR_RECVMSG, fd), UR_DATA(UR_CANCEL, fd));
     }
-
-    //exlusive lock:
-    if (flock(fd,LOCK_EX) < 0){
-        perror("flock LOCK_EX");
-        //might be risky but we will keep going :D
+    for (size_t i = w->live_count; i-- > 0; ) {
+        conn_close(w->live[i]);
     }
-
-    //writing:
-    if (fseek(fp,0,SEEK_SET)!= 0)
-        perror("fseek");
-    size_t w = fwrite(&atom_stock,1,sizeof(AtomStock),fp);
-    if (w!=sizeof(AtomStock))
-        fprintf(stderr, "Error: could not write full Atom struct\n");
-    fflush(fp);
-
-    //releasing the lock:
-    if (flock(fd, LOCK_UN) < 0) {
-        perror("flock LOCK_UN");
+    bool active = false;
+    while (w->live_count > 0 || u->free_count < UR_DGRAM_BUFS) {
+        int rc = uring_submit_and_wait(&u->ring, 1, 1000);
+        if (rc < 0 && rc != -EINTR && rc != -EBUSY) {
+            fprintf(stderr, "worker %d: io_uring_enter (shutdown): %s\n", w->id, strerror(-rc));
+            break;
+        }
+        uring_drain(w, out, &active);
     }
-    fclose(fp);
-
-}   
-
+    for (size_t i = w->live_count; i-- > 0; ) {
+        // Only if the kernel never answered: the ring goes away with them
+        w->live[i]->recv_armed = w->live[i]->send_inflight = false;
+    }
+    loop_end(w, out);
+    worker_free_uring(w);
+}
 
+// ----------------------------------------------------------------------------
+// worker_thread(): entry point of the extra --workers event-loop threads.
+// ----------------------------------------------------------------------------
+static void *worker_thread(void *arg) {
+    Worker *w = (Worker *)arg;
+    if (w->uring) {
+        run_uring_loop(w);
+    } else {
+        run_event_loop(w);
+    }
+    return NULL;
+}
 
 
+static void usage_exit(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s -c <carbon> -o <oxygen> -h <hydrogen> "
+        "[-t <timeout>] -T <tcp_port> -U <udp_port> \\\n"
+        "       [-s <uds_stream_path>] [-d <uds_dgram_path>] -f <file path>\n"
+        " -f <file path> [--workers <N>] [--wal [--wal-sync-ms <ms>] [--wal-sync-ops <N>] [--wal-compact-ops <N>]]\n"
+        " [--mmap [--msync-ms <ms>]] [--save-thread [--ack <apply|fsync>]]\n"
+        " [--dgram-batch <N>] [--recipes <file>]\n"
+        " [--log-level <error|warn|info|debug>] [--log-rate <lines/s>] [--log-summary-ms <ms>]\n"
+        " [--conn-idle-ms <ms>] [--request-timeout-ms <ms>]\n"
+        " [--max-connections <N> [--evict-idle-ms <ms>] [--accept-backpressure]]\n"
+        " [--metrics-port <port>] [--out-high-water <bytes>] [--io-uring]\n"
+        " [--warehouses <N>] [--atoms <NAME,NAME,...>]\n",
+        prog);
+    exit(EXIT_FAILURE);
+}
 
+// A -c / -o / -h start value, checked like a request count: the inventory
+// kernels rely on every count being at most MAX_ATOMS
+static uint64_t start_count(const char *flag, const char *arg, const char *prog) {
+    uint64_t v;
+    ParseStatus st = parse_number(arg, &v);
+    if (st != PARSE_OK) {
+        fprintf(stderr, "ERROR: %s %s: %s", flag, arg, parse_error_text(st) + strlen("ERROR: "));
+        usage_exit(prog);
+    }
+    return v;
+}
 
 // ----------------------------------------------------------------------------
 // main():
-//   • parse flags (−c, −o, −h, −t, −T, −U, optionally −s or −d)
-//   • set up atom_stock
-//   • possibly install SIGALRM
-//   • create and bind TCP listen socket on port T
-//   • create and bind UDP socket on port U
+//   • parse flags (−c, −o, −h, −t, −T, −U, optionally −s or −d, --workers)
+//   • set up the inventory
+//   • with -t, worker 0 arms an idle timer on its timer wheel
+//   • create and bind TCP listen socket on port T   (one per worker)
+//   • create and bind UDP socket on port U          (one per worker)
 //   • optionally create & bind UDS‐STREAM if −s was given
 //   • optionally create & bind UDS‐DGRAM if −d was given
-//   • enter select() loop: monitor 
-//       – tcp_listen_fd, 
-//       – udp_fd, 
-//       – any accepted TCP client fds, 
-//       – STDIN_FILENO, 
-//       – uds_stream_fd (if set), 
-//       – uds_dgram_fd (if set).
-//   • on tcp_listen_fd ready: accept new connection, add to client list
-//   • on udp_fd ready: recvfrom, parse_and_update_udp, sendto reply
-//   • on any TCP client fd ready: call handle_tcp_client()
+//   • every worker registers its sockets once with an edge-triggered epoll instance:
+//       – tcp_listen_fd,
+//       – udp_fd,
+//       – any accepted TCP / UDS‐STREAM client fds,
+//       – STDIN_FILENO (worker 0, level-triggered, stdio buffers the console),
+//       – uds_stream_fd (worker 0, if set),
+//       – uds_dgram_fd (worker 0, if set).
+//   • on tcp_listen_fd ready: accept every pending connection, add it to epoll
+//   • on udp_fd ready: recvfrom, parse_and_update_udp, sendto reply (until drained)
+//   • on any stream client fd ready: call handle_tcp_client() until it would block
 //   • on STDIN_FILENO ready: handle “GEN …” console commands
-//   • on uds_stream_fd ready: accept a UDS‐STREAM connection, call handle_tcp_client() over it, close it
+//   • on uds_stream_fd ready: accept every pending UDS‐STREAM connection, add it to epoll
 //   • on uds_dgram_fd ready: recvfrom a “DELIVER …” datagram from a UDS client, parse_and_update_udp, sendto reply back to that UDS client
-//   • if timeout triggered, break out and clean up
+//   • worker 0 runs on the main thread; workers 1..N-1 run on their own threads
+//   • if timeout triggered or the console closed, stop all workers and clean up
 // ----------------------------------------------------------------------------
 int main(int argc, char *argv[]) {
     // 1) Parse command‐line options
     uint64_t init_carbon   = 0;
     uint64_t init_oxygen   = 0;
     uint64_t init_hydrogen = 0;
-    int timeout_secs       = 0;
     int tcp_port           = -1;
     int udp_port           = -1;
+    int num_workers        = 1;
+    int metrics_port       = 0;
     char *uds_stream_path  = NULL;
     char *uds_dgram_path   = NULL;
+    bool use_wal           = false;
+    bool use_mmap          = false;
+    bool use_save_thread   = false;
+    size_t max_warehouses  = 0;
+    const char *recipes_path = NULL;
+    unsigned msync_ms      = 0;
+    WalConfig wal_cfg      = { WAL_DEFAULT_SYNC_MS, WAL_DEFAULT_SYNC_OPS, WAL_DEFAULT_COMPACT_OPS };
+    LogConfig log_cfg      = { LOG_LEVEL_INFO, 0, 0 };
 
     struct option long_opts[] = {
         {"carbon",       required_argument, 0, 'c'},
@@ -550,20 +2631,44 @@ int main(int argc, char *argv[]) {
         {"stream-path",  required_argument, 0, 's'},
         {"datagram-path",required_argument, 0, 'd'},
         {"save-file",required_argument, 0, 'f'},
+        {"workers",      required_argument, 0, 'w'},
+        {"wal",             no_argument,       0, OPT_WAL},
+        {"wal-sync-ms",     required_argument, 0, OPT_WAL_SYNC_MS},
+        {"wal-sync-ops",    required_argument, 0, OPT_WAL_SYNC_OPS},
+        {"wal-compact-ops", required_argument, 0, OPT_WAL_COMPACT_OPS},
+        {"mmap",            no_argument,       0, OPT_MMAP},
+        {"msync-ms",        required_argument, 0, OPT_MSYNC_MS},
+        {"dgram-batch",     required_argument, 0, OPT_DGRAM_BATCH},
+        {"recipes",         required_argument, 0, OPT_RECIPES},
+        {"log-level",       required_argument, 0, OPT_LOG_LEVEL},
+        {"log-rate",        required_argument, 0, OPT_LOG_RATE},
+        {"log-summary-ms",  required_argument, 0, OPT_LOG_SUMMARY_MS},
+        {"conn-idle-ms",    required_argument, 0, OPT_CONN_IDLE_MS},
+        {"request-timeout-ms", required_argument, 0, OPT_REQUEST_TIMEOUT_MS},
+        {"max-connections", required_argument, 0, OPT_MAX_CONNECTIONS},
+        {"evict-idle-ms",   required_argument, 0, OPT_EVICT_IDLE_MS},
+        {"accept-backpressure", no_argument,   0, OPT_ACCEPT_BACKPRESSURE},
+        {"metrics-port",    required_argument, 0, OPT_METRICS_PORT},
+        {"out-high-water",  required_argument, 0, OPT_OUT_HIGH_WATER},
+        {"io-uring",        no_argument,       0, OPT_IO_URING},
+        {"save-thread",     no_argument,       0, OPT_SAVE_THREAD},
+        {"ack",             required_argument, 0, OPT_ACK},
+        {"warehouses",      required_argument, 0, OPT_WAREHOUSES},
+        {"atoms",           required_argument, 0, OPT_ATOMS},
         {0,0,0,0}
     };
-    const char *short_opts = "c:o:h:t:T:U:s:d:f:";
+    const char *short_opts = "c:o:h:t:T:U:s:d:f:w:";
     int opt;
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
         switch (opt) {
             case 'c':
-                init_carbon = strtoull(optarg, NULL, 10);
+                init_carbon = start_count("-c", optarg, argv[0]);
                 break;
             case 'o':
-                init_oxygen = strtoull(optarg, NULL, 10);
+                init_oxygen = start_count("-o", optarg, argv[0]);
                 break;
             case 'h':
-                init_hydrogen = strtoull(optarg, NULL, 10);
+                init_hydrogen = start_count("-h", optarg, argv[0]);
                 break;
             case 't':
                 timeout_secs = atoi(optarg);
@@ -583,14 +2688,95 @@ int main(int argc, char *argv[]) {
             case 'f':
                 save_file_path = optarg;
                 break;
+            case 'w':
+                num_workers = atoi(optarg);
+                break;
+            case OPT_WAL:
+                use_wal = true;
+                break;
+            case OPT_WAL_SYNC_MS:
+                wal_cfg.sync_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_WAL_SYNC_OPS:
+                wal_cfg.sync_ops = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_WAL_COMPACT_OPS:
+                wal_cfg.compact_ops = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_MMAP:
+                use_mmap = true;
+                break;
+            case OPT_MSYNC_MS:
+                msync_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_DGRAM_BATCH:
+                dgram_batch = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_LOG_LEVEL: {
+                int level = log_parse_level(optarg);
+                if (level < 0) {
+                    fprintf(stderr, "ERROR: --log-level must be error, warn, info or debug\n");
+                    exit(EXIT_FAILURE);
+                }
+                log_cfg.level = (LogLevel)level;
+                break;
+            }
+            case OPT_LOG_RATE:
+                log_cfg.rate = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_LOG_SUMMARY_MS:
+                log_cfg.summary_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_CONN_IDLE_MS:
+                conn_idle_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_REQUEST_TIMEOUT_MS:
+                request_timeout_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_MAX_CONNECTIONS:
+                max_connections = (size_t)strtoull(optarg, NULL, 10);
+                break;
+            case OPT_EVICT_IDLE_MS:
+                evict_idle_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_ACCEPT_BACKPRESSURE:
+                accept_backpressure = true;
+                break;
+            case OPT_METRICS_PORT:
+                metrics_port = atoi(optarg);
+                break;
+            case OPT_OUT_HIGH_WATER:
+                out_high_water = (size_t)strtoull(optarg, NULL, 10);
+                break;
+            case OPT_IO_URING:
+                use_io_uring = true;
+                break;
+            case OPT_SAVE_THREAD:
+                use_save_thread = true;
+                break;
+            case OPT_ACK:
+                if (strcmp(optarg, "apply") == 0) {
+                    ack_fsync = false;
+                } else if (strcmp(optarg, "fsync") == 0) {
+                    ack_fsync = true;
+                } else {
+                    fprintf(stderr, "ERROR: --ack must be apply or fsync\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPT_WAREHOUSES:
+                max_warehouses = (size_t)strtoull(optarg, NULL, 10);
+                break;
+            case OPT_ATOMS:
+                if (atoms_configure(optarg) < 0) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPT_RECIPES:
+                recipes_path = optarg;   // loaded once --atoms is known
+                break;
             default:
-                fprintf(stderr,
-                    "Usage: %s -c <carbon> -o <oxygen> -h <hydrogen> "
-                    "[-t <timeout>] -T <tcp_port> -U <udp_port> \\\n"
-                    "       [-s <uds_stream_path>] [-d <uds_dgram_path>] -f <file path>\n"
-                    " -f <file path>",
-                    argv[0]);
-                exit(EXIT_FAILURE);
+                usage_exit(argv[0]);
         }
     }
 
@@ -602,135 +2788,130 @@ int main(int argc, char *argv[]) {
             "-T <tcp_port> -U <udp_port>.\n"
             "Usage: %s -c <carbon> -o <oxygen> -h <hydrogen> "
             "[-t <timeout>] -T <tcp_port> -U <udp_port> \\\n"
-            "       [-s <uds_stream_path>] [-d <uds_dgram_path>]  -f <file path>\n",
+            "       [-s <uds_stream_path>] [-d <uds_dgram_path>]  -f <file path> [--workers <N>]\n",
             argv[0]);
         exit(EXIT_FAILURE);
     }
+    if (num_workers < 1 || num_workers > MAX_WORKERS) {
+        fprintf(stderr, "ERROR: --workers must be between 1 and %d\n", MAX_WORKERS);
+        exit(EXIT_FAILURE);
+    }
+    if (metrics_port < 0 || metrics_port > 65535) {
+        fprintf(stderr, "ERROR: --metrics-port must be between 1 and 65535\n");
+        exit(EXIT_FAILURE);
+    }
+    if (out_high_water < 1) {
+        fprintf(stderr, "ERROR: --out-high-water must be at least 1\n");
+        exit(EXIT_FAILURE);
+    }
+    if (dgram_batch < 1 || dgram_batch > MAX_DGRAM_BATCH) {
+        fprintf(stderr, "ERROR: --dgram-batch must be between 1 and %d\n", MAX_DGRAM_BATCH);
+        exit(EXIT_FAILURE);
+    }
+    if ((use_wal || use_mmap || use_save_thread) && !save_file_path) {
+        fprintf(stderr, "ERROR: --wal / --mmap / --save-thread need -f <file path>\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((int)use_wal + (int)use_mmap + (int)use_save_thread > 1) {
+        fprintf(stderr, "ERROR: --wal, --mmap and --save-thread cannot be combined\n");
+        exit(EXIT_FAILURE);
+    }
+    if (ack_fsync && !use_save_thread) {
+        fprintf(stderr, "ERROR: --ack fsync needs --save-thread\n");
+        exit(EXIT_FAILURE);
+    }
+    if (max_warehouses > WAREHOUSES_MAX) {
+        fprintf(stderr, "ERROR: --warehouses must be at most %u\n", WAREHOUSES_MAX);
+        exit(EXIT_FAILURE);
+    }
+    if (max_warehouses > 0 && (use_wal || use_mmap)) {
+        fprintf(stderr, "ERROR: --warehouses cannot be combined with --wal or --mmap\n");
+        exit(EXIT_FAILURE);
+    }
+    if (recipes_path && recipes_load(recipes_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    warehouses_init(max_warehouses);
+    if (save_file_path) {
+        persist_mode = use_wal ? PERSIST_WAL : use_mmap ? PERSIST_MMAP :
+                       use_save_thread ? PERSIST_THREAD : PERSIST_REWRITE;
+    }
 
     // if we did use the f flag
-    if (save_file_path) {
+    if (persist_mode == PERSIST_MMAP) {
+        AtomStock initial = {{ init_carbon, init_oxygen, init_hydrogen }};
+        inventory = shared_inventory_open(save_file_path, &initial, msync_ms);
+    }
+    else if (save_file_path) {
+        // Plain -f: one process per file, or their rewrites would undo each
+        // other's updates (--wal and --save-thread lock it themselves)
+        if (persist_mode == PERSIST_REWRITE) snapshot_lock(save_file_path);
         load_atoms_from_file(save_file_path, init_carbon, init_oxygen, init_hydrogen);
+        if (persist_mode == PERSIST_WAL) {
+            // The snapshot is only the starting point: replay <file>.wal on top
+            AtomStock stock;
+            inventory_read(inventory, &stock);
+            wal_open(save_file_path, &wal_cfg, &stock);
+            inventory_store(inventory, &stock);
+        } else if (persist_mode == PERSIST_THREAD) {
+            saver_open(save_file_path, save_inventories_durably);
+        }
     }
     else {
         // אם אין -f, מאתחלים inv לערכי ברירת המחדל
-        atom_stock.carbon         = init_carbon;
-        atom_stock.oxygen         = init_oxygen;
-        atom_stock.hydrogen       = init_hydrogen;
-    }
-
-    // 3) If timeout_secs > 0, install SIGALRM handler and call alarm(timeout_secs)
-    if (timeout_secs > 0) {
-        struct sigaction sa_alrm;
-        memset(&sa_alrm, 0, sizeof(sa_alrm));
-        sa_alrm.sa_handler = alarm_handler;
-        sigemptyset(&sa_alrm.sa_mask);
-        sa_alrm.sa_flags = 0;  // not using SA_RESTART
-        if (sigaction(SIGALRM, &sa_alrm, NULL) == -1) {
-            perror("sigaction(SIGALRM)");
-            exit(EXIT_FAILURE);
-        }
-        alarm(timeout_secs);
+        AtomStock initial = {{ init_carbon, init_oxygen, init_hydrogen }};
+        inventory_init(inventory, &initial);
+    }
+
+    // Allow as many simultaneous clients as the hard descriptor limit permits
+    conn_table_size = raise_fd_limit();
+    conn_table = calloc(conn_table_size, sizeof(*conn_table));
+    if (!conn_table) {
+        perror("calloc (conn_table)");
+        exit(EXIT_FAILURE);
     }
 
+    // 3) -t is an idle timer in worker 0's event loop; it starts counting now
+    last_activity_ms = timer_now_ms();
+
     // Convert ports to strings for getaddrinfo
     char tcp_port_str[6], udp_port_str[6];
     snprintf(tcp_port_str, sizeof(tcp_port_str), "%d", tcp_port);
     snprintf(udp_port_str, sizeof(udp_port_str), "%d", udp_port);
 
     // ----------------------------------------------------------------------------
-    // 4) Create TCP listening socket on tcp_port
+    // 4) Create TCP listening socket and 5) UDP socket on tcp_port / udp_port,
+    //    one pair per worker. With more than one worker they are SO_REUSEPORT
+    //    shards of the same ports.
     // ----------------------------------------------------------------------------
-    int tcp_listen_fd;
-    {
-        struct addrinfo hints_tcp;
-        struct addrinfo *servinfo_tcp, *p_tcp;
-        memset(&hints_tcp, 0, sizeof(hints_tcp));
-        hints_tcp.ai_family   = AF_INET;      // IPv4 only (for simplicity)
-        hints_tcp.ai_socktype = SOCK_STREAM;  // TCP
-        hints_tcp.ai_flags    = AI_PASSIVE;   // use local IP
-
-        int rv;
-        if ((rv = getaddrinfo(NULL, tcp_port_str, &hints_tcp, &servinfo_tcp)) != 0) {
-            fprintf(stderr, "getaddrinfo (TCP): %s\n", gai_strerror(rv));
-            exit(EXIT_FAILURE);
-        }
-
-        int yes = 1;
-        for (p_tcp = servinfo_tcp; p_tcp != NULL; p_tcp = p_tcp->ai_next) {
-            tcp_listen_fd = socket(p_tcp->ai_family, p_tcp->ai_socktype, p_tcp->ai_protocol);
-            if (tcp_listen_fd < 0) {
-                perror("socket (TCP)");
-                continue;
-            }
-            if (setsockopt(tcp_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
-                perror("setsockopt (TCP)");
-                close(tcp_listen_fd);
-                exit(EXIT_FAILURE);
-            }
-            if (bind(tcp_listen_fd, p_tcp->ai_addr, p_tcp->ai_addrlen) < 0) {
-                perror("bind (TCP)");
-                close(tcp_listen_fd);
-                continue;
-            }
-            // Bound successfully
-            break;
-        }
-        if (p_tcp == NULL) {
-            fprintf(stderr, "Error: failed to bind TCP on port %s\n", tcp_port_str);
-            exit(EXIT_FAILURE);
-        }
-        freeaddrinfo(servinfo_tcp);
-
-        if (listen(tcp_listen_fd, BACKLOG) < 0) {
-            perror("listen (TCP)");
-            exit(EXIT_FAILURE);
-        }
-        printf("server (TCP): listening on port %s...\n", tcp_port_str);
-
+    Worker workers[MAX_WORKERS];
+    bool reuseport = (num_workers > 1);
+    stats_init((unsigned)num_workers);
+    for (int i = 0; i < num_workers; i++) {
+        memset(&workers[i], 0, sizeof(Worker));
+        workers[i].stats         = stats_shard((unsigned)i);
+        workers[i].id            = i;
+        workers[i].epfd          = -1;
+        workers[i].tcp_listen_fd = create_tcp_listener(tcp_port_str, reuseport);
+        workers[i].udp_fd        = create_udp_socket(udp_port_str, reuseport);
+        workers[i].uds_stream_fd = -1;
+        workers[i].uds_dgram_fd  = -1;
+        workers[i].console       = (i == 0);
     }
-
-    // ----------------------------------------------------------------------------
-    // 5) Create UDP socket on udp_port
-    // ----------------------------------------------------------------------------
-    int udp_fd;
-    {
-        struct addrinfo hints_udp;
-        struct addrinfo *servinfo_udp, *p_udp;
-        memset(&hints_udp, 0, sizeof(hints_udp));
-        hints_udp.ai_family   = AF_INET;      // IPv4 only
-        hints_udp.ai_socktype = SOCK_DGRAM;   // UDP
-        hints_udp.ai_flags    = AI_PASSIVE;   // use local IP
-
-        int rv2;
-        if ((rv2 = getaddrinfo(NULL, udp_port_str, &hints_udp, &servinfo_udp)) != 0) {
-            fprintf(stderr, "getaddrinfo (UDP): %s\n", gai_strerror(rv2));
-            exit(EXIT_FAILURE);
-        }
-        for (p_udp = servinfo_udp; p_udp != NULL; p_udp = p_udp->ai_next) {
-            udp_fd = socket(p_udp->ai_family, p_udp->ai_socktype, p_udp->ai_protocol);
-            if (udp_fd < 0) {
-                perror("socket (UDP)");
-                continue;
-            }
-            if (bind(udp_fd, p_udp->ai_addr, p_udp->ai_addrlen) < 0) {
-                perror("bind (UDP)");
-                close(udp_fd);
-                continue;
-            }
-            // Bound successfully
-            break;
-        }
-        if (p_udp == NULL) {
-            fprintf(stderr, "Error: failed to bind UDP on port %s\n", udp_port_str);
-            exit(EXIT_FAILURE);
-        }
-        freeaddrinfo(servinfo_udp);
-
-        printf("server (UDP): listening on port %s...\n", udp_port_str);
+    printf("server (TCP): listening on port %s...\n", tcp_port_str);
+    printf("server (UDP): listening on port %s...\n", udp_port_str);
+    if (num_workers > 1) {
+        printf("server: %d worker threads (SO_REUSEPORT)\n", num_workers);
+    }
+    if (metrics_port > 0) {
+        char metrics_port_str[6];
+        snprintf(metrics_port_str, sizeof(metrics_port_str), "%d", metrics_port);
+        stats_http_start(metrics_port_str);
+        printf("server (metrics): listening on port %s (GET /metrics)\n", metrics_port_str);
     }
 
     // ----------------------------------------------------------------------------
-    // 6) create UDS‐STREAM socket "-s"
+    // 6) create UDS‐STREAM socket "-s" (served by worker 0)
     // ----------------------------------------------------------------------------
     int uds_stream_fd = -1;
     if (uds_stream_path) {
@@ -762,9 +2943,10 @@ int main(int argc, char *argv[]) {
         }
         printf("server (UDS_STREAM): listening on path %s\n", uds_stream_path);
     }
+    workers[0].uds_stream_fd = uds_stream_fd;
 
     // ----------------------------------------------------------------------------
-    // 7) create UDS‐DGRAM socket "-d"
+    // 7) create UDS‐DGRAM socket "-d" (served by worker 0)
     // ----------------------------------------------------------------------------
     int uds_dgram_fd = -1;
     if (uds_dgram_path) {
@@ -790,13 +2972,40 @@ int main(int argc, char *argv[]) {
         }
         printf("server (UDS_DGRAM): bound on path %s\n", uds_dgram_path);
     }
+    workers[0].uds_dgram_fd = uds_dgram_fd;
 
     // ----------------------------------------------------------------------------
-    // 8) Initialize an array of active TCP client fds
+    // 8) Register every worker's sockets with its own epoll instance.
+    //    shutdown_fd is how worker 0 stops the others at the end.
+    //    With --io-uring each worker gets a ring instead, as long as the
+    //    kernel supports everything run_uring_loop() needs.
     // ----------------------------------------------------------------------------
-    int client_fds[MAX_CLIENTS];
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        client_fds[i] = -1;  // –1 means “empty slot”
+    if (num_workers > 1) {
+        shutdown_fd = eventfd(0, EFD_NONBLOCK);
+        if (shutdown_fd < 0) {
+            perror("eventfd");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (use_io_uring) {
+        const char *why = uring_probe();
+        if (why) {
+            fprintf(stderr, "io_uring unavailable (%s), using epoll\n", why);
+            use_io_uring = false;
+        }
+    }
+    bool console_pollable = true;
+    for (int i = 0; i < num_workers; i++) {
+        if (use_io_uring && worker_init_uring(&workers[i])) {
+            if (workers[i].console && !stdin_pollable()) {
+                console_pollable = false;
+            }
+        } else if (!worker_init_epoll(&workers[i])) {
+            console_pollable = false;
+        }
+    }
+    if (use_io_uring) {
+        printf("server: io_uring event loop\n");
     }
 
     // ----------------------------------------------------------------------------
@@ -804,327 +3013,76 @@ int main(int argc, char *argv[]) {
     // ----------------------------------------------------------------------------
     printf("\n=== DRINKS_BAR SERVER READY ===\n");
     printf("Valid console commands (type here):\n");
-    printf("  GEN SOFT DRINK\n");
-    printf("  GEN VODKA\n");
-    printf("  GEN CHAMPAGNE\n\n");
+    for (size_t i = 0; i < recipes_count(); i++) {
+        if (recipe_at(i)->kind == RECIPE_BEVERAGE) {
+            printf("  GEN %s\n", recipe_at(i)->name);
+        }
+    }
+    printf("  GEN ALL\n\n");
     printf("Press Ctrl+C to terminate.\n\n");
     print_inventory();
 
     // ----------------------------------------------------------------------------
-    // 10) Enter the main select() loop
+    // 10) Start the logger and workers 1..N-1, then run worker 0 right here.
     // ----------------------------------------------------------------------------
-    while (1) {
-        if (timed_out) {
-            // Timeout triggered ⇒ no activity within the last <timeout_secs> seconds
-            printf("TIMEOUT: no activity for %d seconds. Shutting down.\n", timeout_secs);
-            break;
-        }
-
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        int max_fd = -1;
-
-        // a) Always watch tcp_listen_fd
-        FD_SET(tcp_listen_fd, &read_fds);
-        if (tcp_listen_fd > max_fd) max_fd = tcp_listen_fd;
-
-        // b) Always watch udp_fd
-        FD_SET(udp_fd, &read_fds);
-        if (udp_fd > max_fd) max_fd = udp_fd;
-
-        // c) Watch all active TCP client fds
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (client_fds[i] != -1) {
-                FD_SET(client_fds[i], &read_fds);
-                if (client_fds[i] > max_fd) {
-                    max_fd = client_fds[i];
-                }
-            }
-        }
-
-        // d) Watch keyboard (STDIN_FILENO)
-        FD_SET(STDIN_FILENO, &read_fds);
-        if (STDIN_FILENO > max_fd) max_fd = STDIN_FILENO;
-
-        // e) If UDS_STREAM was created, watch uds_stream_fd
-        if (uds_stream_path) {
-            FD_SET(uds_stream_fd, &read_fds);
-            if (uds_stream_fd > max_fd) max_fd = uds_stream_fd;
-        }
-
-        // f) If UDS_DGRAM was created, watch uds_dgram_fd
-        if (uds_dgram_path) {
-            FD_SET(uds_dgram_fd, &read_fds);
-            if (uds_dgram_fd > max_fd) max_fd = uds_dgram_fd;
-        }
-
-        // Wait until at least one descriptor is ready
-        int ready = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        if (ready < 0) {
-            if (errno == EINTR) {
-                // Interrupted by a signal (likely SIGALRM). Recompute if timed_out.
-                continue;
-            }
-            perror("select");
+    log_summary_ms = log_cfg.summary_ms;
+    log_start(&log_cfg, inventory_summary);
+    for (int i = 1; i < num_workers; i++) {
+        int rc = pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
             exit(EXIT_FAILURE);
         }
+    }
 
-        // -------------------------------------------------------
-        // 10.1 New incoming TCP connection?
-        // If tcp_listen_fd is ready, accept() it and store in client_fds[].
-        // -------------------------------------------------------
-        if (FD_ISSET(tcp_listen_fd, &read_fds)) {
-            struct sockaddr_storage client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-            int new_fd = accept(tcp_listen_fd,
-                                (struct sockaddr*)&client_addr,
-                                &addr_len);
-            if (new_fd < 0) {
-                perror("accept (TCP)");
-            } else {
-                // store new_fd in the first empty slot
-                bool added = false;
-                for (int i = 0; i < MAX_CLIENTS; i++) {
-                    if (client_fds[i] == -1) {
-                        client_fds[i] = new_fd;
-                        added = true;
-                        break;
-                    }
-                }
-                if (!added) {
-                    // too many clients; drop this connection
-                    close(new_fd);
-                } else {
-                    // print the new client's IPv4 address
-                    char ipstr[INET_ADDRSTRLEN];
-                    struct sockaddr_in *sa = (struct sockaddr_in *)&client_addr;
-                    inet_ntop(AF_INET, &sa->sin_addr, ipstr, sizeof(ipstr));
-                    printf("New TCP client from %s\n", ipstr);
-                }
-            }
-            // Reset alarm if using timeout
-            if (timeout_secs > 0) {
-                alarm(timeout_secs);
-                timed_out = 0;
-            }
-        }
-
-        // -------------------------------------------------------
-        // 10.2 Incoming UDP datagram?
-        // If udp_fd is ready, recvfrom() it, parse_and_update_udp(), sendto() the reply.
-        // -------------------------------------------------------
-        if (FD_ISSET(udp_fd, &read_fds)) {
-            char buf[MAXBUF];
-            struct sockaddr_storage client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-            ssize_t numbytes = recvfrom(
-                udp_fd,
-                buf, sizeof(buf)-1,
-                0,
-                (struct sockaddr*)&client_addr,
-                &addr_len
-            );
-            if (numbytes < 0) {
-                perror("recvfrom (UDP)");
-            } else {
-                buf[numbytes] = '\0';
-                char response[MAXBUF];
-                parse_and_update_udp(buf, response, sizeof(response));
-                // reply to exactly that client address:
-                if (sendto(
-                        udp_fd,
-                        response, strlen(response),
-                        0,
-                        (struct sockaddr*)&client_addr,
-                        addr_len
-                    ) < 0)
-                {
-                    perror("sendto (UDP)");
-                }
-            }
-            if (timeout_secs > 0) {
-                alarm(timeout_secs);
-                timed_out = 0;
-            }
-        }
-
-        // -------------------------------------------------------
-        // 10.3 Check each active TCP client descriptor: 
-        // if ready, call handle_tcp_client(); if it returns false, close & remove.
-        // -------------------------------------------------------
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            int fd = client_fds[i];
-            if (fd != -1 && FD_ISSET(fd, &read_fds)) {
-                if (!handle_tcp_client(fd)) {
-                    close(fd);
-                    client_fds[i] = -1;
-                }
-                // Reset alarm if using timeout
-                if (timeout_secs > 0) {
-                    alarm(timeout_secs);
-                    timed_out = 0;
-                }
-            }
-        }
-
-        // -------------------------------------------------------
-        // 10.4 Console keyboard input (STDIN_FILENO)?
-        // If ready, read one line, interpret “GEN …” commands.
-        // -------------------------------------------------------
-        if (FD_ISSET(STDIN_FILENO, &read_fds)) {
-            if (save_file_path) {
-                load_atoms_from_file(save_file_path, 0, 0, 0);
-            }
-            char linebuf[MAXBUF];
-            if (fgets(linebuf, sizeof(linebuf), stdin) != NULL) {
-                // strip trailing newline
-                size_t L = strlen(linebuf);
-                if (L > 0 && linebuf[L-1] == '\n') {
-                    linebuf[L-1] = '\0';
-                }
-                // Expect “GEN <BEVERAGE>”
-                char *cmd = strtok(linebuf, " \t");
-                if (!cmd || strcmp(cmd, "GEN") != 0) {
-                    printf("ERROR: invalid console command\n");
-                } else {
-                    char *drink = strtok(NULL, " \t");
-                    if (!drink) {
-                        printf("ERROR: missing drink type after GEN\n");
-                    }
-                    else if (strcmp(drink, "SOFT") == 0) {
-                        char *maybe_drink = strtok(NULL, " \t");
-                        if (!maybe_drink || strcmp(maybe_drink, "DRINK") != 0) {
-                            printf("ERROR: did you mean 'GEN SOFT DRINK'?\n");
-                        } else {
-                            // Soft drink requires 6 C, 14 H, 9 O
-                            uint64_t c = atom_stock.carbon / 6;
-                            uint64_t h = atom_stock.hydrogen / 14;
-                            uint64_t o = atom_stock.oxygen / 9;
-                            uint64_t can_make = c;
-                            if (h < can_make) can_make = h;
-                            if (o < can_make) can_make = o;
-                            printf("You can make up to %llu SOFT DRINK(s)\n",
-                                   (unsigned long long)can_make);
-                        }
-                    }
-                    else if (strcmp(drink, "VODKA") == 0) {
-                        // Vodka requires 8 C, 20 H, 8 O
-                        uint64_t c = atom_stock.carbon / 8;
-                        uint64_t h = atom_stock.hydrogen / 20;
-                        uint64_t o = atom_stock.oxygen / 8;
-                        uint64_t can_make = c;
-                        if (h < can_make) can_make = h;
-                        if (o < can_make) can_make = o;
-                        printf("You can make up to %llu VODKA(s)\n",
-                               (unsigned long long)can_make);
-                    }
-                    else if (strcmp(drink, "CHAMPAGNE") == 0) {
-                        // Champagne requires 3 C, 9 H, 4 O
-                        uint64_t c = atom_stock.carbon / 3;
-                        uint64_t h = atom_stock.hydrogen / 9;
-                        uint64_t o = atom_stock.oxygen / 4;
-                        uint64_t can_make = c;
-                        if (h < can_make) can_make = h;
-                        if (o < can_make) can_make = o;
-                        printf("You can make up to %llu CHAMPAGNE(s)\n",
-                               (unsigned long long)can_make);
-                    }
-                    else {
-                        printf("ERROR: unknown drink type '%s'\n", drink);
-                    }
-                }
-            } else {
-                // EOF (Ctrl+D) or error reading stdin ⇒ exit loop
-                printf("Console closed or error – exiting.\n");
-                break;
-            }
-            if (timeout_secs > 0) {
-                alarm(timeout_secs);
-                timed_out = 0;
-            }
-        }
-
-        // -------------------------------------------------------
-        // 10.5 Accept a new UDS_STREAM connection (if that socket exists)
-        // Once accepted, handle exactly one “ADD …” on that connection and close.
-        // -------------------------------------------------------
-        if (uds_stream_path && uds_stream_fd >= 0 && FD_ISSET(uds_stream_fd, &read_fds)) {
-            int new_un_fd = accept(uds_stream_fd, NULL, NULL);
-            if (new_un_fd < 0) {
-                perror("accept (UDS_STREAM)");
-            } else {
-                if (save_file_path) {
-                    load_atoms_from_file(save_file_path, 0,0,0);
-                }
-                // Use the same TCP‐handler for “ADD …” lines
-                if (!handle_tcp_client(new_un_fd)) {
-                    // either closed immediately or error
-                }
-                close(new_un_fd);
-            }
-            if (timeout_secs > 0) {
-                alarm(timeout_secs);
-                timed_out = 0;
-            }
+    if (!console_pollable) {
+        while (handle_console_input()) {
+            // run every command in the file
         }
+        printf("Console closed or error – exiting.\n");
+    } else if (workers[0].uring) {
+        run_uring_loop(&workers[0]);
+    } else {
+        run_event_loop(&workers[0]);
+    }
 
-        // -------------------------------------------------------
-        // 10.6 Receive one UDS_DGRAM datagram “DELIVER …” (if that socket exists)
-        // Parse & respond to that client’s address over UDS datagram.
-        // -------------------------------------------------------
-        if (uds_dgram_path && uds_dgram_fd >= 0 && FD_ISSET(uds_dgram_fd, &read_fds)) {
-            char buf[MAXBUF];
-            struct sockaddr_un cli_un;
-            socklen_t cli_len = sizeof(cli_un);
-            ssize_t nbytes = recvfrom(
-                uds_dgram_fd,
-                buf, sizeof(buf)-1,
-                0,
-                (struct sockaddr*)&cli_un,
-                &cli_len
-            );
-            if (nbytes < 0) {
-                perror("recvfrom (UDS_DGRAM)");
-            } else {
-                buf[nbytes] = '\0';
-                if (save_file_path) {
-                    load_atoms_from_file(save_file_path, 0,0,0);
-                }
-                char response[MAXBUF];
-                parse_and_update_udp(buf, response, sizeof(response));
-                if (save_file_path) {
-                    save_atoms_to_file(save_file_path);
-                }
-                if (sendto(
-                        uds_dgram_fd,
-                        response, strlen(response),
-                        0,
-                        (struct sockaddr*)&cli_un,
-                        cli_len
-                    ) < 0)
-                {
-                    perror("sendto (UDS_DGRAM)");
-                }
-            }
-            if (timeout_secs > 0) {
-                alarm(timeout_secs);
-                timed_out = 0;
-            }
+    // Wake every other worker and wait for it to leave its loop
+    if (shutdown_fd >= 0) {
+        uint64_t one = 1;
+        if (write(shutdown_fd, &one, sizeof(one)) < 0) {
+            perror("write (shutdown)");
         }
-
-    } // end of main select‐loop
+    }
+    for (int i = 1; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
 
     // ----------------------------------------------------------------------------
     // 11) Clean up: close sockets and unlink any UDS files
     // ----------------------------------------------------------------------------
-    if (tcp_listen_fd >= 0) close(tcp_listen_fd);
-    if (udp_fd >= 0)        close(udp_fd);
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i].uring) worker_free_uring(&workers[i]);   // worker 0 never ran (console file)
+        if (workers[i].epfd >= 0) close(workers[i].epfd);
+        close(workers[i].tcp_listen_fd);
+        close(workers[i].udp_fd);
+    }
+    free(conn_table);          // every worker has closed its own connections
+    if (shutdown_fd >= 0)   close(shutdown_fd);
     if (uds_stream_fd >= 0) close(uds_stream_fd);
     if (uds_dgram_fd >= 0)  close(uds_dgram_fd);
 
     if (uds_stream_path)   unlink(uds_stream_path);
     if (uds_dgram_path)    unlink(uds_dgram_path);
 
+    // Every worker is gone: drain the console log, flush the WAL and fold it
+    // into the snapshot (or write the last state with --save-thread)
+    log_stop();
+    stats_free();
+    if (persist_mode == PERSIST_WAL) wal_close();
+    if (persist_mode == PERSIST_THREAD) saver_close();
+    if (persist_mode == PERSIST_MMAP) shared_inventory_close();
+    warehouses_free();
+
     printf("Server exiting cleanly.\n");
     return 0;
 }
@@ -0,0 +1,73 @@
+/*
+** histogram.c -- log-linear latency histogram (see histogram.h)
+*/
+
+#include "histogram.h"
+
+#include <string.h>          // memset
+
+void histogram_init(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+// ----------------------------------------------------------------------------
+// Bucket of `v`: below HIST_SUB the value itself. Otherwise shift v right
+// until it lies in [HIST_HALF, HIST_SUB); the shift selects the power of two,
+// the remaining bits the bucket inside it.
+// ----------------------------------------------------------------------------
+unsigned histogram_bucket(uint64_t v) {
+    if (v < HIST_SUB) return (unsigned)v;
+    unsigned msb   = 63u - (unsigned)__builtin_clzll(v);
+    unsigned shift = msb - (HIST_SUB_BITS - 1);
+    return HIST_SUB + (shift - 1) * HIST_HALF + (unsigned)((v >> shift) - HIST_HALF);
+}
+
+// Largest value that falls into bucket `b`
+static uint64_t bucket_high(unsigned b) {
+    if (b < HIST_SUB) return b;
+    unsigned k     = b - HIST_SUB;
+    unsigned shift = k / HIST_HALF + 1;
+    uint64_t sub   = k % HIST_HALF + HIST_HALF;
+    return (sub << shift) + ((1ull << shift) - 1);
+}
+
+void histogram_record(Histogram *h, uint64_t value) {
+    h->buckets[histogram_bucket(value)]++;
+    h->count++;
+    h->sum += (double)value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        dst->buckets[b] += src->buckets[b];
+    }
+    dst->count += src->count;
+    dst->sum   += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const Histogram *h, double percentile) {
+    if (h->count == 0) return 0;
+    if (percentile >= 100.0) return h->max;
+    // Rank of the wanted value, 1-based, rounded up
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->count);
+    if ((double)rank < percentile / 100.0 * (double)h->count) rank++;
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t v = bucket_high(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+double histogram_mean(const Histogram *h) {
+    return h->count ? h->sum / (double)h->count : 0.0;
+}
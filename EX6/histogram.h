@@ -0,0 +1,49 @@
+/*
+** histogram.h -- log-linear latency histogram (HDR histogram layout)
+**
+** Values below 2^HIST_SUB_BITS are counted exactly; above that every power
+** of two is split into 2^(HIST_SUB_BITS-1) equal buckets, so a recorded
+** value is known to within 1 / 2^(HIST_SUB_BITS-1) (< 1 %) over the whole
+** 64-bit range. Recording is a few shifts and one increment, the counters
+** are a fixed array (no allocation) and histograms of several threads are
+** combined with histogram_merge().
+**
+** The unit is up to the caller (the load generator records nanoseconds).
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>          // uint64_t
+
+#define HIST_SUB_BITS  7
+#define HIST_SUB       (1u << HIST_SUB_BITS)                    // exact values
+#define HIST_HALF      (HIST_SUB / 2)                           // buckets per power of two
+#define HIST_BUCKETS   (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)
+
+typedef struct {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double   sum;                     // for the mean
+    uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+void histogram_init(Histogram *h);
+
+void histogram_record(Histogram *h, uint64_t value);
+
+// Index into h->buckets of `value` (for callers that update them themselves)
+unsigned histogram_bucket(uint64_t value);
+
+// dst += src
+void histogram_merge(Histogram *dst, const Histogram *src);
+
+// Smallest value v such that at least `percentile` % of the recorded values
+// are <= v (reported as the upper end of v's bucket, at most h->max);
+// 0 if nothing was recorded.
+uint64_t histogram_percentile(const Histogram *h, double percentile);
+
+double histogram_mean(const Histogram *h);
+
+#endif // HISTOGRAM_H
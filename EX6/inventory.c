@@ -0,0 +1,418 @@
+/*
+** inventory.c -- seqlock-protected atom inventory (see inventory.h)
+**
+** Writer protocol:
+**   1. s = stable sequence, read the stock under it (like any reader)
+**   2. validate the request and compute the new stock locally
+**   3. CAS owner: 0 -> pid (fails while another writer holds it: retry),
+**      then check seq is still s and store seq = s+1
+**   4. store the new stock, then seq = s+2 and owner = 0 (release)
+** Readers retry while seq is odd or changed during their copy. The owner
+** word is the claim itself, so whenever seq is odd the pid that made it odd
+** is recorded. In a --mmap inventory (inventory_share()), a claim whose
+** owner process no longer exists can then be closed by whoever waits on it
+** (see wait_claim()); a claim is never taken away from a live process.
+*/
+
+#include "inventory.h"
+
+#include <stdbool.h>         // bool, true, false
+#include <stddef.h>          // NULL
+#include <string.h>          // strcmp, memcpy
+#include <stdio.h>           // fprintf
+#include <errno.h>           // errno, ESRCH
+#include <signal.h>          // kill
+#include <time.h>            // clock_gettime
+#include <unistd.h>          // getpid
+
+#include "atoms.h"           // atoms_lanes
+
+#if defined(__x86_64__)
+#include <immintrin.h>       // _mm256_*, _mm_*
+#endif
+
+// Tell the CPU we are spinning (cheaper for the sibling hyper-thread)
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Lane kernels. Each one walks `lanes` lanes (a multiple of ATOM_LANE_GROUP)
+// of two stocks, writes the result into `next` unconditionally and reports
+// whether any lane failed, without a branch per atom type. A failure is
+// rare, so which lane it was is looked up afterwards (first_short()).
+//   take: next = cur - req, fails if any req > cur
+//   add:  next = cur + delta, fails if any sum > MAX_ATOMS (counts are at
+//         most MAX_ATOMS < 2^60, so neither the sum nor a signed compare
+//         can wrap)
+// The unsigned compare of take flips the sign bit of both sides and uses the
+// signed compare: a request lane may be UINT64_MAX (see recipe_scale()).
+// `cur` is the live stock of the inventory: the kernels load it straight
+// into registers (copying it to the stack lane by lane first would stall
+// store forwarding on the wide loads), and update() discards a torn read by
+// its sequence check, like for any seqlock reader.
+// Loads and stores are unaligned, as callers may pass a stock from a plain
+// malloc()ed array; AtomStock's own alignment keeps them off line splits.
+// ----------------------------------------------------------------------------
+typedef bool (*lane_fn)(const AtomStock *cur, const AtomStock *arg, AtomStock *next, unsigned lanes);
+
+static bool take_scalar(const AtomStock *cur, const AtomStock *req, AtomStock *next, unsigned lanes) {
+    uint64_t short_any = 0;
+    for (unsigned i = 0; i < lanes; i++) {
+        uint64_t c = __atomic_load_n(&cur->count[i], __ATOMIC_RELAXED);
+        short_any |= c < req->count[i];
+        next->count[i] = c - req->count[i];
+    }
+    return short_any == 0;
+}
+
+static bool add_scalar(const AtomStock *cur, const AtomStock *delta, AtomStock *next, unsigned lanes) {
+    uint64_t over_any = 0;
+    for (unsigned i = 0; i < lanes; i++) {
+        next->count[i] = __atomic_load_n(&cur->count[i], __ATOMIC_RELAXED) + delta->count[i];
+        over_any |= next->count[i] > MAX_ATOMS;
+    }
+    return over_any == 0;
+}
+
+// Copy kernels: the `lanes` lanes of `src` into `dst`, at the kernel's own
+// width. Either side may be the live stock: publishing with whole vector
+// stores lets the next wide load of the stock be forwarded instead of
+// stalling on eight-byte stores, and a torn copy is discarded by the
+// sequence check like any other seqlock read.
+typedef void (*store_fn)(AtomStock *dst, const AtomStock *src, unsigned lanes);
+
+static void store_scalar(AtomStock *dst, const AtomStock *src, unsigned lanes) {
+    for (unsigned i = 0; i < lanes; i++) {
+        __atomic_store_n(&dst->count[i], __atomic_load_n(&src->count[i], __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static bool take_avx2(const AtomStock *cur, const AtomStock *req, AtomStock *next, unsigned lanes) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i short_any  = _mm256_setzero_si256();
+    for (unsigned i = 0; i < lanes; i += 4) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)&cur->count[i]);
+        __m256i r = _mm256_loadu_si256((const __m256i *)&req->count[i]);
+        short_any = _mm256_or_si256(short_any,
+                        _mm256_cmpgt_epi64(_mm256_xor_si256(r, sign), _mm256_xor_si256(c, sign)));
+        _mm256_storeu_si256((__m256i *)&next->count[i], _mm256_sub_epi64(c, r));
+    }
+    return _mm256_testz_si256(short_any, short_any);
+}
+
+__attribute__((target("avx2")))
+static bool add_avx2(const AtomStock *cur, const AtomStock *delta, AtomStock *next, unsigned lanes) {
+    const __m256i max = _mm256_set1_epi64x((long long)MAX_ATOMS);
+    __m256i over_any  = _mm256_setzero_si256();
+    for (unsigned i = 0; i < lanes; i += 4) {
+        __m256i sum = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)&cur->count[i]),
+                                       _mm256_loadu_si256((const __m256i *)&delta->count[i]));
+        over_any = _mm256_or_si256(over_any, _mm256_cmpgt_epi64(sum, max));
+        _mm256_storeu_si256((__m256i *)&next->count[i], sum);
+    }
+    return _mm256_testz_si256(over_any, over_any);
+}
+
+__attribute__((target("avx2")))
+static void store_avx2(AtomStock *dst, const AtomStock *src, unsigned lanes) {
+    for (unsigned i = 0; i < lanes; i += 4) {
+        _mm256_storeu_si256((__m256i *)&dst->count[i],
+                            _mm256_loadu_si256((const __m256i *)&src->count[i]));
+    }
+}
+
+// SSE4.2 brings the 64-bit compare (pcmpgtq); two lanes per instruction
+__attribute__((target("sse4.2")))
+static bool take_sse42(const AtomStock *cur, const AtomStock *req, AtomStock *next, unsigned lanes) {
+    const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    __m128i short_any  = _mm_setzero_si128();
+    for (unsigned i = 0; i < lanes; i += 2) {
+        __m128i c = _mm_loadu_si128((const __m128i *)&cur->count[i]);
+        __m128i r = _mm_loadu_si128((const __m128i *)&req->count[i]);
+        short_any = _mm_or_si128(short_any,
+                        _mm_cmpgt_epi64(_mm_xor_si128(r, sign), _mm_xor_si128(c, sign)));
+        _mm_storeu_si128((__m128i *)&next->count[i], _mm_sub_epi64(c, r));
+    }
+    return _mm_testz_si128(short_any, short_any);
+}
+
+__attribute__((target("sse4.2")))
+static bool add_sse42(const AtomStock *cur, const AtomStock *delta, AtomStock *next, unsigned lanes) {
+    const __m128i max = _mm_set1_epi64x((long long)MAX_ATOMS);
+    __m128i over_any  = _mm_setzero_si128();
+    for (unsigned i = 0; i < lanes; i += 2) {
+        __m128i sum = _mm_add_epi64(_mm_loadu_si128((const __m128i *)&cur->count[i]),
+                                    _mm_loadu_si128((const __m128i *)&delta->count[i]));
+        over_any = _mm_or_si128(over_any, _mm_cmpgt_epi64(sum, max));
+        _mm_storeu_si128((__m128i *)&next->count[i], sum);
+    }
+    return _mm_testz_si128(over_any, over_any);
+}
+
+__attribute__((target("sse4.2")))
+static void store_sse42(AtomStock *dst, const AtomStock *src, unsigned lanes) {
+    for (unsigned i = 0; i < lanes; i += 2) {
+        _mm_storeu_si128((__m128i *)&dst->count[i],
+                         _mm_loadu_si128((const __m128i *)&src->count[i]));
+    }
+}
+#endif
+
+static const struct {
+    const char *name;
+    lane_fn     take;
+    lane_fn     add;
+    store_fn    store;
+} kernels[] = {
+#if defined(__x86_64__)
+    { "avx2",   take_avx2,   add_avx2,   store_avx2   },
+    { "sse4.2", take_sse42,  add_sse42,  store_sse42  },
+#endif
+    { "scalar", take_scalar, add_scalar, store_scalar },
+};
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static unsigned kernel = NUM_KERNELS - 1;    // index into kernels[]
+static uint32_t self_pid;                    // the claim in Inventory.owner
+
+static bool cpu_has(const char *name) {
+#if defined(__x86_64__)
+    if (strcmp(name, "avx2") == 0)   return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse4.2") == 0) return __builtin_cpu_supports("sse4.2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+// The widest kernel this CPU runs. Picked before main(), so the request path
+// pays no once-check for it.
+__attribute__((constructor))
+static void kernel_init(void) {
+    unsigned k = 0;
+    while (!cpu_has(kernels[k].name)) k++;
+    kernel   = k;
+    self_pid = (uint32_t)getpid();
+}
+
+const char *inventory_kernel(void) {
+    return kernels[kernel].name;
+}
+
+bool inventory_use_kernel(const char *name) {
+    for (unsigned k = 0; k < NUM_KERNELS; k++) {
+        if (strcmp(kernels[k].name, name) == 0 && cpu_has(name)) {
+            kernel = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline void copy_lanes(AtomStock *dst, const AtomStock *src, unsigned lanes) {
+    memcpy(dst->count, src->count, lanes * sizeof(src->count[0]));
+}
+
+// The lowest atom id `req` asks more of than `cur` holds (cold path)
+static InvResult first_short(const AtomStock *cur, const AtomStock *req, unsigned lanes) {
+    unsigned i = 0;
+    while (i < lanes && cur->count[i] >= req->count[i]) i++;
+    return (InvResult)(INV_NOT_ENOUGH_CARBON + i);
+}
+
+// ----------------------------------------------------------------------------
+// wait_claim(): called while seq is `s` and a writer holds `owner` (always
+// the case while seq is odd). Returns once either changes. A publish takes
+// nanoseconds, so a claim that stays for STUCK_NS has either a writer that
+// is descheduled or stopped (keep waiting) or, in a --mmap inventory, one
+// whose process died in the middle of the publish. Only the latter is
+// repaired: the waiter takes the dead claim over with a CAS on `owner`,
+// closes an odd seq (s+1) and releases it; the stock keeps whatever the
+// dead writer stored, as with the startup repair of a mapped file
+// (shared_inventory.c). Threads of one process share a pid, so a claim of
+// our own process is always alive.
+// ----------------------------------------------------------------------------
+#define STUCK_SPINS 4096                 // cpu_relax() rounds between clock reads
+#define STUCK_NS    100000000LL          // 100 ms
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool claim_held(const Inventory *inv, uint64_t s) {
+    return __atomic_load_n(&inv->seq, __ATOMIC_ACQUIRE) == s &&
+           __atomic_load_n(&inv->owner, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void wait_claim(const Inventory *inv, uint64_t s) {
+    int64_t since = 0;
+    for (;;) {
+        for (unsigned i = 0; i < STUCK_SPINS; i++) {
+            if (!claim_held(inv, s)) return;
+            cpu_relax();
+        }
+        int64_t now = now_ns();
+        if (since == 0) {
+            since = now;
+            continue;
+        }
+        if (now - since < STUCK_NS) continue;
+        since = now;
+        if (!__atomic_load_n(&inv->shared, __ATOMIC_RELAXED)) continue;
+
+        uint32_t owner = __atomic_load_n(&inv->owner, __ATOMIC_RELAXED);
+        if (owner == 0) return;
+        if (owner == self_pid || kill((pid_t)owner, 0) == 0 || errno != ESRCH) {
+            continue;             // alive: it will finish
+        }
+        // The inventory is writable memory; only the read-side API is const
+        Inventory *w = (Inventory *)inv;
+        uint32_t expected = owner;
+        if (!__atomic_compare_exchange_n(&w->owner, &expected, self_pid, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;               // released, or repaired by another waiter
+        }
+        uint64_t seq = __atomic_load_n(&w->seq, __ATOMIC_RELAXED);
+        if (seq & 1) __atomic_store_n(&w->seq, seq + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&w->owner, 0, __ATOMIC_RELEASE);
+        fprintf(stderr, "Warning: repaired an update interrupted by process %u\n", owner);
+        return;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// read_stable(): seqlock read side. Returns the (even) sequence number the
+// snapshot in `out` belongs to. Only the `lanes` lanes in use are copied.
+// ----------------------------------------------------------------------------
+static uint64_t read_stable(const Inventory *inv, AtomStock *out, unsigned lanes) {
+    for (;;) {
+        uint64_t s1 = __atomic_load_n(&inv->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            wait_claim(inv, s1);
+            continue;
+        }
+        for (unsigned i = 0; i < lanes; i++) {
+            out->count[i] = __atomic_load_n(&inv->stock.count[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&inv->seq, __ATOMIC_RELAXED) == s1) {
+            return s1;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// try_publish(): claim the inventory at sequence `s` (must still be current)
+// and write `next`. Returns false if another writer holds the claim or got
+// there first; after a held claim the caller waits with wait_claim().
+// ----------------------------------------------------------------------------
+static bool try_publish(Inventory *inv, uint64_t s, const AtomStock *next, unsigned lanes) {
+    uint32_t none = 0;
+    if (!__atomic_compare_exchange_n(&inv->owner, &none, self_pid, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    if (__atomic_load_n(&inv->seq, __ATOMIC_RELAXED) != s) {
+        __atomic_store_n(&inv->owner, 0, __ATOMIC_RELEASE);
+        return false;
+    }
+    __atomic_store_n(&inv->seq, s + 1, __ATOMIC_RELAXED);
+    // seq is odd from here on: keep the stock stores after it
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    kernels[kernel].store(&inv->stock, next, lanes);
+    __atomic_store_n(&inv->seq, s + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&inv->owner, 0, __ATOMIC_RELEASE);
+    return true;
+}
+
+// A writer that lost try_publish(): wait while the claim at `s` is held
+static void wait_publish(const Inventory *inv, uint64_t s) {
+    if (claim_held(inv, s)) wait_claim(inv, s);
+    else cpu_relax();
+}
+
+void inventory_init(Inventory *inv, const AtomStock *initial) {
+    inv->seq    = 0;
+    inv->owner  = 0;
+    inv->shared = 0;
+    inv->stock  = *initial;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void inventory_share(Inventory *inv) {
+    __atomic_store_n(&inv->shared, 1, __ATOMIC_RELEASE);
+}
+
+void inventory_store(Inventory *inv, const AtomStock *stock) {
+    unsigned lanes = atoms_lanes();
+    AtomStock cur;
+    for (;;) {
+        uint64_t s = read_stable(inv, &cur, lanes);
+        if (try_publish(inv, s, stock, lanes)) return;
+        wait_publish(inv, s);
+    }
+}
+
+uint64_t inventory_read(const Inventory *inv, AtomStock *out) {
+    return read_stable(inv, out, atoms_lanes());
+}
+
+// ----------------------------------------------------------------------------
+// update(): the writer protocol around one kernel. Returns true once `fn`'s
+// result is published. A failed check only counts if the sequence held over
+// it (a torn read can fail spuriously); the stock it failed on is then
+// returned in `failed` with false.
+// ----------------------------------------------------------------------------
+static bool update(Inventory *inv, lane_fn fn, const AtomStock *arg, unsigned lanes,
+                   AtomStock *after, uint64_t *version, AtomStock *failed) {
+    AtomStock next;
+    for (;;) {
+        uint64_t s = __atomic_load_n(&inv->seq, __ATOMIC_ACQUIRE);
+        if (s & 1) {
+            wait_claim(inv, s);
+            continue;
+        }
+        bool ok = fn(&inv->stock, arg, &next, lanes);
+        if (!ok) {
+            // Keep the stock the check failed on; the sequence check below
+            // covers this copy too
+            kernels[kernel].store(failed, &inv->stock, lanes);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&inv->seq, __ATOMIC_RELAXED) != s) {
+            cpu_relax();
+            continue;
+        }
+        if (!ok) return false;
+        if (try_publish(inv, s, &next, lanes)) {
+            if (after)   copy_lanes(after, &next, lanes);
+            if (version) *version = s + 2;
+            return true;
+        }
+        wait_publish(inv, s);
+    }
+}
+
+InvResult inventory_add(Inventory *inv, const AtomStock *delta,
+                        AtomStock *after, uint64_t *version) {
+    unsigned lanes = atoms_lanes();
+    AtomStock cur;
+    if (update(inv, kernels[kernel].add, delta, lanes, after, version, &cur)) return INV_OK;
+    if (after) copy_lanes(after, &cur, lanes);
+    return INV_CAPACITY_EXCEEDED;
+}
+
+InvResult inventory_take(Inventory *inv, const AtomStock *req,
+                         AtomStock *after, uint64_t *version) {
+    unsigned lanes = atoms_lanes();
+    AtomStock cur;
+    if (update(inv, kernels[kernel].take, req, lanes, after, version, &cur)) return INV_OK;
+    if (after) copy_lanes(after, &cur, lanes);
+    return first_short(&cur, req, lanes);
+}
@@ -0,0 +1,118 @@
+/*
+** inventory.h -- the atom inventory shared by every drinks_bar worker
+**
+** The stock is protected by a sequence counter (seqlock) instead of a mutex:
+**   • readers take a consistent snapshot without writing shared memory
+**   • ADD / DELIVER validate their request against a snapshot first and only
+**     then try to publish the new stock with one CAS on the sequence word,
+**     so a multi-atom DELIVER is applied all-or-nothing and a failed request
+**     (not enough atoms, capacity exceeded) never touches the cache line.
+**
+** Only the first atoms_lanes() lanes of a stock are in use (the configured
+** atom types, see atoms.h): they are copied under the seqlock and checked
+** with one vector compare per four lanes (AVX2, SSE4.2 or scalar, picked at
+** run time), so a request costs the same whichever lane runs short.
+**
+** An Inventory is plain memory (no pointers, no OS handles), so it can also
+** live in a shared mapping.
+*/
+
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // offsetof
+#include <stdint.h>          // uint64_t
+
+#define MAX_ATOMS  ((uint64_t)1000000000000000000ULL)  // 10^18 maximum quantity
+
+// Atom types one AtomStock has room for (see atoms.h for the configured
+// set; --atoms fails past it). Every inventory pays for all of them, so the
+// default is small: build with -DATOM_TYPES_MAX=64 (make ATOM_TYPES_MAX=64)
+// for a larger catalog, or 4 for one-line inventories when only carbon,
+// oxygen and hydrogen are needed.
+#ifndef ATOM_TYPES_MAX
+#define ATOM_TYPES_MAX  16
+#endif
+#define ATOM_LANE_GROUP 4    // uint64_t lanes per 256-bit vector
+
+_Static_assert(ATOM_TYPES_MAX >= ATOM_LANE_GROUP && ATOM_TYPES_MAX % ATOM_LANE_GROUP == 0,
+               "ATOM_TYPES_MAX must be a positive multiple of ATOM_LANE_GROUP");
+
+// The built-in atom ids (equal to WIRE_ATOM_*)
+enum {
+    ATOM_CARBON   = 0,
+    ATOM_OXYGEN   = 1,
+    ATOM_HYDROGEN = 2
+};
+
+// ----------------------------------------------------------------------------
+// Counts of each atom type, indexed by atom id: one contiguous, vector
+// aligned row, so a whole stock is checked and updated lane-parallel.
+// ----------------------------------------------------------------------------
+typedef struct {
+    uint64_t count[ATOM_TYPES_MAX];
+} __attribute__((aligned(32))) AtomStock;
+
+// ----------------------------------------------------------------------------
+// The live inventory: `seq` is even while the stock is stable and odd while a
+// writer is publishing a new one. `owner` is the writer's claim: its pid,
+// taken before `seq` turns odd and cleared after it is even again (0: free).
+// `shared` is set by inventory_share().
+// `seq` comes first, so it shares one cache line with the first four lanes
+// (carbon, oxygen, hydrogen and one more): an update of three or four atom
+// types touches a single line whatever ATOM_TYPES_MAX is. Aligned so no two
+// inventories share a line; 192 bytes by default, 64 with ATOM_TYPES_MAX=4.
+// ----------------------------------------------------------------------------
+typedef struct {
+    uint64_t  seq;
+    uint32_t  owner;
+    uint32_t  shared;
+    AtomStock stock;
+} __attribute__((aligned(64))) Inventory;
+
+_Static_assert(offsetof(Inventory, stock) + ATOM_LANE_GROUP * sizeof(uint64_t) <= 64,
+               "seq and the first lane group must share a cache line");
+
+// Outcome of inventory_add() / inventory_take()
+typedef enum {
+    INV_OK = 0,
+    INV_CAPACITY_EXCEEDED,     // an ADD would push a count above MAX_ATOMS
+    INV_NOT_ENOUGH_CARBON,     // INV_NOT_ENOUGH_CARBON + id: the lowest atom id
+    INV_NOT_ENOUGH_OXYGEN,     // that runs short, like the text protocol
+    INV_NOT_ENOUGH_HYDROGEN
+} InvResult;
+
+// Set the stock without any check (startup, reload from the -f file).
+// inventory_init() copies every lane: the unused ones must be zero.
+void inventory_init(Inventory *inv, const AtomStock *initial);
+void inventory_store(Inventory *inv, const AtomStock *stock);
+
+// Mark `inv` as mapped by other processes too (--mmap): a claim left by a
+// process that died mid-publish is then repaired by whoever waits on it.
+void inventory_share(Inventory *inv);
+
+// Copy a consistent snapshot into `out`. Returns its version (sequence number).
+// Here and below only the lanes in use (atoms_lanes()) of `out` / `after`
+// are written, and only those of `stock` / `delta` / `req` are read.
+uint64_t inventory_read(const Inventory *inv, AtomStock *out);
+
+// Add `delta` to the stock unless any count would exceed MAX_ATOMS.
+// On INV_OK, `after` (may be NULL) receives the new stock and `version`
+// (may be NULL) the version that contains this update.
+InvResult inventory_add(Inventory *inv, const AtomStock *delta,
+                        AtomStock *after, uint64_t *version);
+
+// Subtract `req` atomically if every count is available, otherwise nothing.
+// `after` / `version` as above; on failure `after` holds the stock that was
+// checked.
+InvResult inventory_take(Inventory *inv, const AtomStock *req,
+                         AtomStock *after, uint64_t *version);
+
+// The compare-and-subtract kernel in use: "avx2", "sse4.2" or "scalar"
+const char *inventory_kernel(void);
+
+// Switch to the kernel called `name` (benchmarks). False if this CPU lacks it.
+bool inventory_use_kernel(const char *name);
+
+#endif // INVENTORY_H
@@ -0,0 +1,203 @@
+/*
+** inventory_bench.c -- contention microbenchmark for the drinks_bar inventory
+**
+** Every thread runs a mix of ADD (one random atom type) and DELIVER WATER /
+** CARBON DIOXIDE / GLUCOSE / ALCOHOL requests against one shared inventory,
+** first through the seqlock engine in inventory.c, then through the
+** pthread_mutex baseline it replaced. At the end the final stock must equal
+** initial + all successful ADDs - all successful DELIVERs, or the run fails.
+**
+** Usage: ./inventory_bench.out [-t <max_threads>] [-n <ops_per_thread>]
+**   threads are doubled from 1 up to max_threads (default: 8, 2000000 ops)
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>           // printf, fprintf
+#include <stdlib.h>          // exit, atoi, strtoull
+#include <string.h>          // memset
+#include <stdint.h>          // uint64_t
+#include <stdbool.h>         // bool
+#include <unistd.h>          // getopt
+#include <pthread.h>         // pthread_create, pthread_join, pthread_mutex_t
+#include <time.h>            // clock_gettime
+
+#include "inventory.h"
+
+#define MAX_BENCH_THREADS 256
+
+// Molecule recipes (C, O, H per molecule), same as drinks_bar.c
+static const AtomStock recipes[] = {
+    {{ 0, 1,  2 }},   // WATER
+    {{ 1, 2,  0 }},   // CARBON DIOXIDE
+    {{ 6, 6, 12 }},   // GLUCOSE
+    {{ 2, 1,  6 }},   // ALCOHOL
+};
+#define ATOMS 3         // carbon, oxygen, hydrogen
+
+// Per-thread tally of what was actually applied (padded: no false sharing)
+typedef struct {
+    AtomStock added;
+    AtomStock taken;
+    uint64_t  ops;
+} __attribute__((aligned(64))) Tally;
+
+typedef struct {
+    int        id;
+    uint64_t   ops;
+    bool       use_mutex;
+    Tally      tally;
+} BenchThread;
+
+static Inventory       shared_inv;
+static AtomStock       mutex_stock;
+static pthread_mutex_t mutex_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t start_barrier;
+
+// xorshift64: cheap per-thread pseudo random numbers
+static inline uint64_t next_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static bool mutex_add(const AtomStock *d) {
+    bool ok = false;
+    pthread_mutex_lock(&mutex_lock);
+    ok = true;
+    for (int i = 0; i < ATOMS; i++) ok &= mutex_stock.count[i] + d->count[i] <= MAX_ATOMS;
+    if (ok) {
+        for (int i = 0; i < ATOMS; i++) mutex_stock.count[i] += d->count[i];
+    }
+    pthread_mutex_unlock(&mutex_lock);
+    return ok;
+}
+
+static bool mutex_take(const AtomStock *r) {
+    bool ok = false;
+    pthread_mutex_lock(&mutex_lock);
+    ok = true;
+    for (int i = 0; i < ATOMS; i++) ok &= mutex_stock.count[i] >= r->count[i];
+    if (ok) {
+        for (int i = 0; i < ATOMS; i++) mutex_stock.count[i] -= r->count[i];
+    }
+    pthread_mutex_unlock(&mutex_lock);
+    return ok;
+}
+
+static void *bench_thread(void *arg) {
+    BenchThread *bt = (BenchThread *)arg;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(bt->id + 1);
+    memset(&bt->tally, 0, sizeof(bt->tally));
+
+    pthread_barrier_wait(&start_barrier);
+    for (uint64_t i = 0; i < bt->ops; i++) {
+        uint64_t r = next_rand(&rng);
+        bool ok;
+        if (r & 1) {
+            // ADD <random atom> 1..16
+            static __thread AtomStock d;     // zero but for the lane set here
+            unsigned atom = (r >> 1) % ATOMS;
+            d.count[atom] = 1 + ((r >> 8) & 15);
+            ok = bt->use_mutex ? mutex_add(&d)
+                               : inventory_add(&shared_inv, &d, NULL, NULL) == INV_OK;
+            if (ok) {
+                for (int k = 0; k < ATOMS; k++) bt->tally.added.count[k] += d.count[k];
+            }
+            d.count[atom] = 0;
+        } else {
+            // DELIVER <random molecule> 1
+            const AtomStock *req = &recipes[(r >> 1) % 4];
+            ok = bt->use_mutex ? mutex_take(req)
+                               : inventory_take(&shared_inv, req, NULL, NULL) == INV_OK;
+            if (ok) {
+                for (int k = 0; k < ATOMS; k++) bt->tally.taken.count[k] += req->count[k];
+            }
+        }
+        bt->tally.ops++;
+    }
+    return NULL;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// ----------------------------------------------------------------------------
+// run_one(): one engine, `nthreads` threads. Returns Mops/s, exits on a
+// conservation error.
+// ----------------------------------------------------------------------------
+static double run_one(bool use_mutex, int nthreads, uint64_t ops) {
+    static BenchThread threads[MAX_BENCH_THREADS];
+    pthread_t tids[MAX_BENCH_THREADS];
+    const AtomStock initial = {{ 1000, 1000, 1000 }};
+
+    inventory_init(&shared_inv, &initial);
+    mutex_stock = initial;
+    pthread_barrier_init(&start_barrier, NULL, (unsigned)nthreads + 1);
+
+    for (int i = 0; i < nthreads; i++) {
+        threads[i].id        = i;
+        threads[i].ops       = ops;
+        threads[i].use_mutex = use_mutex;
+        pthread_create(&tids[i], NULL, bench_thread, &threads[i]);
+    }
+    double t0 = now_sec();
+    pthread_barrier_wait(&start_barrier);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = now_sec() - t0;
+    pthread_barrier_destroy(&start_barrier);
+
+    // Conservation check
+    AtomStock expect = initial;
+    for (int i = 0; i < nthreads; i++) {
+        for (int k = 0; k < ATOMS; k++) {
+            expect.count[k] += threads[i].tally.added.count[k] - threads[i].tally.taken.count[k];
+        }
+    }
+    AtomStock final;
+    if (use_mutex) final = mutex_stock;
+    else           inventory_read(&shared_inv, &final);
+    const uint64_t *f = final.count, *e = expect.count;
+    if (f[0] != e[0] || f[1] != e[1] || f[2] != e[2]) {
+        fprintf(stderr, "ERROR: %s lost updates: got C=%llu O=%llu H=%llu, expected C=%llu O=%llu H=%llu\n",
+                use_mutex ? "mutex" : "seqlock",
+                (unsigned long long)f[0], (unsigned long long)f[1], (unsigned long long)f[2],
+                (unsigned long long)e[0], (unsigned long long)e[1], (unsigned long long)e[2]);
+        exit(EXIT_FAILURE);
+    }
+    return (double)ops * nthreads / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = 8;
+    uint64_t ops = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+            case 't': max_threads = atoi(optarg); break;
+            case 'n': ops = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t <max_threads>] [-n <ops_per_thread>]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_BENCH_THREADS || ops == 0) {
+        fprintf(stderr, "ERROR: need 1 <= threads <= %d and ops > 0\n", MAX_BENCH_THREADS);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-8s %16s %16s\n", "threads", "seqlock Mops/s", "mutex Mops/s");
+    for (int t = 1; t <= max_threads; t *= 2) {
+        double lf = run_one(false, t, ops);
+        double mx = run_one(true,  t, ops);
+        printf("%-8d %16.2f %16.2f\n", t, lf, mx);
+    }
+    return 0;
+}
@@ -0,0 +1,569 @@
+/*
+** load_generator.c -- closed- and open-loop load for drinks_bar
+**
+** Every client (one thread, one socket) keeps up to -w requests in flight
+** against one drinks_bar transport and times every reply:
+**   -h <host> -p <port>            UDP (default) or, with -t tcp, TCP
+**   -d <uds_dgram_path>            UDS_DGRAM
+**   -s <uds_stream_path>           UDS_STREAM
+** Stream requests are pipelined in one write(); datagrams go out with
+** sendmmsg() and come back with recvmmsg(), so the generator is not the
+** bottleneck of the measurement.
+**
+** Closed loop (default): every reply lets the next request go out, so the
+** result is what the server sustains at that concurrency.
+** Open loop (-r <rate>): each client sends on a fixed schedule (rate / clients
+** per second) whether or not the replies keep up, and a reply's latency is
+** counted from the time its request was due, not from when it was actually
+** sent. A stalled server therefore shows up as latency instead of as fewer
+** samples (no coordinated omission). -w still caps what is in flight.
+**
+** Replies are matched to requests in order (streams keep it; the text
+** protocol has no request ids). A datagram window that gets no reply within
+** 100 ms is counted as lost. Latencies go into a log-linear histogram
+** (histogram.h, < 1 % error) and are reported as p50 / p90 / p99 / p99.9.
+**
+** Usage:
+**   ./load_generator.out -h <host> -p <port> [-t udp|tcp] [options]
+**   ./load_generator.out -d <uds_dgram_path>              [options]
+**   ./load_generator.out -s <uds_stream_path>             [options]
+** Options:
+**   -c <clients>   parallel clients / connections (default 4)
+**   -w <depth>     requests in flight per client (default 64)
+**   -r <rate>      open loop: requests per second over all clients (default 0 = closed loop)
+**   -D <seconds>   duration (default 5)
+**   -m <command>   request text, repeat -m to cycle through several
+**                  (default "ADD CARBON 1" on streams, "DELIVER WATER 1" on datagrams)
+**   -B             send the commands as binary WireRequest frames (see wire.h)
+**   -j             print the report as one JSON object
+**
+** Example (server with a deep stock, console output discarded):
+**   ./drinks_bar.out -c 0 -o 1000000000000000 -h 1000000000000000 -T 5555 -U 6666 > /dev/null &
+**   ./load_generator.out -h 127.0.0.1 -p 6666 -c 4 -w 64 -D 5
+**   ./load_generator.out -h 127.0.0.1 -p 5555 -t tcp -c 8 -w 16 -r 200000 -j
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>           // printf, fprintf, snprintf
+#include <stdlib.h>          // exit, atoi, strtod, calloc
+#include <string.h>          // strlen, strcmp, memset, memcpy, memchr, memmove, strncpy
+#include <stdint.h>          // uint64_t
+#include <stdbool.h>         // bool
+#include <errno.h>           // errno
+#include <unistd.h>          // getopt, close, unlink, getpid, write
+#include <time.h>            // clock_gettime
+#include <poll.h>            // ppoll
+#include <pthread.h>         // pthread_create, pthread_join
+#include <netdb.h>           // getaddrinfo
+#include <sys/socket.h>      // socket, connect, send, recv, sendmmsg, recvmmsg
+#include <sys/un.h>          // sockaddr_un
+#include <netinet/in.h>      // IPPROTO_TCP
+#include <netinet/tcp.h>     // TCP_NODELAY
+
+#include "wire.h"            // WireRequest, WireReply, wire_request
+#include "parser.h"          // parse_command (text -> binary request)
+#include "histogram.h"       // latency percentiles
+
+#define MAX_CLIENTS  256
+#define MAX_WINDOW   1024
+#define MAX_COMMANDS 16
+#define REQUEST_MAX  256
+#define REPLY_MAX    256
+#define STREAM_INBUF 65536
+#define LOSS_WAIT_MS 100
+
+typedef enum {
+    TRANSPORT_UDP,
+    TRANSPORT_TCP,
+    TRANSPORT_UDS_DGRAM,
+    TRANSPORT_UDS_STREAM
+} Transport;
+
+static const char *const transport_names[] = { "UDP", "TCP", "UDS_DGRAM", "UDS_STREAM" };
+
+// One request as sent: the text line or its binary frame
+typedef struct {
+    char   data[REQUEST_MAX];
+    size_t len;
+} Request;
+
+typedef struct {
+    int       id;
+    int       fd;
+    char      local_path[sizeof(((struct sockaddr_un *)0)->sun_path)];  // UDS_DGRAM only
+    uint64_t  sent;
+    uint64_t  replies;
+    uint64_t  errors;        // "ERROR: ..." lines / non-zero binary status
+    uint64_t  lost;
+    Histogram latency;       // ns
+} Client;
+
+static Transport   transport = TRANSPORT_UDP;
+static const char *host      = NULL;
+static const char *port      = NULL;
+static const char *uds_path  = NULL;
+static int         nclients  = 4;
+static int         window    = 64;
+static double      rate      = 0;     // requests/s over all clients, 0 = closed loop
+static int         duration  = 5;
+static bool        binary    = false;
+static bool        json      = false;
+static Request     requests[MAX_COMMANDS];
+static int         nrequests = 0;
+static uint64_t    start_ns, deadline_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool is_stream(void) {
+    return transport == TRANSPORT_TCP || transport == TRANSPORT_UDS_STREAM;
+}
+
+// ----------------------------------------------------------------------------
+// add_request(): one -m command, as text or (with -B) as a WireRequest built
+// by the server's own parser.
+// ----------------------------------------------------------------------------
+static void add_request(const char *text) {
+    Request *r = &requests[nrequests++];
+    if (!binary) {
+        int n = snprintf(r->data, sizeof(r->data), "%s\n", text);
+        r->len = (n > 0 && (size_t)n < sizeof(r->data)) ? (size_t)n : sizeof(r->data) - 1;
+        return;
+    }
+    Command cmd;
+    if (parse_command(text, strlen(text), &cmd) != PARSE_OK) {
+        fprintf(stderr, "ERROR: -B needs valid commands, not \"%s\"\n", text);
+        exit(EXIT_FAILURE);
+    }
+    WireRequest w = wire_request(cmd.kind == CMD_ADD ? WIRE_OP_ADD : WIRE_OP_DELIVER,
+                                 (uint8_t)cmd.item, cmd.count, (uint32_t)(nrequests - 1));
+    memcpy(r->data, &w, sizeof(w));
+    r->len = sizeof(w);
+}
+
+// ----------------------------------------------------------------------------
+// open_client(): a socket connect()ed to the server. Datagram sockets can then
+// use plain sendmmsg / recvmmsg without addresses; UDS_DGRAM clients need
+// their own bound path for the server to answer to.
+// ----------------------------------------------------------------------------
+static void open_client(Client *c) {
+    if (transport == TRANSPORT_UDS_DGRAM || transport == TRANSPORT_UDS_STREAM) {
+        bool dgram = (transport == TRANSPORT_UDS_DGRAM);
+        c->fd = socket(AF_UNIX, dgram ? SOCK_DGRAM : SOCK_STREAM, 0);
+        if (c->fd < 0) {
+            perror("socket (UDS)");
+            exit(EXIT_FAILURE);
+        }
+        struct sockaddr_un srv;
+        memset(&srv, 0, sizeof(srv));
+        srv.sun_family = AF_UNIX;
+        strncpy(srv.sun_path, uds_path, sizeof(srv.sun_path) - 1);
+        if (dgram) {
+            struct sockaddr_un me;
+            memset(&me, 0, sizeof(me));
+            me.sun_family = AF_UNIX;
+            snprintf(me.sun_path, sizeof(me.sun_path), "/tmp/load_generator_%d_%d.sock",
+                     (int)getpid(), c->id);
+            memcpy(c->local_path, me.sun_path, sizeof(c->local_path));
+            unlink(c->local_path);
+            if (bind(c->fd, (struct sockaddr *)&me, sizeof(me)) < 0) {
+                perror("bind (UDS_DGRAM)");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (connect(c->fd, (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+            perror("connect (UDS)");
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = (transport == TRANSPORT_TCP) ? SOCK_STREAM : SOCK_DGRAM;
+    int rv = getaddrinfo(host, port, &hints, &res);
+    if (rv != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+    c->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (c->fd < 0 || connect(c->fd, res->ai_addr, res->ai_addrlen) < 0) {
+        fprintf(stderr, "socket/connect (%s): %s\n", transport_names[transport], strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    freeaddrinfo(res);
+    if (transport == TRANSPORT_TCP) {
+        int one = 1;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Per-client send / receive state. `due` is a ring of the times the requests
+// in flight were due, oldest first.
+// ----------------------------------------------------------------------------
+typedef struct {
+    Client         *c;
+    uint64_t       *due;
+    unsigned        head;
+    unsigned        inflight;
+    uint64_t        next_cmd;
+    // streams
+    char           *out;             // window requests back to back
+    char           *in;              // partial replies
+    size_t          in_len;
+    // datagrams
+    struct mmsghdr *out_msgs;
+    struct mmsghdr *in_msgs;
+    struct iovec   *out_iov;
+    struct iovec   *in_iov;
+    char          (*replies)[REPLY_MAX];
+} Flow;
+
+static void reply_done(Flow *f, const char *reply, size_t len, uint64_t now) {
+    if (f->inflight == 0) return;          // late reply of a window already counted as lost
+    uint64_t due = f->due[f->head];
+    f->head = (f->head + 1) % (unsigned)window;
+    f->inflight--;
+    f->c->replies++;
+    histogram_record(&f->c->latency, now > due ? now - due : 0);
+    bool failed = binary ? (len < sizeof(WireReply) || ((const WireReply *)reply)->status != WIRE_OK)
+                         : (len >= 5 && memcmp(reply, "ERROR", 5) == 0);
+    if (failed) f->c->errors++;
+}
+
+// Send `n` requests, the i-th one due at first_due + i * step. Returns false
+// if the server is gone.
+static bool send_requests(Flow *f, unsigned n, uint64_t first_due, uint64_t step) {
+    for (unsigned i = 0; i < n; i++) {
+        f->due[(f->head + f->inflight + i) % (unsigned)window] = first_due + i * step;
+    }
+    if (is_stream()) {
+        size_t len = 0;
+        for (unsigned i = 0; i < n; i++) {
+            const Request *r = &requests[f->next_cmd++ % (uint64_t)nrequests];
+            memcpy(f->out + len, r->data, r->len);
+            len += r->len;
+        }
+        for (size_t off = 0; off < len; ) {
+            ssize_t w = send(f->c->fd, f->out + off, len - off, MSG_NOSIGNAL);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perror("send");
+                return false;
+            }
+            off += (size_t)w;
+        }
+    } else {
+        for (unsigned i = 0; i < n; i++) {
+            const Request *r = &requests[f->next_cmd++ % (uint64_t)nrequests];
+            f->out_iov[i].iov_base = (void *)r->data;
+            f->out_iov[i].iov_len  = r->len;
+        }
+        for (unsigned off = 0; off < n; ) {
+            int s = sendmmsg(f->c->fd, f->out_msgs + off, n - off, 0);
+            if (s < 0) {
+                if (errno == EINTR) continue;
+                if (errno == ECONNREFUSED) break;    // server not (yet) there: counted as lost
+                perror("sendmmsg");
+                return false;
+            }
+            off += (unsigned)s;
+        }
+    }
+    f->inflight  += n;
+    f->c->sent   += n;
+    return true;
+}
+
+// Take every reply that has arrived. Returns the number of replies, or -1
+// if the server closed the connection.
+static int receive_replies(Flow *f) {
+    uint64_t now;
+    int got = 0;
+    if (is_stream()) {
+        for (;;) {
+            ssize_t n = recv(f->c->fd, f->in + f->in_len, STREAM_INBUF - f->in_len, MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return got;
+                if (errno == EINTR) continue;
+                perror("recv");
+                return -1;
+            }
+            if (n == 0) {
+                fprintf(stderr, "load_generator: server closed connection %d\n", f->c->id);
+                return -1;
+            }
+            now = now_ns();
+            f->in_len += (size_t)n;
+            size_t pos = 0;
+            if (binary) {
+                for (; f->in_len - pos >= sizeof(WireReply); pos += sizeof(WireReply), got++) {
+                    reply_done(f, f->in + pos, sizeof(WireReply), now);
+                }
+            } else {
+                char *nl;
+                while ((nl = memchr(f->in + pos, '\n', f->in_len - pos)) != NULL) {
+                    reply_done(f, f->in + pos, (size_t)(nl - (f->in + pos)), now);
+                    pos = (size_t)(nl - f->in) + 1;
+                    got++;
+                }
+            }
+            f->in_len -= pos;
+            memmove(f->in, f->in + pos, f->in_len);
+        }
+    }
+    for (;;) {
+        int n = recvmmsg(f->c->fd, f->in_msgs, (unsigned)window, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+                perror("recvmmsg");
+            }
+            return got;
+        }
+        now = now_ns();
+        for (int i = 0; i < n; i++) {
+            reply_done(f, f->replies[i], f->in_msgs[i].msg_len, now);
+        }
+        got += n;
+    }
+}
+
+static void *client_thread(void *arg) {
+    Client *c = (Client *)arg;
+    Flow f;
+    memset(&f, 0, sizeof(f));
+    f.c   = c;
+    f.due = calloc((size_t)window, sizeof(*f.due));
+    bool ok = (f.due != NULL);
+    if (is_stream()) {
+        f.out = malloc((size_t)window * REQUEST_MAX);
+        f.in  = malloc(STREAM_INBUF);
+        ok = ok && f.out && f.in;
+    } else {
+        f.out_msgs = calloc((size_t)window, sizeof(*f.out_msgs));
+        f.in_msgs  = calloc((size_t)window, sizeof(*f.in_msgs));
+        f.out_iov  = calloc((size_t)window, sizeof(*f.out_iov));
+        f.in_iov   = calloc((size_t)window, sizeof(*f.in_iov));
+        f.replies  = calloc((size_t)window, REPLY_MAX);
+        ok = ok && f.out_msgs && f.in_msgs && f.out_iov && f.in_iov && f.replies;
+        for (int i = 0; ok && i < window; i++) {
+            f.out_msgs[i].msg_hdr.msg_iov    = &f.out_iov[i];
+            f.out_msgs[i].msg_hdr.msg_iovlen = 1;
+            f.in_iov[i].iov_base = f.replies[i];
+            f.in_iov[i].iov_len  = REPLY_MAX;
+            f.in_msgs[i].msg_hdr.msg_iov    = &f.in_iov[i];
+            f.in_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+    if (!ok) {
+        perror("calloc (client buffers)");
+        exit(EXIT_FAILURE);
+    }
+
+    // Open loop: this client's share of -r, the clients staggered over one interval
+    uint64_t interval = rate > 0 ? (uint64_t)(1e9 * nclients / rate) : 0;
+    if (rate > 0 && interval == 0) interval = 1;
+    uint64_t next_due = start_ns + interval * (uint64_t)c->id / (uint64_t)nclients;
+    uint64_t last_reply = now_ns();
+
+    for (;;) {
+        uint64_t now = now_ns();
+        if (now >= deadline_ns) break;
+
+        // 1) Send what the window (and, open loop, the schedule) allows
+        unsigned room = (unsigned)window - f.inflight;
+        bool was_idle = (f.inflight == 0);
+        if (room > 0) {
+            if (interval == 0) {
+                if (!send_requests(&f, room, now, 0)) break;
+            } else if (now >= next_due) {
+                uint64_t due = (now - next_due) / interval + 1;
+                unsigned n = due < room ? (unsigned)due : room;
+                if (!send_requests(&f, n, next_due, interval)) break;
+                next_due += n * interval;
+            }
+            if (was_idle) last_reply = now;        // the loss clock starts now
+        }
+
+        // 2) Wait for replies, or until the next request is due
+        uint64_t wait = (uint64_t)LOSS_WAIT_MS * 1000000u;
+        if (interval > 0 && f.inflight < (unsigned)window) {
+            wait = next_due > now ? next_due - now : 0;
+        }
+        if (now + wait > deadline_ns) wait = deadline_ns - now;
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        struct timespec ts = { (time_t)(wait / 1000000000u), (long)(wait % 1000000000u) };
+        if (ppoll(&pfd, 1, &ts, NULL) < 0 && errno != EINTR) {
+            perror("ppoll");
+            break;
+        }
+        int got = receive_replies(&f);
+        if (got < 0) break;
+        now = now_ns();
+        if (got > 0) {
+            last_reply = now;
+        } else if (!is_stream() && f.inflight > 0 &&
+                   now - last_reply >= (uint64_t)LOSS_WAIT_MS * 1000000u) {
+            c->lost   += f.inflight;
+            f.head     = (f.head + f.inflight) % (unsigned)window;
+            f.inflight = 0;
+            last_reply = now;
+        }
+    }
+    free(f.due);
+    free(f.out);
+    free(f.in);
+    free(f.out_msgs);
+    free(f.in_msgs);
+    free(f.out_iov);
+    free(f.in_iov);
+    free(f.replies);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Report
+// ----------------------------------------------------------------------------
+static double us(uint64_t ns) {
+    return (double)ns / 1000.0;
+}
+
+static void print_report(const Client *total, double elapsed) {
+    const Histogram *h = &total->latency;
+    double rate_done = (double)total->replies / elapsed;
+    if (json) {
+        printf("{\"transport\":\"%s\",\"protocol\":\"%s\",\"clients\":%d,\"depth\":%d,"
+               "\"mode\":\"%s\",\"target_rate\":%.0f,\"duration_s\":%.3f,"
+               "\"sent\":%llu,\"replies\":%llu,\"errors\":%llu,\"lost\":%llu,\"rate\":%.0f,"
+               "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,"
+               "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               transport_names[transport], binary ? "binary" : "text", nclients, window,
+               rate > 0 ? "open" : "closed", rate, elapsed,
+               (unsigned long long)total->sent, (unsigned long long)total->replies,
+               (unsigned long long)total->errors, (unsigned long long)total->lost, rate_done,
+               h->count ? us(h->min) : 0.0, histogram_mean(h) / 1000.0,
+               us(histogram_percentile(h, 50)), us(histogram_percentile(h, 90)),
+               us(histogram_percentile(h, 99)), us(histogram_percentile(h, 99.9)), us(h->max));
+        return;
+    }
+    printf("transport  %s (%s)\n", transport_names[transport], binary ? "binary" : "text");
+    printf("clients    %d x window %d, %s loop", nclients, window, rate > 0 ? "open" : "closed");
+    if (rate > 0) printf(" at %.0f requests/s", rate);
+    printf(", %.2f s\n", elapsed);
+    printf("sent       %llu\n", (unsigned long long)total->sent);
+    printf("replies    %llu (%llu errors)\n", (unsigned long long)total->replies,
+           (unsigned long long)total->errors);
+    printf("lost       %llu\n", (unsigned long long)total->lost);
+    printf("rate       %.0f replies/s\n", rate_done);
+    printf("latency    p50 %.1f us  p90 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+           us(histogram_percentile(h, 50)), us(histogram_percentile(h, 90)),
+           us(histogram_percentile(h, 99)), us(histogram_percentile(h, 99.9)), us(h->max));
+}
+
+int main(int argc, char *argv[]) {
+    const char *commands[MAX_COMMANDS];
+    int ncommands = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:t:d:s:c:w:r:D:m:Bj")) != -1) {
+        switch (opt) {
+            case 'h': host     = optarg;         break;
+            case 'p': port     = optarg;         break;
+            case 'c': nclients = atoi(optarg);   break;
+            case 'w': window   = atoi(optarg);   break;
+            case 'r': rate     = strtod(optarg, NULL); break;
+            case 'D': duration = atoi(optarg);   break;
+            case 'B': binary   = true;           break;
+            case 'j': json     = true;           break;
+            case 'd':
+                uds_path  = optarg;
+                transport = TRANSPORT_UDS_DGRAM;
+                break;
+            case 's':
+                uds_path  = optarg;
+                transport = TRANSPORT_UDS_STREAM;
+                break;
+            case 't':
+                if (strcmp(optarg, "tcp") == 0) {
+                    transport = TRANSPORT_TCP;
+                } else if (strcmp(optarg, "udp") != 0) {
+                    fprintf(stderr, "ERROR: -t must be udp or tcp\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                if (ncommands == MAX_COMMANDS) {
+                    fprintf(stderr, "ERROR: at most %d -m commands\n", MAX_COMMANDS);
+                    exit(EXIT_FAILURE);
+                }
+                commands[ncommands++] = optarg;
+                break;
+            default:
+                fprintf(stderr,
+                    "Usage: %s (-h <host> -p <port> [-t udp|tcp] | -d <uds_dgram_path> | -s <uds_stream_path>)\n"
+                    "          [-c <clients>] [-w <depth>] [-r <requests/s>] [-D <seconds>]\n"
+                    "          [-m <command>]... [-B] [-j]\n",
+                    argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!uds_path == !(host && port)) {
+        fprintf(stderr, "ERROR: give either -h <host> -p <port>, -d <uds_dgram_path> or -s <uds_stream_path>\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nclients < 1 || nclients > MAX_CLIENTS || window < 1 || window > MAX_WINDOW ||
+        duration < 1 || rate < 0) {
+        fprintf(stderr, "ERROR: need 1 <= clients <= %d, 1 <= window <= %d, seconds >= 1, rate >= 0\n",
+                MAX_CLIENTS, MAX_WINDOW);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ncommands == 0) {
+        commands[ncommands++] = is_stream() ? "ADD CARBON 1" : "DELIVER WATER 1";
+    }
+    for (int i = 0; i < ncommands; i++) {
+        add_request(commands[i]);
+    }
+
+    Client *clients = calloc((size_t)nclients, sizeof(Client));
+    pthread_t *tids = calloc((size_t)nclients, sizeof(pthread_t));
+    if (!clients || !tids) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nclients; i++) {
+        clients[i].id = i;
+        histogram_init(&clients[i].latency);
+        open_client(&clients[i]);
+    }
+
+    start_ns    = now_ns();
+    deadline_ns = start_ns + (uint64_t)duration * 1000000000u;
+    for (int i = 0; i < nclients; i++) {
+        pthread_create(&tids[i], NULL, client_thread, &clients[i]);
+    }
+    static Client total;
+    histogram_init(&total.latency);
+    for (int i = 0; i < nclients; i++) {
+        pthread_join(tids[i], NULL);
+        total.sent    += clients[i].sent;
+        total.replies += clients[i].replies;
+        total.errors  += clients[i].errors;
+        total.lost    += clients[i].lost;
+        histogram_merge(&total.latency, &clients[i].latency);
+        close(clients[i].fd);
+        if (transport == TRANSPORT_UDS_DGRAM) unlink(clients[i].local_path);
+    }
+    double elapsed = (double)(now_ns() - start_ns) / 1e9;
+
+    print_report(&total, elapsed);
+    free(clients);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+** logger.c -- lock-free log ring and its writer thread (see logger.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "logger.h"
+
+#include <stdio.h>           // vsnprintf, fwrite, fflush, fprintf
+#include <stdlib.h>          // exit
+#include <string.h>          // strcmp, strerror
+#include <stdarg.h>          // va_list
+#include <stdint.h>          // uint64_t
+#include <time.h>            // clock_gettime
+#include <pthread.h>         // pthread_create, pthread_join
+#include <unistd.h>          // syscall
+#include <linux/futex.h>     // FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#include <sys/syscall.h>     // SYS_futex
+
+#define LOG_OUTBUF    65536                  // bytes written per fwrite
+
+// ----------------------------------------------------------------------------
+// Bounded multi-producer / single-consumer ring. Every slot carries a
+// sequence number: a producer may claim position p when seq == p, publishes
+// with seq = p + 1, and the writer frees it with seq = p + LOG_RING_SLOTS.
+// ----------------------------------------------------------------------------
+typedef struct {
+    uint64_t seq;
+    int      level;
+    unsigned len;
+    char     text[LOG_LINE_MAX];
+} LogSlot;
+
+static struct {
+    LogSlot      slots[LOG_RING_SLOTS];
+    uint64_t     tail __attribute__((aligned(64)));   // next position to claim
+    uint64_t     head __attribute__((aligned(64)));   // next position to drain (writer only)
+    uint64_t     dropped;                             // ring full
+    uint32_t     sleeping;                            // writer waits on this futex word
+    LogConfig    cfg;
+    LogSummaryFn summary;
+    bool         running;
+    bool         stop;
+    pthread_t    thread;
+} ring = { .cfg = { LOG_LEVEL_INFO, 0, 0 } };
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// ----------------------------------------------------------------------------
+// Idle writer: it sets `sleeping`, checks the ring once more and waits on the
+// word; a producer that publishes a line and finds `sleeping` set clears it
+// and wakes the writer. The seq_cst fences on both sides make sure either
+// the writer sees the line or the producer sees the flag, so a busy ring
+// costs producers one load and an empty one costs the writer no wake-ups.
+// ----------------------------------------------------------------------------
+static void wake_writer(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring.sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&ring.sleeping, 0, __ATOMIC_RELAXED)) {
+        syscall(SYS_futex, &ring.sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static FILE *stream_for(int level) {
+    return level <= LOG_LEVEL_WARN ? stderr : stdout;
+}
+
+bool log_enabled(LogLevel level) {
+    return level <= ring.cfg.level;
+}
+
+int log_parse_level(const char *name) {
+    if (strcmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+    if (strcmp(name, "warn")  == 0) return LOG_LEVEL_WARN;
+    if (strcmp(name, "info")  == 0) return LOG_LEVEL_INFO;
+    if (strcmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+    return -1;
+}
+
+void log_msg(LogLevel level, const char *fmt, ...) {
+    if (!log_enabled(level)) return;
+    va_list ap;
+
+    if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE)) {
+        va_start(ap, fmt);
+        vfprintf(stream_for(level), fmt, ap);
+        va_end(ap);
+        fputc('\n', stream_for(level));
+        return;
+    }
+
+    uint64_t pos = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+    LogSlot *s;
+    for (;;) {
+        s = &ring.slots[pos & (LOG_RING_SLOTS - 1)];
+        uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full: the writer is stuck on the console, drop instead of waiting
+            __atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+            wake_writer();
+            return;
+        } else {
+            pos = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    va_start(ap, fmt);
+    int n = vsnprintf(s->text, sizeof(s->text), fmt, ap);
+    va_end(ap);
+    if (n < 0) n = 0;
+    s->len   = (unsigned)n < sizeof(s->text) ? (unsigned)n : sizeof(s->text) - 1;
+    s->level = level;
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+    wake_writer();
+}
+
+// ----------------------------------------------------------------------------
+// Writer thread
+// ----------------------------------------------------------------------------
+typedef struct {
+    FILE  *fp;
+    size_t len;
+    char   data[LOG_OUTBUF];
+} OutBuf;
+
+static void out_flush(OutBuf *o) {
+    if (o->len > 0) {
+        fwrite(o->data, 1, o->len, o->fp);
+        o->len = 0;
+    }
+    fflush(o->fp);
+}
+
+static void out_line(OutBuf *o, const char *text, size_t len) {
+    if (o->len + len + 1 > sizeof(o->data)) {
+        out_flush(o);
+    }
+    memcpy(o->data + o->len, text, len);
+    o->len += len;
+    o->data[o->len++] = '\n';
+}
+
+static void out_note(OutBuf *o, const char *what, uint64_t count) {
+    char note[96];
+    int n = snprintf(note, sizeof(note), "[log] %llu line(s) %s",
+                     (unsigned long long)count, what);
+    out_line(o, note, (size_t)n);
+}
+
+static void emit_summary(OutBuf *out) {
+    char line[LOG_LINE_MAX];
+    size_t n = ring.summary(line, sizeof(line));
+    if (n > 0) out_line(out, line, n < sizeof(line) ? n : sizeof(line) - 1);
+}
+
+static bool ring_empty(void) {
+    const LogSlot *s = &ring.slots[ring.head & (LOG_RING_SLOTS - 1)];
+    return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != ring.head + 1 &&
+           __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED) == 0 &&
+           !__atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE);
+}
+
+// Wait up to `ms` milliseconds (UINT64_MAX = no limit) for wake_writer()
+static void idle_wait(uint64_t ms) {
+    __atomic_store_n(&ring.sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ring_empty() && ms > 0) {
+        struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+        syscall(SYS_futex, &ring.sleeping, FUTEX_WAIT_PRIVATE, 1,
+                ms == UINT64_MAX ? NULL : &ts, NULL, 0);
+    }
+    __atomic_store_n(&ring.sleeping, 0, __ATOMIC_RELAXED);
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+    static OutBuf out = { .len = 0 }, err = { .len = 0 };
+    out.fp = stdout;
+    err.fp = stderr;
+    uint64_t window_start = now_ms(), window_lines = 0, suppressed = 0;
+    uint64_t next_summary = now_ms() + ring.cfg.summary_ms;
+
+    for (;;) {
+        bool stopping = __atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE);
+        uint64_t now = now_ms();
+        if (now - window_start >= 1000) {
+            if (suppressed > 0) out_note(&err, "suppressed by --log-rate", suppressed);
+            window_start = now;
+            window_lines = 0;
+            suppressed   = 0;
+        }
+
+        // Drain everything published so far
+        size_t drained = 0;
+        for (;;) {
+            LogSlot *s = &ring.slots[ring.head & (LOG_RING_SLOTS - 1)];
+            if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != ring.head + 1) break;
+            if (ring.cfg.rate == 0 || window_lines < ring.cfg.rate) {
+                out_line(s->level <= LOG_LEVEL_WARN ? &err : &out, s->text, s->len);
+                window_lines++;
+            } else {
+                suppressed++;
+            }
+            __atomic_store_n(&s->seq, ring.head + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+            ring.head++;
+            drained++;
+        }
+        uint64_t dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0) out_note(&err, "dropped, log ring full", dropped);
+
+        if (ring.summary && ring.cfg.summary_ms > 0 && log_enabled(LOG_LEVEL_INFO) &&
+            (now >= next_summary || stopping)) {
+            emit_summary(&out);
+            next_summary = now + ring.cfg.summary_ms;
+        }
+        if (out.len > 0) out_flush(&out);
+        if (err.len > 0) out_flush(&err);
+
+        if (stopping) {
+            if (suppressed > 0) {
+                out_note(&err, "suppressed by --log-rate", suppressed);
+                out_flush(&err);
+            }
+            break;
+        }
+        if (drained == 0) {
+            // Sleep until a line arrives, or until the summary or the
+            // suppressed-lines note is due
+            uint64_t wait_ms = UINT64_MAX;
+            if (ring.summary && ring.cfg.summary_ms > 0 && log_enabled(LOG_LEVEL_INFO)) {
+                wait_ms = next_summary > now ? next_summary - now : 0;
+            }
+            if (suppressed > 0 && window_start + 1000 - now < wait_ms) {
+                wait_ms = window_start + 1000 - now;
+            }
+            idle_wait(wait_ms);
+        }
+    }
+    return NULL;
+}
+
+void log_start(const LogConfig *cfg, LogSummaryFn summary) {
+    ring.cfg     = *cfg;
+    ring.summary = summary;
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; i++) {
+        ring.slots[i].seq = i;
+    }
+    ring.head = ring.tail = 0;
+    ring.stop = false;
+    // Anything printed with stdio before now must come out first
+    fflush(stdout);
+    int rc = pthread_create(&ring.thread, NULL, writer_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "pthread_create (logger): %s\n", strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+    __atomic_store_n(&ring.running, true, __ATOMIC_RELEASE);
+}
+
+void log_stop(void) {
+    if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&ring.stop, true, __ATOMIC_RELEASE);
+    wake_writer();
+    pthread_join(ring.thread, NULL);
+    __atomic_store_n(&ring.running, false, __ATOMIC_RELEASE);
+}
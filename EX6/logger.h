@@ -0,0 +1,61 @@
+/*
+** logger.h -- asynchronous, rate-limited console log for drinks_bar
+**
+** log_msg() formats the line into a slot of a lock-free ring and returns;
+** it never blocks and never touches stdout/stderr itself. A background
+** writer drains the ring in batches (ERROR / WARN to stderr, the rest to
+** stdout), so a slow terminal or a full pipe stalls only that thread:
+** once the ring is full, new lines are dropped and counted instead.
+**
+** Throttling, all decided by the writer:
+**   • level:      lines above LogConfig.level are discarded by the caller
+**   • rate:       at most LogConfig.rate lines per second (0 = no limit);
+**                 the excess is dropped and reported once per second
+**   • summary_ms: every summary_ms milliseconds the writer asks the
+**                 LogSummaryFn for one line (e.g. the current inventory)
+**                 instead of the callers logging every event (INFO)
+**
+** Before log_start() and after log_stop() lines are written synchronously.
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+
+#define LOG_LINE_MAX    240                  // longer lines are truncated
+#define LOG_RING_SLOTS  4096                 // lines in flight (power of two)
+
+typedef enum {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+} LogLevel;
+
+typedef struct {
+    LogLevel level;          // default LOG_LEVEL_INFO
+    unsigned rate;           // lines per second, 0 = unlimited
+    unsigned summary_ms;     // 0 = no summary line
+} LogConfig;
+
+// Write one summary line (without '\n') into `buf`; return its length, or 0
+// to skip this period. Runs on the writer thread.
+typedef size_t (*LogSummaryFn)(char *buf, size_t size);
+
+// Start the writer thread. `summary` may be NULL. Exits the process on error.
+void log_start(const LogConfig *cfg, LogSummaryFn summary);
+
+// Drain the ring, print the last summary and join the writer.
+void log_stop(void);
+
+// Cheap check before formatting an expensive line
+bool log_enabled(LogLevel level);
+
+void log_msg(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// "error" / "warn" / "info" / "debug" -> LogLevel, -1 if unknown
+int log_parse_level(const char *name);
+
+#endif // LOGGER_H
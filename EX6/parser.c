@@ -0,0 +1,164 @@
+/*
+** parser.c -- single-pass scanner for ADD / DELIVER (see parser.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "parser.h"
+
+#include <stdbool.h>         // bool
+#include <string.h>          // memcmp, strlen
+
+#include "inventory.h"       // MAX_ATOMS
+#include "atoms.h"           // atom_find, atoms_count (--atoms types)
+#include "wire.h"            // WIRE_ATOM_*, WIRE_MOLECULE_*
+#include "warehouse.h"       // WAREHOUSE_NAME_MAX
+
+// A token is a [start, start+len) slice of the line
+typedef struct {
+    const char *start;
+    size_t      len;
+} Token;
+
+static inline bool is_delim(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Advance *pos past the next token. Returns false at the end of the line.
+static inline bool next_token(const char *line, size_t len, size_t *pos, Token *t) {
+    size_t i = *pos;
+    while (i < len && is_delim(line[i])) i++;
+    if (i >= len || line[i] == '\0') return false;
+    size_t start = i;
+    while (i < len && line[i] != '\0' && !is_delim(line[i])) i++;
+    t->start = line + start;
+    t->len   = i - start;
+    *pos = i;
+    return true;
+}
+
+#define TOKEN_IS(t, lit) ((t).len == sizeof(lit) - 1 && memcmp((t).start, lit, sizeof(lit) - 1) == 0)
+
+// The built-in three by length, any --atoms type by name
+static int atom_id(Token t) {
+    switch (t.len) {
+        case 6:
+            if (TOKEN_IS(t, "CARBON")) return WIRE_ATOM_CARBON;
+            if (TOKEN_IS(t, "OXYGEN")) return WIRE_ATOM_OXYGEN;
+            break;
+        case 8:
+            if (TOKEN_IS(t, "HYDROGEN")) return WIRE_ATOM_HYDROGEN;
+            break;
+    }
+    return atoms_count() > 3 ? atom_find(t.start, t.len) : -1;
+}
+
+// Single-token molecule names ("CARBON" [DIOXIDE] is handled by the caller)
+static int molecule_id(Token t) {
+    switch (t.len) {
+        case 5:
+            return TOKEN_IS(t, "WATER") ? WIRE_MOLECULE_WATER : -1;
+        case 7:
+            if (TOKEN_IS(t, "GLUCOSE")) return WIRE_MOLECULE_GLUCOSE;
+            if (TOKEN_IS(t, "ALCOHOL")) return WIRE_MOLECULE_ALCOHOL;
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+// Decimal count with overflow detection; the whole token must be digits
+static ParseStatus parse_count(Token t, uint64_t *out) {
+    size_t i = 0;
+    if (t.len > 1 && t.start[0] == '+') i = 1;
+    uint64_t v = 0;
+    bool too_large = false;
+    for (; i < t.len; i++) {
+        unsigned d = (unsigned)(t.start[i] - '0');
+        if (d > 9) return PARSE_INVALID_NUMBER;
+        if (v > (MAX_ATOMS - d) / 10) too_large = true;
+        else v = v * 10 + d;
+    }
+    if (too_large) return PARSE_NUMBER_TOO_LARGE;
+    *out = v;
+    return PARSE_OK;
+}
+
+// Optional "@name" right after the command word. *t receives the token
+// after it (has_next: whether there was one).
+static ParseStatus parse_warehouse(const char *line, size_t len, size_t *pos,
+                                   Command *cmd, Token *t, bool *has_next) {
+    *has_next = next_token(line, len, pos, t);
+    if (!*has_next || t->start[0] != '@') return PARSE_OK;
+    if (t->len < 2 || t->len > WAREHOUSE_NAME_MAX) return PARSE_INVALID_WAREHOUSE;
+    cmd->warehouse     = t->start + 1;
+    cmd->warehouse_len = t->len - 1;
+    *has_next = next_token(line, len, pos, t);
+    return PARSE_OK;
+}
+
+ParseStatus parse_command(const char *line, size_t len, Command *cmd) {
+    size_t pos = 0;
+    Token t1, t2, t3;
+    bool has_t2;
+    cmd->kind          = CMD_NONE;
+    cmd->item          = -1;
+    cmd->count         = 0;
+    cmd->warehouse     = NULL;
+    cmd->warehouse_len = 0;
+
+    if (!next_token(line, len, &pos, &t1)) return PARSE_INVALID_COMMAND;
+    if (TOKEN_IS(t1, "ADD")) {
+        cmd->kind = CMD_ADD;
+        ParseStatus st = parse_warehouse(line, len, &pos, cmd, &t2, &has_t2);
+        if (st != PARSE_OK) return st;
+        // ADD needs all three tokens before anything else is judged
+        if (!has_t2 || !next_token(line, len, &pos, &t3)) {
+            return PARSE_INVALID_COMMAND;
+        }
+        cmd->item = atom_id(t2);
+        if (cmd->item < 0) return PARSE_INVALID_ATOM;
+        return parse_count(t3, &cmd->count);
+    }
+    if (TOKEN_IS(t1, "DELIVER")) {
+        cmd->kind = CMD_DELIVER;
+        ParseStatus st = parse_warehouse(line, len, &pos, cmd, &t2, &has_t2);
+        if (st != PARSE_OK) return st;
+        if (!has_t2) return PARSE_INVALID_COMMAND;
+        if (TOKEN_IS(t2, "CARBON")) {
+            Token t_next;
+            if (!next_token(line, len, &pos, &t_next) || !TOKEN_IS(t_next, "DIOXIDE")) {
+                return PARSE_INVALID_MOLECULE;
+            }
+            cmd->item = WIRE_MOLECULE_CARBON_DIOXIDE;
+        } else {
+            cmd->item = molecule_id(t2);
+            if (cmd->item < 0) return PARSE_INVALID_MOLECULE;
+        }
+        if (!next_token(line, len, &pos, &t3)) return PARSE_MISSING_NUMBER;
+        Token extra;
+        if (next_token(line, len, &pos, &extra)) return PARSE_TOO_MANY_ARGS;
+        return parse_count(t3, &cmd->count);
+    }
+    return PARSE_INVALID_COMMAND;
+}
+
+ParseStatus parse_number(const char *s, uint64_t *out) {
+    Token t = { s, strlen(s) };
+    if (t.len == 0) return PARSE_INVALID_NUMBER;
+    return parse_count(t, out);
+}
+
+const char *parse_error_text(ParseStatus status) {
+    switch (status) {
+        case PARSE_INVALID_COMMAND:  return "ERROR: invalid command\n";
+        case PARSE_INVALID_ATOM:     return "ERROR: invalid atom type\n";
+        case PARSE_INVALID_MOLECULE: return "ERROR: invalid molecule type\n";
+        case PARSE_MISSING_NUMBER:   return "ERROR: missing number\n";
+        case PARSE_TOO_MANY_ARGS:    return "ERROR: too many arguments\n";
+        case PARSE_INVALID_NUMBER:   return "ERROR: invalid number\n";
+        case PARSE_NUMBER_TOO_LARGE: return "ERROR: number too large\n";
+        case PARSE_INVALID_WAREHOUSE: return "ERROR: invalid warehouse\n";
+        default:                     return "ERROR: unknown error\n";
+    }
+}
@@ -0,0 +1,59 @@
+/*
+** parser.h -- single-pass scanner for the text ADD / DELIVER commands
+**
+** The line is read once, in place: no copy, no strtok_r, no allocation.
+** Atom and molecule names are matched by length first and then compared
+** once, and the count is accumulated with an overflow check in the same pass.
+**
+** Grammar (tokens separated by spaces, tabs, '\r' or '\n'):
+**   ADD [@warehouse] <CARBON|OXYGEN|HYDROGEN|--atoms type> <count> [ignored...]
+**   DELIVER [@warehouse] <WATER|CARBON DIOXIDE|GLUCOSE|ALCOHOL> <count>
+** count: decimal digits, optional leading '+', at most MAX_ATOMS.
+** warehouse: 1 to WAREHOUSE_NAME_MAX - 1 bytes; omitted = the default one.
+*/
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint64_t
+
+typedef enum {
+    CMD_NONE,                // first token is neither ADD nor DELIVER
+    CMD_ADD,
+    CMD_DELIVER
+} CmdKind;
+
+// Same order of checks and same messages as the original strtok_r parsers
+typedef enum {
+    PARSE_OK = 0,
+    PARSE_INVALID_COMMAND,   // "ERROR: invalid command"
+    PARSE_INVALID_ATOM,      // "ERROR: invalid atom type"
+    PARSE_INVALID_MOLECULE,  // "ERROR: invalid molecule type"
+    PARSE_MISSING_NUMBER,    // "ERROR: missing number"
+    PARSE_TOO_MANY_ARGS,     // "ERROR: too many arguments"
+    PARSE_INVALID_NUMBER,    // "ERROR: invalid number"
+    PARSE_NUMBER_TOO_LARGE,  // "ERROR: number too large"
+    PARSE_INVALID_WAREHOUSE  // "ERROR: invalid warehouse"
+} ParseStatus;
+
+typedef struct {
+    CmdKind  kind;           // set as soon as the first token is known
+    int      item;           // atom id (ADD, see atoms.h) or WIRE_MOLECULE_* (DELIVER)
+    uint64_t count;
+    const char *warehouse;   // name after '@', inside the line (NULL = default)
+    size_t   warehouse_len;
+} Command;
+
+// Parse `len` bytes of `line` (need not be NUL-terminated).
+ParseStatus parse_command(const char *line, size_t len, Command *cmd);
+
+// A whole NUL-terminated decimal count, with the checks of a request count
+// (digits only, at most MAX_ATOMS): PARSE_OK, PARSE_INVALID_NUMBER or
+// PARSE_NUMBER_TOO_LARGE. Used for the -c / -o / -h start values.
+ParseStatus parse_number(const char *s, uint64_t *out);
+
+// The "ERROR: ...\n" reply for a failed parse
+const char *parse_error_text(ParseStatus status);
+
+#endif // PARSER_H
@@ -0,0 +1,158 @@
+/*
+** parser_bench.c -- per-command cost of the text parser
+**
+** Parses a fixed mix of valid and invalid ADD / DELIVER lines over and over,
+** once with parse_command() (parser.c) and once with the strtok_r / strcmp /
+** strtoull chain drinks_bar used before, and prints ns per command for both.
+** The two must agree on every line, or the run fails.
+**
+** Usage: ./parser_bench.out [-n <iterations>]   (default 2000000 passes)
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>           // printf, fprintf
+#include <stdlib.h>          // exit, strtoull
+#include <string.h>          // strlen, strcmp, strncpy, strtok_r
+#include <stdint.h>          // uint64_t
+#include <unistd.h>          // getopt
+#include <time.h>            // clock_gettime
+
+#include "parser.h"
+#include "inventory.h"       // MAX_ATOMS
+#include "wire.h"            // WIRE_ATOM_*, WIRE_MOLECULE_*
+
+#define MAXBUF 1024
+
+static const char *lines[] = {
+    "ADD CARBON 100",
+    "ADD OXYGEN 2500000",
+    "ADD HYDROGEN 7",
+    "DELIVER WATER 3",
+    "DELIVER CARBON DIOXIDE 12",
+    "DELIVER GLUCOSE 1",
+    "DELIVER ALCOHOL 40",
+    "ADD NEON 5",
+    "DELIVER WATER 99999999999999999999",
+    "ADD CARBON 12x",
+};
+#define NUM_LINES (sizeof(lines) / sizeof(lines[0]))
+
+// ----------------------------------------------------------------------------
+// legacy_parse(): the pre-parser.c code path (copy + strtok_r + strcmp +
+// strtoull), reduced to producing the same Command / ParseStatus.
+// ----------------------------------------------------------------------------
+static ParseStatus legacy_parse(const char *line, Command *cmd) {
+    char temp[MAXBUF];
+    strncpy(temp, line, sizeof(temp));
+    temp[sizeof(temp)-1] = '\0';
+    cmd->kind = CMD_NONE;
+    cmd->item = -1;
+    cmd->count = 0;
+
+    char *saveptr = NULL;
+    char *token_cmd = strtok_r(temp, " \t\r\n", &saveptr);
+    if (!token_cmd) return PARSE_INVALID_COMMAND;
+    char *token_num = NULL;
+
+    if (strcmp(token_cmd, "ADD") == 0) {
+        cmd->kind = CMD_ADD;
+        char *token_type = strtok_r(NULL, " \t\r\n", &saveptr);
+        token_num = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!token_type || !token_num) return PARSE_INVALID_COMMAND;
+        if (strcmp(token_type, "CARBON") == 0)        cmd->item = WIRE_ATOM_CARBON;
+        else if (strcmp(token_type, "OXYGEN") == 0)   cmd->item = WIRE_ATOM_OXYGEN;
+        else if (strcmp(token_type, "HYDROGEN") == 0) cmd->item = WIRE_ATOM_HYDROGEN;
+        else return PARSE_INVALID_ATOM;
+    } else if (strcmp(token_cmd, "DELIVER") == 0) {
+        cmd->kind = CMD_DELIVER;
+        char *token_mol = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!token_mol) return PARSE_INVALID_COMMAND;
+        char full_mol[MAXBUF];
+        if (strcmp(token_mol, "CARBON") == 0) {
+            char *token_next = strtok_r(NULL, " \t\r\n", &saveptr);
+            if (!token_next || strcmp(token_next, "DIOXIDE") != 0) return PARSE_INVALID_MOLECULE;
+            strcpy(full_mol, "CARBON DIOXIDE");
+        }
+        else if (strcmp(token_mol, "WATER") == 0)   strcpy(full_mol, "WATER");
+        else if (strcmp(token_mol, "GLUCOSE") == 0) strcpy(full_mol, "GLUCOSE");
+        else if (strcmp(token_mol, "ALCOHOL") == 0) strcpy(full_mol, "ALCOHOL");
+        else return PARSE_INVALID_MOLECULE;
+        token_num = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!token_num) return PARSE_MISSING_NUMBER;
+        if (strtok_r(NULL, " \t\r\n", &saveptr)) return PARSE_TOO_MANY_ARGS;
+        if (strcmp(full_mol, "WATER") == 0)               cmd->item = WIRE_MOLECULE_WATER;
+        else if (strcmp(full_mol, "CARBON DIOXIDE") == 0) cmd->item = WIRE_MOLECULE_CARBON_DIOXIDE;
+        else if (strcmp(full_mol, "GLUCOSE") == 0)        cmd->item = WIRE_MOLECULE_GLUCOSE;
+        else                                              cmd->item = WIRE_MOLECULE_ALCOHOL;
+    } else {
+        return PARSE_INVALID_COMMAND;
+    }
+
+    char *endptr = NULL;
+    unsigned long long val = strtoull(token_num, &endptr, 10);
+    if (endptr == token_num || *endptr != '\0') return PARSE_INVALID_NUMBER;
+    if (val > MAX_ATOMS) return PARSE_NUMBER_TOO_LARGE;
+    cmd->count = val;
+    return PARSE_OK;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atol(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n <iterations>]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "ERROR: iterations must be > 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t lens[NUM_LINES];
+    for (size_t i = 0; i < NUM_LINES; i++) {
+        lens[i] = strlen(lines[i]);
+        Command a, b;
+        ParseStatus sa = parse_command(lines[i], lens[i], &a);
+        ParseStatus sb = legacy_parse(lines[i], &b);
+        if (sa != sb || a.kind != b.kind || (sa == PARSE_OK && (a.item != b.item || a.count != b.count))) {
+            fprintf(stderr, "ERROR: parsers disagree on \"%s\"\n", lines[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    volatile uint64_t sink = 0;   // keep the results alive
+    Command cmd;
+
+    double t0 = now_sec();
+    for (long n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < NUM_LINES; i++) {
+            sink += parse_command(lines[i], lens[i], &cmd) + cmd.count;
+        }
+    }
+    double single_pass = now_sec() - t0;
+
+    t0 = now_sec();
+    for (long n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < NUM_LINES; i++) {
+            sink += legacy_parse(lines[i], &cmd) + cmd.count;
+        }
+    }
+    double legacy = now_sec() - t0;
+
+    double cmds = (double)iterations * NUM_LINES;
+    printf("%-12s %10s\n", "parser", "ns/command");
+    printf("%-12s %10.1f\n", "single-pass", single_pass / cmds * 1e9);
+    printf("%-12s %10.1f\n", "strtok_r", legacy / cmds * 1e9);
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+** recipes.c -- the product table and its requirement math (see recipes.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "recipes.h"
+
+#include <stdio.h>           // fopen, fgets, fprintf
+#include <stdlib.h>          // strtoull
+#include <stdbool.h>         // bool
+#include <string.h>          // strcmp, strlen, strchr, strtok_r, memcpy
+
+#include "atoms.h"           // atoms_count, atoms_lanes
+#include "wire.h"            // WIRE_MOLECULE_*
+
+// Molecules first, at their WIRE_MOLECULE_* index, then the beverages
+static Recipe recipes[MAX_RECIPES] = {
+    [WIRE_MOLECULE_WATER]          = { "WATER",          RECIPE_MOLECULE, {{ 0, 1,  2 }} },  // H2O
+    [WIRE_MOLECULE_CARBON_DIOXIDE] = { "CARBON DIOXIDE", RECIPE_MOLECULE, {{ 1, 2,  0 }} },  // CO2
+    [WIRE_MOLECULE_GLUCOSE]        = { "GLUCOSE",        RECIPE_MOLECULE, {{ 6, 6, 12 }} },  // C6H12O6
+    [WIRE_MOLECULE_ALCOHOL]        = { "ALCOHOL",        RECIPE_MOLECULE, {{ 2, 1,  6 }} },  // C2H6O
+    [4] = { "SOFT DRINK", RECIPE_BEVERAGE, {{ 6, 9, 14 }} },
+    [5] = { "VODKA",      RECIPE_BEVERAGE, {{ 8, 8, 20 }} },
+    [6] = { "CHAMPAGNE",  RECIPE_BEVERAGE, {{ 3, 4,  9 }} },
+};
+static size_t num_recipes = 7;
+
+size_t recipes_count(void) {
+    return num_recipes;
+}
+
+const Recipe *recipe_at(size_t i) {
+    return i < num_recipes ? &recipes[i] : NULL;
+}
+
+const Recipe *recipe_molecule(int molecule) {
+    return &recipes[molecule];
+}
+
+const Recipe *recipe_find(RecipeKind kind, const char *name) {
+    for (size_t i = 0; i < num_recipes; i++) {
+        if (recipes[i].kind == kind && strcmp(recipes[i].name, name) == 0) {
+            return &recipes[i];
+        }
+    }
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Requirement math. Every lane is computed independently and the lanes are
+// combined at the end, without a branch per atom, so the compiler can keep
+// them in vector registers and the loops over the table stay straight-line
+// code.
+// ----------------------------------------------------------------------------
+static inline uint64_t lane_scale(uint64_t per, uint64_t count) {
+    uint64_t r;
+    return __builtin_mul_overflow(per, count, &r) ? UINT64_MAX : r;
+}
+
+// A lane with a zero coefficient never limits the result
+static inline uint64_t lane_units(uint64_t have, uint64_t per) {
+    return per ? have / per : UINT64_MAX;
+}
+
+void recipe_scale(const Recipe *r, uint64_t count, AtomStock *need) {
+    unsigned lanes = atoms_lanes();
+    for (unsigned i = 0; i < lanes; i++) {
+        need->count[i] = lane_scale(r->per.count[i], count);
+    }
+}
+
+uint64_t recipe_max_makeable(const Recipe *r, const AtomStock *stock) {
+    unsigned n = atoms_count();
+    uint64_t m = UINT64_MAX;
+    for (unsigned i = 0; i < n; i++) {
+        uint64_t u = lane_units(stock->count[i], r->per.count[i]);
+        m = u < m ? u : m;
+    }
+    return m;
+}
+
+void recipes_max_makeable(const AtomStock *stock, uint64_t out[MAX_RECIPES]) {
+    for (size_t i = 0; i < num_recipes; i++) {
+        out[i] = recipe_max_makeable(&recipes[i], stock);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// recipes_load(): "<NAME words...> <carbon> <oxygen> <hydrogen> [<extra>...]"
+// per line, one count per --atoms type after the built-in three (missing
+// trailing counts are 0). The counts are the trailing numeric words.
+// '#' starts a comment; blank lines are skipped. A line naming an existing
+// beverage replaces its coefficients; molecule names are rejected.
+// ----------------------------------------------------------------------------
+static bool is_count(const char *s) {
+    if (*s == '\0') return false;
+    while (*s >= '0' && *s <= '9') s++;
+    return *s == '\0';
+}
+
+int recipes_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror("fopen (recipes)");
+        return -1;
+    }
+    enum { MAX_TOKENS = ATOM_TYPES_MAX + 16 };
+    char line[2048];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *tok[MAX_TOKENS];
+        int ntok = 0;
+        char *saveptr = NULL;
+        for (char *t = strtok_r(line, " \t\r\n", &saveptr); t && ntok < MAX_TOKENS;
+             t = strtok_r(NULL, " \t\r\n", &saveptr)) {
+            tok[ntok++] = t;
+        }
+        if (ntok == 0) continue;
+        int ncount = 0;
+        while (ncount < ntok - 1 && is_count(tok[ntok - 1 - ncount])) ncount++;
+        if (ncount < 3 || ncount > (int)atoms_count()) {
+            fprintf(stderr, "ERROR: %s:%d: expected <name> <carbon> <oxygen> <hydrogen>"
+                            " and at most %u more counts (--atoms)\n",
+                    path, lineno, atoms_count() - 3);
+            fclose(fp);
+            return -1;
+        }
+        int nname = ntok - ncount;
+
+        Recipe r = { "", RECIPE_BEVERAGE, {{ 0 }} };
+        bool any = false;
+        for (int k = 0; k < ncount; k++) {
+            const char *s = tok[nname + k];
+            char *end = NULL;
+            unsigned long long v = strtoull(s, &end, 10);
+            if (end == s || *end != '\0' || v > MAX_ATOMS) {
+                fprintf(stderr, "ERROR: %s:%d: invalid count '%s'\n", path, lineno, s);
+                fclose(fp);
+                return -1;
+            }
+            r.per.count[k] = v;
+            any |= v != 0;
+        }
+        if (!any) {
+            fprintf(stderr, "ERROR: %s:%d: a recipe needs at least one atom\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+
+        size_t used = 0;
+        for (int k = 0; k < nname; k++) {
+            size_t n = strlen(tok[k]);
+            if (used + (k ? 1 : 0) + n >= RECIPE_NAME_MAX) {
+                fprintf(stderr, "ERROR: %s:%d: name longer than %d characters\n",
+                        path, lineno, RECIPE_NAME_MAX - 1);
+                fclose(fp);
+                return -1;
+            }
+            if (k) r.name[used++] = ' ';
+            memcpy(r.name + used, tok[k], n);
+            used += n;
+        }
+        r.name[used] = '\0';
+
+        if (recipe_find(RECIPE_MOLECULE, r.name)) {
+            fprintf(stderr, "ERROR: %s:%d: '%s' is a molecule, its recipe is fixed\n",
+                    path, lineno, r.name);
+            fclose(fp);
+            return -1;
+        }
+        Recipe *slot = (Recipe *)recipe_find(RECIPE_BEVERAGE, r.name);
+        if (!slot) {
+            if (num_recipes == MAX_RECIPES) {
+                fprintf(stderr, "ERROR: %s:%d: more than %d recipes\n", path, lineno, MAX_RECIPES);
+                fclose(fp);
+                return -1;
+            }
+            slot = &recipes[num_recipes++];
+        }
+        *slot = r;
+    }
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+** recipes.h -- every product drinks_bar knows, as atom coefficients
+**
+** One table holds the molecules (DELIVER) and the beverages (console GEN),
+** each as the AtomStock needed for one unit. The molecules come first and
+** are indexed by WIRE_MOLECULE_* (their names are fixed by the text and the
+** binary protocol). The beverages are built in and can be extended or
+** redefined at startup with --recipes <file>, one product per line:
+**
+**   # name words...   carbon oxygen hydrogen
+**   SOFT DRINK        6      9      14
+**   LEMONADE          6      7      12
+**
+** With --atoms (see atoms.h) a line may go on with one count per extra atom
+** type, in --atoms order; counts it leaves out are 0:
+**
+**   # --atoms NITROGEN,SODIUM
+**   SALTY DOG         2      1      6        0        3
+**
+** The table is read-only once the server runs, so lookups take no lock.
+*/
+
+#ifndef RECIPES_H
+#define RECIPES_H
+
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint64_t
+
+#include "inventory.h"       // AtomStock
+
+#define RECIPE_NAME_MAX 32
+#define MAX_RECIPES     64
+#define NUM_MOLECULES   4    // WIRE_MOLECULE_* ids, the first table entries
+
+typedef enum {
+    RECIPE_MOLECULE,         // DELIVER <name> <count>
+    RECIPE_BEVERAGE          // GEN <name>
+} RecipeKind;
+
+typedef struct {
+    char       name[RECIPE_NAME_MAX];   // words separated by one space
+    RecipeKind kind;
+    AtomStock  per;                     // atoms for one unit
+} Recipe;
+
+// Add / redefine beverages from `path`. Returns 0, or -1 after printing the
+// offending line to stderr.
+int recipes_load(const char *path);
+
+size_t recipes_count(void);
+const Recipe *recipe_at(size_t i);
+
+// The recipe of a WIRE_MOLECULE_* id
+const Recipe *recipe_molecule(int molecule);
+
+// Exact name match within `kind`, or NULL
+const Recipe *recipe_find(RecipeKind kind, const char *name);
+
+// Atoms needed for `count` units; a lane that would overflow saturates at
+// UINT64_MAX (more than any stock can hold).
+void recipe_scale(const Recipe *r, uint64_t count, AtomStock *need);
+
+// Units of `r` that `stock` is enough for
+uint64_t recipe_max_makeable(const Recipe *r, const AtomStock *stock);
+
+// One pass over the whole table: out[i] = recipe_max_makeable(recipe_at(i), stock)
+void recipes_max_makeable(const AtomStock *stock, uint64_t out[MAX_RECIPES]);
+
+#endif // RECIPES_H
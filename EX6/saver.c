@@ -0,0 +1,141 @@
+/*
+** saver.c -- background writer for the -f file (see saver.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "saver.h"
+
+#include <stdio.h>           // perror, fprintf
+#include <stdlib.h>          // exit, malloc, free
+#include <string.h>          // strerror, strlen, memcpy
+#include <stdbool.h>         // bool
+#include <unistd.h>          // close, usleep
+#include <pthread.h>         // pthread_*
+
+#include "snapshot.h"        // snapshot_lock
+
+#define SAVER_RETRY_US 100000   // after a failed write, try again this much later
+
+// ----------------------------------------------------------------------------
+// Writer state. `pending` is the single-word handoff: every update takes the
+// next ticket from it. `idle` tells them whether the writer needs a wake-up at all, so
+// the mutex is only taken when the writer sleeps or somebody waits in
+// saver_wait().
+// ----------------------------------------------------------------------------
+static struct {
+    SaverWrite       write;
+    char            *path;
+    int              lock_fd;   // "<file>.lock", held for the process lifetime
+    uint64_t         pending;   // atomic: newest ticket handed out
+    uint64_t         durable;   // atomic: newest ticket on disk
+    bool             idle;      // atomic: the writer is going to sleep
+    unsigned         waiters;   // atomic: threads in saver_wait()
+    bool             stop;      // under lock
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;      // writer: new version or stop
+    pthread_cond_t   synced;    // saver_wait(): durable went up
+    pthread_t        thread;
+} saver = { .lock_fd = -1 };
+
+// Replace the file with the current state and make it durable. Every update
+// that took its ticket before `ticket` was read is applied by then, so the
+// snapshot covers it. Returns false if the disk refused.
+static bool write_latest(void) {
+    uint64_t ticket = __atomic_load_n(&saver.pending, __ATOMIC_SEQ_CST);
+    if (!saver.write(saver.path)) return false;
+    __atomic_store_n(&saver.durable, ticket, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&saver.waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&saver.lock);
+        pthread_cond_broadcast(&saver.synced);
+        pthread_mutex_unlock(&saver.lock);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// saver_thread(): sleep until an update newer than the file is published,
+// then write whatever the inventories hold by now.
+// ----------------------------------------------------------------------------
+static void *saver_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&saver.lock);
+        __atomic_store_n(&saver.idle, true, __ATOMIC_SEQ_CST);
+        while (!saver.stop && __atomic_load_n(&saver.pending, __ATOMIC_SEQ_CST) <=
+                              __atomic_load_n(&saver.durable, __ATOMIC_RELAXED)) {
+            pthread_cond_wait(&saver.wake, &saver.lock);
+        }
+        __atomic_store_n(&saver.idle, false, __ATOMIC_RELAXED);
+        bool stop = saver.stop;
+        pthread_mutex_unlock(&saver.lock);
+
+        if (__atomic_load_n(&saver.pending, __ATOMIC_SEQ_CST) > saver.durable || stop) {
+            if (!write_latest() && !stop) usleep(SAVER_RETRY_US);
+        }
+        if (stop) break;
+    }
+    return NULL;
+}
+
+void saver_open(const char *path, SaverWrite write) {
+    size_t len = strlen(path);
+    saver.path = malloc(len + 1);
+    if (!saver.path) {
+        perror("malloc (saver)");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(saver.path, path, len + 1);
+    saver.write = write;
+
+    // The file has exactly one writer process
+    saver.lock_fd = snapshot_lock(path);
+    pthread_mutex_init(&saver.lock, NULL);
+    pthread_cond_init(&saver.wake, NULL);
+    pthread_cond_init(&saver.synced, NULL);
+
+    int rc = pthread_create(&saver.thread, NULL, saver_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "pthread_create (saver): %s\n", strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint64_t saver_publish(void) {
+    uint64_t ticket = __atomic_add_fetch(&saver.pending, 1, __ATOMIC_SEQ_CST);
+    // Pairs with the writer's store to `idle` before it rechecks `pending`
+    if (__atomic_load_n(&saver.idle, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&saver.lock);
+        pthread_cond_signal(&saver.wake);
+        pthread_mutex_unlock(&saver.lock);
+    }
+    return ticket;
+}
+
+uint64_t saver_durable(void) {
+    return __atomic_load_n(&saver.durable, __ATOMIC_ACQUIRE);
+}
+
+void saver_wait(uint64_t ticket) {
+    if (saver_durable() >= ticket) return;
+    __atomic_fetch_add(&saver.waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&saver.lock);
+    while (__atomic_load_n(&saver.durable, __ATOMIC_SEQ_CST) < ticket) {
+        pthread_cond_wait(&saver.synced, &saver.lock);
+    }
+    pthread_mutex_unlock(&saver.lock);
+    __atomic_fetch_sub(&saver.waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void saver_close(void) {
+    if (saver.lock_fd < 0) return;
+    pthread_mutex_lock(&saver.lock);
+    saver.stop = true;
+    pthread_cond_signal(&saver.wake);
+    pthread_mutex_unlock(&saver.lock);
+    pthread_join(saver.thread, NULL);
+
+    close(saver.lock_fd);
+    saver.lock_fd = -1;
+    free(saver.path);
+}
@@ -0,0 +1,47 @@
+/*
+** saver.h -- background writer for the -f file (drinks_bar -f --save-thread)
+**
+** The in-memory inventories are authoritative and the -f file (see
+** snapshot.h) is written by one dedicated thread, never by the event loops.
+** An update only takes a ticket: saver_publish() increments one atomic word
+** and wakes the writer if it sleeps, no lock on the request path. The
+** writer reads the newest ticket and then saves a fresh copy of every
+** inventory, which contains all updates up to that ticket, so any number of
+** updates between two writes coalesce into one durable snapshot.
+**
+** saver_durable() is the newest ticket on disk. With --ack fsync the
+** workers call saver_wait() before sending the replies of a batch, so a
+** client only sees OK for updates that survive a crash; with --ack apply
+** (the default) replies go out as soon as memory is updated.
+**
+** Like --wal, the file has exactly one writer process (flock LOCK_EX on
+** "<file>.lock").
+*/
+
+#ifndef SAVER_H
+#define SAVER_H
+
+#include <stdbool.h>         // bool
+#include <stdint.h>          // uint64_t
+
+// Durably replace `path` with the current state; false if the disk refused
+typedef bool (*SaverWrite)(const char *path);
+
+// Start the writer for `path` (already loaded into memory).
+// Exits the process if the file cannot be locked or is owned by another
+// drinks_bar.
+void saver_open(const char *path, SaverWrite write);
+
+// An update has been applied; returns its ticket (thread-safe, lock-free)
+uint64_t saver_publish(void);
+
+// Newest ticket known to be on disk
+uint64_t saver_durable(void);
+
+// Block until `ticket` is on disk
+void saver_wait(uint64_t ticket);
+
+// Write the final state and stop the thread.
+void saver_close(void);
+
+#endif // SAVER_H
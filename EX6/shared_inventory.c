@@ -0,0 +1,236 @@
+/*
+** shared_inventory.c -- mmap()ed -f file shared between processes
+** (see shared_inventory.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "shared_inventory.h"
+
+#include <stdio.h>           // perror, fprintf
+#include <stdlib.h>          // exit, free
+#include <string.h>          // memset, memcmp, strncpy, strerror
+#include <stdbool.h>         // bool
+#include <stddef.h>          // offsetof
+#include <errno.h>           // ETIMEDOUT
+#include <unistd.h>          // pread, pwrite, ftruncate, close
+#include <fcntl.h>           // open, O_*
+#include <time.h>            // clock_gettime
+#include <pthread.h>         // pthread_*
+#include <sys/mman.h>        // mmap, msync, munmap
+#include <sys/stat.h>        // fstat
+#include <sys/file.h>        // flock
+
+#include "atoms.h"           // atoms_count, atom_name, ATOM_NAME_MAX
+#include "snapshot.h"        // snapshot_load, SNAPSHOT_MMAP_MAGIC, SNAPSHOT_RAW_SIZE
+
+static struct {
+    int              fd;
+    SharedFile      *file;
+    unsigned         msync_ms;
+    bool             stop;
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;
+    pthread_t        thread;
+} shm = { .fd = -1 };
+
+// The header this process writes and expects: its build and --atoms list
+static void fill_header(SharedFile *f) {
+    f->magic      = SNAPSHOT_MMAP_MAGIC;
+    f->lanes_max  = ATOM_TYPES_MAX;
+    f->atom_types = (uint16_t)atoms_count();
+    for (unsigned id = 0; id < atoms_count(); id++) {
+        strncpy(f->atom_names[id], atom_name(id), ATOM_NAME_MAX);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// prepare_file(): called while we are the only process holding the file.
+// Makes sure a mapped file's `seq` is even and its `owner` free; converts
+// anything else (a
+// snapshot written by plain -f, --wal or --save-thread, a legacy raw stock,
+// or no file at all) to the mapped layout.
+// ----------------------------------------------------------------------------
+static void prepare_file(int fd, const char *path, const AtomStock *initial) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat (mmap file)");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t magic = 0;
+    if (st.st_size >= (off_t)sizeof(magic) &&
+        pread(fd, &magic, sizeof(magic), 0) != sizeof(magic)) {
+        perror("pread (mmap file)");
+        exit(EXIT_FAILURE);
+    }
+    if (magic == SNAPSHOT_MMAP_MAGIC) {
+        // Already mapped before: the header is checked once it is mapped
+        Inventory head;
+        size_t len = offsetof(Inventory, stock);
+        off_t at = offsetof(SharedFile, inv);
+        if (st.st_size == (off_t)sizeof(SharedFile) &&
+            pread(fd, &head, len, at) == (ssize_t)len && (head.owner != 0 || (head.seq & 1))) {
+            // Somebody died between claiming and releasing the inventory
+            fprintf(stderr, "Warning: repairing interrupted update in mmap file\n");
+            head.seq  += head.seq & 1;
+            head.owner = 0;
+            if (pwrite(fd, &head, len, at) != (ssize_t)len) {
+                perror("pwrite (mmap file)");
+                exit(EXIT_FAILURE);
+            }
+        }
+        return;
+    }
+
+    SharedFile fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fill_header(&fresh);
+    fresh.inv.stock = *initial;
+    if (st.st_size >= (off_t)SNAPSHOT_RAW_SIZE) {
+        // A snapshot, or a legacy raw stock with the size and range checks
+        // of plain -f; anything else is refused
+        SnapshotEntry *entries;
+        size_t count;
+        SnapshotResult r = snapshot_load(path, &entries, &count);
+        if (r != SNAPSHOT_OK && r != SNAPSHOT_RAW) exit(EXIT_FAILURE);
+        if (count != 1 || entries[0].name[0] != '\0') {
+            fprintf(stderr, "Error: %s holds named warehouses, which --mmap cannot keep\n", path);
+            exit(EXIT_FAILURE);
+        }
+        fresh.inv.stock = entries[0].stock;
+        free(entries);
+    }
+    // Overwrite first, then cut off the rest of a (longer) snapshot
+    if (pwrite(fd, &fresh, sizeof(fresh), 0) != sizeof(fresh) ||
+        ftruncate(fd, sizeof(SharedFile)) < 0) {
+        perror("initialise mmap file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// check_mapped(): every process, once the file (of its own build) is
+// mapped. The lanes of the stock only mean the same atoms to processes with
+// the same --atoms list, so another list is refused.
+// ----------------------------------------------------------------------------
+static void check_mapped(const SharedFile *f, const char *path) {
+    SharedFile want;
+    memset(&want, 0, sizeof(want));
+    fill_header(&want);
+    if (f->atom_types != want.atom_types ||
+        memcmp(f->atom_names, want.atom_names, sizeof(want.atom_names)) != 0) {
+        char list[ATOM_TYPES_MAX * ATOM_NAME_MAX];
+        size_t len = 0;
+        for (unsigned id = 3; id < f->atom_types && id < ATOM_TYPES_MAX; id++) {
+            len += (size_t)snprintf(list + len, sizeof(list) - len, "%s%.*s", len ? "," : "",
+                                    ATOM_NAME_MAX, f->atom_names[id]);
+        }
+        list[len] = '\0';
+        fprintf(stderr, "Error: %s is mapped with --atoms \"%s\"; every process on it needs the same list\n",
+                path, list);
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned i = 0; i < ATOM_TYPES_MAX; i++) {
+        if (f->inv.stock.count[i] > MAX_ATOMS) {
+            fprintf(stderr, "Error: %s: mapped stock count out of range\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Background msync() every msync_ms milliseconds
+static void *msync_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&shm.lock);
+    while (!shm.stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += shm.msync_ms / 1000;
+        deadline.tv_nsec += (long)(shm.msync_ms % 1000) * 1000000L;
+        deadline.tv_sec  += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        if (pthread_cond_timedwait(&shm.wake, &shm.lock, &deadline) == ETIMEDOUT) {
+            if (msync(shm.file, sizeof(SharedFile), MS_SYNC) < 0) {
+                perror("msync");
+            }
+        }
+    }
+    pthread_mutex_unlock(&shm.lock);
+    return NULL;
+}
+
+Inventory *shared_inventory_open(const char *path, const AtomStock *initial,
+                                 unsigned msync_ms) {
+    shm.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (shm.fd < 0) {
+        perror("open (mmap file)");
+        exit(EXIT_FAILURE);
+    }
+
+    // Alone on the file? Then we may initialise / repair it. Otherwise the
+    // first process already did, and we only join in.
+    if (flock(shm.fd, LOCK_EX | LOCK_NB) == 0) {
+        prepare_file(shm.fd, path, initial);
+    }
+    if (flock(shm.fd, LOCK_SH) < 0) {
+        perror("flock LOCK_SH (mmap file)");
+        exit(EXIT_FAILURE);
+    }
+
+    // A file another process prepared may still be of another build
+    SharedFile head;
+    struct stat st;
+    if (fstat(shm.fd, &st) < 0 ||
+        pread(shm.fd, &head, offsetof(SharedFile, atom_names), 0) != offsetof(SharedFile, atom_names) ||
+        head.magic != SNAPSHOT_MMAP_MAGIC) {
+        fprintf(stderr, "Error: %s is not a mapped inventory\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (st.st_size != (off_t)sizeof(SharedFile) || head.lanes_max != ATOM_TYPES_MAX) {
+        fprintf(stderr, "Error: %s was mapped by a drinks_bar built with ATOM_TYPES_MAX=%u\n",
+                path, (unsigned)head.lanes_max);
+        exit(EXIT_FAILURE);
+    }
+    void *p = mmap(NULL, sizeof(SharedFile), PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    shm.file     = (SharedFile *)p;
+    shm.msync_ms = msync_ms;
+    check_mapped(shm.file, path);
+    inventory_share(&shm.file->inv);
+
+    if (msync_ms > 0) {
+        pthread_condattr_t ca;
+        pthread_condattr_init(&ca);
+        pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+        pthread_cond_init(&shm.wake, &ca);
+        pthread_condattr_destroy(&ca);
+        pthread_mutex_init(&shm.lock, NULL);
+        int rc = pthread_create(&shm.thread, NULL, msync_thread, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create (msync): %s\n", strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+    }
+    return &shm.file->inv;
+}
+
+void shared_inventory_close(void) {
+    if (shm.fd < 0) return;
+    if (shm.msync_ms > 0) {
+        pthread_mutex_lock(&shm.lock);
+        shm.stop = true;
+        pthread_cond_signal(&shm.wake);
+        pthread_mutex_unlock(&shm.lock);
+        pthread_join(shm.thread, NULL);
+    }
+    if (msync(shm.file, sizeof(SharedFile), MS_SYNC) < 0) {
+        perror("msync");
+    }
+    munmap(shm.file, sizeof(SharedFile));
+    close(shm.fd);     // drops our shared flock
+    shm.fd   = -1;
+    shm.file = NULL;
+}
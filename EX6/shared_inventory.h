@@ -0,0 +1,58 @@
+/*
+** shared_inventory.h -- the -f file mapped into memory (drinks_bar -f --mmap)
+**
+** The file holds the Inventory itself: it is mmap()ed MAP_SHARED and every
+** drinks_bar process pointing at it runs the seqlock protocol of inventory.c
+** directly on the mapped page. An ADD / DELIVER is a few atomic operations
+** on shared memory, with no read()/write() per request; the page cache
+** writes the page back, and msync() forces it out every --msync-ms
+** milliseconds (0 = only on shutdown).
+**
+** Layout (SharedFile below): a header with SNAPSHOT_MMAP_MAGIC, the
+** ATOM_TYPES_MAX of the build and the atom-type table of the --atoms list,
+** then the Inventory itself. Every process checks the header once it has
+** mapped the file and refuses another build or another --atoms list (also
+** another order), instead of reading the lanes as different atoms. A
+** snapshot file (snapshot.h) written by plain -f, --wal or --save-thread is
+** validated and converted to this layout when the first process opens it,
+** and so is a legacy raw stock (with the size and range checks of
+** snapshot.h). Plain -f refuses a mapped file. Do not mix --mmap and plain
+** -f processes on the same file.
+**
+** Every mapping process holds a shared flock() on the file. Whoever finds no
+** other holder (LOCK_EX succeeds) initialises the file and releases a
+** claim (owner word, odd sequence word) left by a process that crashed in
+** the middle of a publish. While peers are still running, the first of them
+** to wait 100 ms on such a claim finds its owner gone and takes it over to
+** close the publish (see inventory.c).
+*/
+
+#ifndef SHARED_INVENTORY_H
+#define SHARED_INVENTORY_H
+
+#include <stdint.h>          // uint16_t, uint32_t, uint64_t
+
+#include "inventory.h"       // Inventory, AtomStock
+#include "atoms.h"           // ATOM_NAME_MAX
+
+// The whole mapped file (host byte order)
+typedef struct {
+    uint64_t  magic;                                    // SNAPSHOT_MMAP_MAGIC
+    uint16_t  lanes_max;                                // ATOM_TYPES_MAX of the build
+    uint16_t  atom_types;                               // configured atom types
+    uint32_t  reserved;
+    char      atom_names[ATOM_TYPES_MAX][ATOM_NAME_MAX]; // "CARBON", ..., NUL padded
+    Inventory inv;
+} SharedFile;
+
+// Map `path` (created from `initial` if missing or smaller than a legacy
+// raw stock, converted if it is a snapshot or a legacy raw stock) and start
+// the msync thread if msync_ms > 0. Exits the process on any error,
+// including a file that is none of these.
+Inventory *shared_inventory_open(const char *path, const AtomStock *initial,
+                                 unsigned msync_ms);
+
+// Stop the msync thread, msync(MS_SYNC) and unmap.
+void shared_inventory_close(void);
+
+#endif // SHARED_INVENTORY_H
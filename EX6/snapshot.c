@@ -0,0 +1,297 @@
+/*
+** snapshot.c -- versioned, checksummed -f file (see snapshot.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "snapshot.h"
+
+#include <stdio.h>           // perror, fprintf, snprintf
+#include <stdlib.h>          // exit, malloc, calloc, free
+#include <string.h>          // memcpy, memset, strlen, strnlen, strrchr
+#include <stddef.h>          // offsetof
+#include <errno.h>           // errno, ENOENT, EINTR
+#include <unistd.h>          // pread, write, fdatasync, fsync, close, gettid
+#include <fcntl.h>           // open, O_*
+#include <sys/mman.h>        // mmap, munmap, madvise
+#include <sys/stat.h>        // fstat
+#include <sys/file.h>        // flock
+
+#include "atoms.h"           // atoms_count, atom_name, atom_find
+#include "crc32c.h"          // crc32c
+
+// Files up to this size are read with one pread(); larger ones are mapped
+#define SNAPSHOT_READ_MAX 4096
+#define SNAPSHOT_MAX_TYPES 256   // sanity limit on the atom-type table
+
+_Static_assert(ATOM_NAME_MAX == SNAPSHOT_ATOM_NAME, "an atom name is one table entry");
+
+// Highest sequence number loaded or written by this process
+static uint64_t last_seq;
+
+static void note_seq(uint64_t seq) {
+    uint64_t cur = __atomic_load_n(&last_seq, __ATOMIC_RELAXED);
+    while (cur < seq &&
+           !__atomic_compare_exchange_n(&last_seq, &cur, seq, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static SnapshotResult invalid(const char *path, const char *why) {
+    fprintf(stderr, "Error: %s: %s\n", path, why);
+    return SNAPSHOT_INVALID;
+}
+
+// ----------------------------------------------------------------------------
+// decode(): check the file image `p` (`size` bytes) and copy its inventories
+// out. The cheap header checks come first; the checksum is then accumulated
+// over each record while it is decoded, so the data is only touched once.
+// ----------------------------------------------------------------------------
+static SnapshotResult decode(const char *path, const unsigned char *p, size_t size,
+                             SnapshotEntry **entries, size_t *count) {
+    SnapshotHeader h;
+    if (size < sizeof(h)) return invalid(path, "truncated snapshot header");
+    memcpy(&h, p, sizeof(h));
+    if (h.endian != SNAPSHOT_ENDIAN) {
+        return invalid(path, h.endian == __builtin_bswap32(SNAPSHOT_ENDIAN)
+                             ? "snapshot was written with the other byte order"
+                             : "bad snapshot byte order marker");
+    }
+    if (h.version == 0 || h.version > SNAPSHOT_VERSION) {
+        return invalid(path, h.version > SNAPSHOT_VERSION
+                             ? "snapshot was written by a newer drinks_bar"
+                             : "unknown snapshot version");
+    }
+    size_t table  = (size_t)h.atom_types * SNAPSHOT_ATOM_NAME;
+    size_t names  = h.version >= 2 ? (size_t)h.inventories * SNAPSHOT_NAME_MAX : 0;
+    size_t record = (size_t)h.atom_types * sizeof(uint64_t);
+    if (h.atom_types == 0 || h.atom_types > SNAPSHOT_MAX_TYPES || h.inventories == 0 ||
+        size != sizeof(h) + table + names + (size_t)h.inventories * record) {
+        return invalid(path, "snapshot size does not match its header");
+    }
+
+    // Map every column of the file to a configured atom id
+    int column[SNAPSHOT_MAX_TYPES];
+    const unsigned char *types = p + sizeof(h);
+    for (size_t i = 0; i < h.atom_types; i++) {
+        const char *name = (const char *)types + i * SNAPSHOT_ATOM_NAME;
+        column[i] = atom_find(name, strnlen(name, SNAPSHOT_ATOM_NAME));
+        if (column[i] < 0) {
+            fprintf(stderr, "Error: %s: snapshot has atom type %.*s, which --atoms does not list\n",
+                    path, SNAPSHOT_ATOM_NAME, name);
+            return SNAPSHOT_INVALID;
+        }
+    }
+
+    SnapshotEntry *out = calloc(h.inventories, sizeof(SnapshotEntry));
+    if (!out) {
+        perror("calloc (snapshot)");
+        return SNAPSHOT_INVALID;
+    }
+    uint32_t crc = crc32c(0, p, offsetof(SnapshotHeader, crc));
+    crc = crc32c(crc, types, table + names);
+    const unsigned char *name = types + table;
+    const unsigned char *rec  = name + names;
+    bool well_formed = true;
+    for (size_t k = 0; k < h.inventories; k++, rec += record) {
+        crc = crc32c(crc, rec, record);
+        if (names) {
+            memcpy(out[k].name, name + k * SNAPSHOT_NAME_MAX, SNAPSHOT_NAME_MAX);
+            well_formed &= out[k].name[SNAPSHOT_NAME_MAX - 1] == '\0';
+        }
+        for (size_t i = 0; i < h.atom_types; i++) {
+            uint64_t v;
+            memcpy(&v, rec + i * sizeof(v), sizeof(v));
+            well_formed &= v <= MAX_ATOMS;
+            out[k].stock.count[column[i]] = v;
+        }
+    }
+    if (crc != h.crc || !well_formed) {
+        free(out);
+        return invalid(path, crc != h.crc ? "snapshot checksum mismatch"
+                                          : "snapshot has a malformed name or count");
+    }
+    note_seq(h.seq);
+    *entries = out;
+    *count   = h.inventories;
+    return SNAPSHOT_OK;
+}
+
+// ----------------------------------------------------------------------------
+// decode_raw(): a file without the magic. Only the two legacy sizes with
+// counts in range are a raw stock; anything else (a snapshot with a damaged
+// magic, a foreign file) is refused instead of being read as atom counts.
+// ----------------------------------------------------------------------------
+static SnapshotResult decode_raw(const char *path, const unsigned char *p, size_t size,
+                                 SnapshotEntry **entries, size_t *count) {
+    uint64_t magic;
+    memcpy(&magic, p, sizeof(magic));
+    if (magic == SNAPSHOT_MMAP_MAGIC) {
+        return invalid(path, "file is mapped by --mmap; start with --mmap to use it");
+    }
+    if (size != SNAPSHOT_RAW_SIZE && size != SNAPSHOT_LEGACY_MMAP_SIZE) {
+        return invalid(path, "not a snapshot (bad magic)");
+    }
+    uint64_t raw[SNAPSHOT_RAW_SIZE / sizeof(uint64_t)];
+    memcpy(raw, p, SNAPSHOT_RAW_SIZE);
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+        if (raw[i] > MAX_ATOMS) return invalid(path, "raw stock count out of range");
+    }
+    if ((*entries = calloc(1, sizeof(SnapshotEntry))) == NULL) {
+        perror("calloc (snapshot)");
+        return SNAPSHOT_INVALID;
+    }
+    memcpy((*entries)->stock.count, raw, SNAPSHOT_RAW_SIZE);
+    *count = 1;
+    return SNAPSHOT_RAW;
+}
+
+SnapshotResult snapshot_load(const char *path, SnapshotEntry **entries, size_t *count) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) return SNAPSHOT_MISSING;
+        perror("open (snapshot)");
+        return SNAPSHOT_INVALID;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat (snapshot)");
+        close(fd);
+        return SNAPSHOT_INVALID;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < SNAPSHOT_RAW_SIZE) {
+        close(fd);
+        return SNAPSHOT_MISSING;
+    }
+
+    unsigned char small[SNAPSHOT_READ_MAX];
+    const unsigned char *p = small;
+    if (size <= sizeof(small)) {
+        if (pread(fd, small, size, 0) != (ssize_t)size) {
+            perror("pread (snapshot)");
+            close(fd);
+            return SNAPSHOT_INVALID;
+        }
+    } else {
+        p = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap (snapshot)");
+            close(fd);
+            return SNAPSHOT_INVALID;
+        }
+        madvise((void *)p, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    SnapshotResult r;
+    uint64_t magic;
+    memcpy(&magic, p, sizeof(magic));
+    if (magic == SNAPSHOT_MAGIC) {
+        r = decode(path, p, size, entries, count);
+    } else {
+        r = decode_raw(path, p, size, entries, count);
+    }
+    if (p != small) munmap((void *)p, size);
+    return r;
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p   += w;
+        len -= (size_t)w;
+    }
+    return true;
+}
+
+// fsync() the directory holding `path`, so a rename() in it is durable
+static void sync_dir(const char *path) {
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+    if (slash) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path + 1), path);
+    else       snprintf(dir, sizeof(dir), ".");
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+}
+
+bool snapshot_write(const char *path, const SnapshotEntry *entries, size_t count, bool durable) {
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic       = SNAPSHOT_MAGIC;
+    h.endian      = SNAPSHOT_ENDIAN;
+    h.version     = SNAPSHOT_VERSION;
+    h.atom_types  = (uint16_t)atoms_count();
+    h.seq         = __atomic_add_fetch(&last_seq, 1, __ATOMIC_RELAXED);
+    h.inventories = (uint32_t)count;
+
+    size_t table  = h.atom_types * SNAPSHOT_ATOM_NAME;
+    size_t names  = count * SNAPSHOT_NAME_MAX;
+    size_t record = h.atom_types * sizeof(uint64_t);
+    size_t size   = sizeof(h) + table + names + count * record;
+    unsigned char small[SNAPSHOT_READ_MAX];
+    unsigned char *buf = size <= sizeof(small) ? small : malloc(size);
+    if (!buf) {
+        perror("malloc (snapshot)");
+        return false;
+    }
+    unsigned char *types = buf + sizeof(h);
+    memset(types, 0, table);
+    for (unsigned t = 0; t < h.atom_types; t++) {
+        memcpy(types + t * SNAPSHOT_ATOM_NAME, atom_name(t), strlen(atom_name(t)));
+    }
+    unsigned char *rec = types + table + names;
+    for (size_t k = 0; k < count; k++) {
+        memcpy(types + table + k * SNAPSHOT_NAME_MAX, entries[k].name, SNAPSHOT_NAME_MAX);
+        // A record is the head of an AtomStock: its lanes in atom id order
+        memcpy(rec + k * record, entries[k].stock.count, record);
+    }
+    h.crc = crc32c(crc32c(0, &h, offsetof(SnapshotHeader, crc)), types, size - sizeof(h));
+    memcpy(buf, &h, sizeof(h));
+    // Every writing thread has its own temporary file
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)gettid());
+    bool ok = false;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open (snapshot tmp)");
+    } else if (!write_all(fd, buf, size) || (durable && fdatasync(fd) < 0)) {
+        perror("write (snapshot tmp)");
+        close(fd);
+        unlink(tmp);
+    } else {
+        close(fd);
+        if (rename(tmp, path) < 0) {
+            perror("rename (snapshot)");
+            unlink(tmp);
+        } else {
+            if (durable) sync_dir(path);
+            ok = true;
+        }
+    }
+    if (buf != small) free(buf);
+    return ok;
+}
+
+int snapshot_lock(const char *path) {
+    char lock_path[4096];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    int fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open (snapshot lock)");
+        exit(EXIT_FAILURE);
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        fprintf(stderr, "Error: %s is in use by another drinks_bar\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
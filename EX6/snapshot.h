@@ -0,0 +1,93 @@
+/*
+** snapshot.h -- on-disk format of the drinks_bar -f file
+**
+** Layout (host byte order, all integers naturally aligned):
+**
+**   SnapshotHeader                              32 bytes
+**   atom-type table   atom_types x char[16]     "CARBON", "OXYGEN", ...
+**   name table        inventories x char[32]    warehouse names, "" = default
+**   stock records     inventories x atom_types x uint64_t
+**
+** Version 1 had no name table (one unnamed inventory); it is still read.
+**
+** The CRC-32C covers the header up to `crc` and everything after the
+** header. `endian` tells a file written on a host of the other byte order
+** apart from a corrupt one, and the atom-type table lets a reader map the
+** columns by name instead of by position. `seq` grows by one with every
+** write of the file (continuing from the value that was loaded).
+**
+** A file is only ever replaced as a whole: the new snapshot is written to
+** "<file>.tmp.<tid>" and renamed over the old one, so a reader sees either
+** the old or the new snapshot, never a mix. Since the file's inode changes
+** on every write, the process that writes it holds an flock() on
+** "<file>.lock" instead (snapshot_lock()).
+**
+** The writer stores one column per configured atom type (atoms.h); a reader
+** needs every column's type in its own --atoms list. Entries come back as
+** AtomStocks with the lanes of the other types zero.
+**
+** A file without the magic is a legacy raw carbon, oxygen, hydrogen stock
+** (the format before this one) only if it is exactly SNAPSHOT_RAW_SIZE
+** bytes, or SNAPSHOT_LEGACY_MMAP_SIZE bytes (a --mmap file of that time,
+** the stock followed by its sequence word), and every count is at most
+** MAX_ATOMS. It is then loaded and converted by the next write. Any other
+** file without the magic is refused, like a damaged snapshot; so is a file
+** in the --mmap layout (SNAPSHOT_MMAP_MAGIC).
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint16_t, uint32_t, uint64_t
+
+#include "inventory.h"       // AtomStock
+
+#define SNAPSHOT_MAGIC       0x50414E534B4E5244ull   // "DRNKSNAP"
+#define SNAPSHOT_MMAP_MAGIC  0x50414D4D4B4E5244ull   // "DRNKMMAP", a --mmap file (shared_inventory.h)
+#define SNAPSHOT_ENDIAN      0x01020304u
+#define SNAPSHOT_VERSION     2
+#define SNAPSHOT_ATOM_NAME   16                      // bytes per atom-type entry
+#define SNAPSHOT_NAME_MAX    32                      // bytes per warehouse name
+#define SNAPSHOT_RAW_SIZE    (3 * sizeof(uint64_t))  // legacy raw stock
+#define SNAPSHOT_LEGACY_MMAP_SIZE 64                 // legacy raw stock + seq, one line
+
+typedef struct {
+    uint64_t magic;        // SNAPSHOT_MAGIC
+    uint32_t endian;       // SNAPSHOT_ENDIAN as the writer stored it
+    uint16_t version;      // SNAPSHOT_VERSION
+    uint16_t atom_types;   // entries in the atom-type table
+    uint64_t seq;          // write sequence number of this file
+    uint32_t inventories;  // named stock records after the atom-type table
+    uint32_t crc;          // CRC-32C, see above
+} SnapshotHeader;
+
+// One inventory of the file
+typedef struct {
+    char      name[SNAPSHOT_NAME_MAX];   // NUL-terminated, "" = default
+    AtomStock stock;
+} SnapshotEntry;
+
+typedef enum {
+    SNAPSHOT_OK = 0,       // valid snapshot
+    SNAPSHOT_RAW,          // legacy raw stock (one unnamed inventory)
+    SNAPSHOT_MISSING,      // no file, or too short to hold any stock
+    SNAPSHOT_INVALID       // damaged or unsupported; the reason went to stderr
+} SnapshotResult;
+
+// Validate `path` and load its inventories into a malloc()ed array
+// (*entries, to be freed by the caller, *count entries). Large files are
+// mmap()ed and checksummed while they are decoded, in a single pass.
+SnapshotResult snapshot_load(const char *path, SnapshotEntry **entries, size_t *count);
+
+// Atomically replace `path` with `count` inventories. With `durable` the
+// data and the rename are fsync()ed before returning. Thread-safe.
+bool snapshot_write(const char *path, const SnapshotEntry *entries, size_t count, bool durable);
+
+// Make this process the only writer of `path`: flock LOCK_EX on
+// "<path>.lock", kept until the returned descriptor is closed. Exits the
+// process if another drinks_bar holds it or the lock file cannot be opened.
+int snapshot_lock(const char *path);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,446 @@
+/*
+** stats.c -- per-thread request counters, STATS text and metrics endpoint
+**            (see stats.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "stats.h"
+
+#include <stdio.h>           // snprintf, vsnprintf, perror, fprintf
+#include <stdlib.h>          // posix_memalign, malloc, free, exit
+#include <string.h>          // memset, strncmp, strlen
+#include <stdarg.h>          // va_list
+#include <stdbool.h>         // bool
+#include <unistd.h>          // close, read, write
+#include <errno.h>           // errno
+#include <netdb.h>           // getaddrinfo
+#include <poll.h>            // poll
+#include <pthread.h>         // pthread_create, pthread_join
+#include <sys/socket.h>      // socket, bind, listen, accept, setsockopt
+#include <sys/time.h>        // struct timeval (SO_RCVTIMEO)
+#include <sys/eventfd.h>     // eventfd (stop the HTTP thread)
+
+#define HTTP_REQUEST_MAX   4096              // request head we are willing to read
+#define HTTP_RESPONSE_MAX  65536             // metrics page (truncated beyond)
+#define HTTP_TIMEOUT_S     1                 // a scraper that sends nothing is dropped
+
+static StatsShard *shards   = NULL;
+static unsigned    n_shards = 0;
+
+static const char *const transport_name[STATS_TRANSPORTS] = {
+    "tcp", "udp", "uds_stream", "uds_dgram"
+};
+
+static const char *const op_name[STATS_OPS] = { "add", "deliver", "other" };
+
+// The text after "ERROR: " of each StatsError, as drinks_bar sends it
+static const char *const error_text[STATS_ERRORS] = {
+    "invalid command",
+    "invalid atom type",
+    "invalid molecule type",
+    "missing number",
+    "too many arguments",
+    "invalid number",
+    "number too large",
+    "capacity exceeded",
+    "not enough carbon atoms",
+    "not enough oxygen atoms",
+    "not enough hydrogen atoms",
+    "invalid warehouse",
+    "unknown warehouse",
+    "too many warehouses",
+    "line too long",
+    "request timeout",
+    "unknown error"
+};
+
+// Percentiles reported for every latency histogram
+static const double quantiles[] = { 50.0, 90.0, 99.0, 99.9 };
+#define NUM_QUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+void stats_init(unsigned count) {
+    void *mem;
+    if (posix_memalign(&mem, 64, count * sizeof(StatsShard)) != 0) {
+        fprintf(stderr, "stats: cannot allocate %u shards\n", count);
+        exit(EXIT_FAILURE);
+    }
+    shards   = mem;
+    n_shards = count;
+    memset(shards, 0, count * sizeof(StatsShard));
+    for (unsigned i = 0; i < count; i++) {
+        for (int t = 0; t < STATS_TRANSPORTS; t++) {
+            for (int op = 0; op < STATS_OPS; op++) {
+                histogram_init(&shards[i].t[t].latency[op]);
+            }
+        }
+    }
+}
+
+StatsShard *stats_shard(unsigned i) {
+    return &shards[i];
+}
+
+// ----------------------------------------------------------------------------
+// Recording (owner thread only): the same steps as histogram_record(), with
+// relaxed stores so that a concurrent reader sees whole values.
+// ----------------------------------------------------------------------------
+static void record_latency(Histogram *h, uint64_t ns) {
+    stats_add(&h->buckets[histogram_bucket(ns)], 1);
+    stats_add(&h->count, 1);
+    double sum;
+    __atomic_load(&h->sum, &sum, __ATOMIC_RELAXED);
+    sum += (double)ns;
+    __atomic_store(&h->sum, &sum, __ATOMIC_RELAXED);
+    if (ns < __atomic_load_n(&h->min, __ATOMIC_RELAXED)) __atomic_store_n(&h->min, ns, __ATOMIC_RELAXED);
+    if (ns > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) __atomic_store_n(&h->max, ns, __ATOMIC_RELAXED);
+}
+
+void stats_request(StatsShard *s, StatsTransport t, StatsOp op, uint64_t ns, StatsError err) {
+    StatsCounters *c = &s->t[t];
+    stats_add(&c->requests, 1);
+    if (err != STATS_ERR_NONE) stats_add(&c->errors[err], 1);
+    record_latency(&c->latency[op], ns);
+}
+
+void stats_error(StatsShard *s, StatsTransport t, StatsError err) {
+    stats_add(&s->t[t].errors[err], 1);
+}
+
+StatsError stats_error_of(const char *reply) {
+    if (strncmp(reply, "ERROR: ", 7) != 0) return STATS_ERR_NONE;
+    const char *text = reply + 7;
+    for (int e = 0; e < STATS_ERRORS; e++) {
+        size_t n = strlen(error_text[e]);
+        if (strncmp(text, error_text[e], n) == 0 && (text[n] == '\n' || text[n] == '\0')) {
+            return (StatsError)e;
+        }
+    }
+    return STATS_ERR_UNKNOWN;
+}
+
+// ----------------------------------------------------------------------------
+// Reading: add every shard up with relaxed loads.
+// ----------------------------------------------------------------------------
+static void load_histogram(Histogram *dst, const Histogram *src) {
+    Histogram h;
+    h.count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    h.min   = __atomic_load_n(&src->min, __ATOMIC_RELAXED);
+    h.max   = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    __atomic_load(&src->sum, &h.sum, __ATOMIC_RELAXED);
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        h.buckets[b] = __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+    }
+    histogram_merge(dst, &h);
+}
+
+// Sum of all shards, one StatsCounters per transport (caller frees)
+static StatsCounters *stats_sum(void) {
+    StatsCounters *sum = malloc(STATS_TRANSPORTS * sizeof(StatsCounters));
+    if (!sum) return NULL;
+    memset(sum, 0, STATS_TRANSPORTS * sizeof(StatsCounters));
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        StatsCounters *c = &sum[t];
+        for (int op = 0; op < STATS_OPS; op++) {
+            histogram_init(&c->latency[op]);
+        }
+        for (unsigned i = 0; i < n_shards; i++) {
+            const StatsCounters *s = &shards[i].t[t];
+            c->requests     += __atomic_load_n(&s->requests, __ATOMIC_RELAXED);
+            c->bytes_in     += __atomic_load_n(&s->bytes_in, __ATOMIC_RELAXED);
+            c->bytes_out    += __atomic_load_n(&s->bytes_out, __ATOMIC_RELAXED);
+            c->conns_opened += __atomic_load_n(&s->conns_opened, __ATOMIC_RELAXED);
+            c->conns_closed += __atomic_load_n(&s->conns_closed, __ATOMIC_RELAXED);
+            c->replies_dropped += __atomic_load_n(&s->replies_dropped, __ATOMIC_RELAXED);
+            for (int e = 0; e < STATS_ERRORS; e++) {
+                c->errors[e] += __atomic_load_n(&s->errors[e], __ATOMIC_RELAXED);
+            }
+            for (int op = 0; op < STATS_OPS; op++) {
+                load_histogram(&c->latency[op], &s->latency[op]);
+            }
+        }
+    }
+    return sum;
+}
+
+// ----------------------------------------------------------------------------
+// Output. Out collects formatted text and silently stops at the end of buf.
+// ----------------------------------------------------------------------------
+typedef struct {
+    char  *buf;
+    size_t size;
+    size_t len;
+} Out;
+
+static void put(Out *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put(Out *o, const char *fmt, ...) {
+    if (o->len + 1 >= o->size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    o->len += (size_t)n;
+    if (o->len >= o->size) o->len = o->size - 1;
+}
+
+static bool is_stream(int t) {
+    return t == STATS_TCP || t == STATS_UDS_STREAM;
+}
+
+size_t stats_format_text(char *buf, size_t size) {
+    Out o = { buf, size, 0 };
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    StatsCounters *sum = stats_sum();
+    if (!sum) {
+        put(&o, "ERROR: out of memory\n");
+        return o.len;
+    }
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        const StatsCounters *c = &sum[t];
+        const char *name = transport_name[t];
+        put(&o, "STAT %s requests %llu\n", name, (unsigned long long)c->requests);
+        put(&o, "STAT %s bytes_in %llu\n", name, (unsigned long long)c->bytes_in);
+        put(&o, "STAT %s bytes_out %llu\n", name, (unsigned long long)c->bytes_out);
+        if (!is_stream(t)) {
+            put(&o, "STAT %s replies_dropped %llu\n", name, (unsigned long long)c->replies_dropped);
+        } else {
+            put(&o, "STAT %s connections_active %llu\n", name,
+                (unsigned long long)(c->conns_opened - c->conns_closed));
+            put(&o, "STAT %s connections_total %llu\n", name, (unsigned long long)c->conns_opened);
+        }
+        for (int e = 0; e < STATS_ERRORS; e++) {
+            if (c->errors[e] == 0) continue;
+            put(&o, "STAT %s error \"%s\" %llu\n", name, error_text[e],
+                (unsigned long long)c->errors[e]);
+        }
+        for (int op = 0; op < STATS_OPS; op++) {
+            const Histogram *h = &c->latency[op];
+            if (h->count == 0) continue;
+            put(&o, "STAT %s latency_us %s count=%llu mean=%.1f", name, op_name[op],
+                (unsigned long long)h->count, histogram_mean(h) / 1e3);
+            for (size_t q = 0; q < NUM_QUANTILES; q++) {
+                put(&o, " p%g=%.1f", quantiles[q], (double)histogram_percentile(h, quantiles[q]) / 1e3);
+            }
+            put(&o, " max=%.1f\n", (double)h->max / 1e3);
+        }
+    }
+    put(&o, "END\n");
+    free(sum);
+    return o.len;
+}
+
+size_t stats_format_prometheus(char *buf, size_t size) {
+    Out o = { buf, size, 0 };
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    StatsCounters *sum = stats_sum();
+    if (!sum) return 0;
+
+    put(&o, "# HELP drinks_bar_requests_total Requests served.\n"
+            "# TYPE drinks_bar_requests_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        put(&o, "drinks_bar_requests_total{transport=\"%s\"} %llu\n",
+            transport_name[t], (unsigned long long)sum[t].requests);
+    }
+    put(&o, "# HELP drinks_bar_errors_total Requests answered with an error, by error.\n"
+            "# TYPE drinks_bar_errors_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        for (int e = 0; e < STATS_ERRORS; e++) {
+            put(&o, "drinks_bar_errors_total{transport=\"%s\",error=\"%s\"} %llu\n",
+                transport_name[t], error_text[e], (unsigned long long)sum[t].errors[e]);
+        }
+    }
+    put(&o, "# HELP drinks_bar_received_bytes_total Request bytes received.\n"
+            "# TYPE drinks_bar_received_bytes_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        put(&o, "drinks_bar_received_bytes_total{transport=\"%s\"} %llu\n",
+            transport_name[t], (unsigned long long)sum[t].bytes_in);
+    }
+    put(&o, "# HELP drinks_bar_sent_bytes_total Reply bytes sent.\n"
+            "# TYPE drinks_bar_sent_bytes_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        put(&o, "drinks_bar_sent_bytes_total{transport=\"%s\"} %llu\n",
+            transport_name[t], (unsigned long long)sum[t].bytes_out);
+    }
+    put(&o, "# HELP drinks_bar_dropped_replies_total Datagram replies dropped (client queue full).\n"
+            "# TYPE drinks_bar_dropped_replies_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        if (is_stream(t)) continue;
+        put(&o, "drinks_bar_dropped_replies_total{transport=\"%s\"} %llu\n",
+            transport_name[t], (unsigned long long)sum[t].replies_dropped);
+    }
+    put(&o, "# HELP drinks_bar_connections_active Open stream connections.\n"
+            "# TYPE drinks_bar_connections_active gauge\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        if (!is_stream(t)) continue;
+        put(&o, "drinks_bar_connections_active{transport=\"%s\"} %llu\n", transport_name[t],
+            (unsigned long long)(sum[t].conns_opened - sum[t].conns_closed));
+    }
+    put(&o, "# HELP drinks_bar_connections_total Stream connections accepted.\n"
+            "# TYPE drinks_bar_connections_total counter\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        if (!is_stream(t)) continue;
+        put(&o, "drinks_bar_connections_total{transport=\"%s\"} %llu\n",
+            transport_name[t], (unsigned long long)sum[t].conns_opened);
+    }
+    put(&o, "# HELP drinks_bar_request_duration_seconds Time spent serving a request.\n"
+            "# TYPE drinks_bar_request_duration_seconds summary\n");
+    for (int t = 0; t < STATS_TRANSPORTS; t++) {
+        for (int op = 0; op < STATS_OPS; op++) {
+            const Histogram *h = &sum[t].latency[op];
+            const char *labels_t = transport_name[t], *labels_op = op_name[op];
+            for (size_t q = 0; q < NUM_QUANTILES; q++) {
+                if (h->count == 0) {
+                    put(&o, "drinks_bar_request_duration_seconds{transport=\"%s\",op=\"%s\",quantile=\"%g\"} NaN\n",
+                        labels_t, labels_op, quantiles[q] / 100.0);
+                } else {
+                    put(&o, "drinks_bar_request_duration_seconds{transport=\"%s\",op=\"%s\",quantile=\"%g\"} %.9f\n",
+                        labels_t, labels_op, quantiles[q] / 100.0,
+                        (double)histogram_percentile(h, quantiles[q]) / 1e9);
+                }
+            }
+            put(&o, "drinks_bar_request_duration_seconds_sum{transport=\"%s\",op=\"%s\"} %.9f\n",
+                labels_t, labels_op, h->sum / 1e9);
+            put(&o, "drinks_bar_request_duration_seconds_count{transport=\"%s\",op=\"%s\"} %llu\n",
+                labels_t, labels_op, (unsigned long long)h->count);
+        }
+    }
+    free(sum);
+    return o.len;
+}
+
+// ----------------------------------------------------------------------------
+// Metrics endpoint: one thread, one blocking client at a time. A scrape is
+// rare and small, so it never needs to share an event loop with requests.
+// ----------------------------------------------------------------------------
+static int       http_fd   = -1;
+static int       http_stop = -1;   // eventfd, readable once stats_free() runs
+static pthread_t http_thread;
+
+static void write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static void http_serve_client(int fd, char *page) {
+    struct timeval tv = { HTTP_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Read the request head; only its first line matters
+    char req[HTTP_REQUEST_MAX];
+    size_t have = 0;
+    while (have < sizeof(req) - 1) {
+        ssize_t n = read(fd, req + have, sizeof(req) - 1 - have);
+        if (n <= 0) break;
+        have += (size_t)n;
+        req[have] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[have] = '\0';
+
+    const char *status = "200 OK";
+    size_t len = 0;
+    if (strncmp(req, "GET ", 4) != 0) {
+        status = "400 Bad Request";
+    } else if (strncmp(req + 4, "/metrics ", 9) != 0 && strncmp(req + 4, "/ ", 2) != 0) {
+        status = "404 Not Found";
+    } else {
+        len = stats_format_prometheus(page, HTTP_RESPONSE_MAX);
+    }
+    char head[160];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.0 %s\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", status, len);
+    write_all(fd, head, (size_t)n);
+    write_all(fd, page, len);
+}
+
+static void *http_main(void *arg) {
+    (void)arg;
+    char *page = malloc(HTTP_RESPONSE_MAX);
+    if (!page) {
+        perror("malloc (metrics page)");
+        return NULL;
+    }
+    struct pollfd pfd[2] = {
+        { .fd = http_fd,   .events = POLLIN },
+        { .fd = http_stop, .events = POLLIN },
+    };
+    while (1) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll (metrics)");
+            break;
+        }
+        if (pfd[1].revents) break;
+        int fd = accept(http_fd, NULL, NULL);
+        if (fd < 0) continue;
+        http_serve_client(fd, page);
+        close(fd);
+    }
+    free(page);
+    return NULL;
+}
+
+void stats_http_start(const char *port) {
+    struct addrinfo hints, *res, *p;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    int rv = getaddrinfo(NULL, port, &hints, &res);
+    if (rv != 0) {
+        fprintf(stderr, "getaddrinfo (metrics): %s\n", gai_strerror(rv));
+        exit(EXIT_FAILURE);
+    }
+    for (p = res; p != NULL; p = p->ai_next) {
+        http_fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (http_fd < 0) continue;
+        int yes = 1;
+        setsockopt(http_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (bind(http_fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(http_fd);
+        http_fd = -1;
+    }
+    freeaddrinfo(res);
+    if (http_fd < 0 || listen(http_fd, 16) < 0) {
+        perror("bind/listen (metrics)");
+        exit(EXIT_FAILURE);
+    }
+    http_stop = eventfd(0, EFD_NONBLOCK);
+    if (http_stop < 0) {
+        perror("eventfd (metrics)");
+        exit(EXIT_FAILURE);
+    }
+    int rc = pthread_create(&http_thread, NULL, http_main, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "pthread_create (metrics): %s\n", strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+}
+
+void stats_free(void) {
+    if (http_fd >= 0) {
+        uint64_t one = 1;
+        if (write(http_stop, &one, sizeof(one)) < 0) {
+            perror("write (metrics stop)");
+        }
+        pthread_join(http_thread, NULL);
+        close(http_fd);
+        close(http_stop);
+        http_fd = http_stop = -1;
+    }
+    free(shards);
+    shards   = NULL;
+    n_shards = 0;
+}
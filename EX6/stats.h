@@ -0,0 +1,125 @@
+/*
+** stats.h -- per-transport request counters and latency histograms
+**
+** Every event-loop thread owns one StatsShard and is the only writer of it:
+** counters are bumped with a relaxed load + store (a plain add, no locked
+** instruction) and each shard starts on its own cache line, so counting
+** costs the hot path no sharing at all. Readers (the STATS command and the
+** metrics endpoint) add the shards up with relaxed loads; a value may be a
+** few requests behind, never torn.
+**
+** Per transport:
+**   requests, errors by kind, bytes received / sent, dropped datagram
+**   replies, stream connections opened / closed (active = opened - closed),
+**   and a log-linear histogram
+**   of the service time (parse + inventory update + persistence) per
+**   operation.
+**
+** Output:
+**   stats_format_text()        "STAT ..." lines ended by "END" (STATS command)
+**   stats_format_prometheus()  Prometheus text exposition format
+**   stats_http_start()         serves the latter on its own port and thread
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint64_t
+#include <time.h>            // clock_gettime
+
+#include "histogram.h"       // Histogram
+
+typedef enum {
+    STATS_TCP,
+    STATS_UDP,
+    STATS_UDS_STREAM,
+    STATS_UDS_DGRAM,
+    STATS_TRANSPORTS
+} StatsTransport;
+
+typedef enum {
+    STATS_OP_ADD,
+    STATS_OP_DELIVER,
+    STATS_OP_OTHER,          // neither ADD nor DELIVER (invalid, STATS, ...)
+    STATS_OPS
+} StatsOp;
+
+// One per "ERROR: <text>" reply the server can send
+typedef enum {
+    STATS_ERR_NONE = -1,
+    STATS_ERR_INVALID_COMMAND,
+    STATS_ERR_INVALID_ATOM,
+    STATS_ERR_INVALID_MOLECULE,
+    STATS_ERR_MISSING_NUMBER,
+    STATS_ERR_TOO_MANY_ARGS,
+    STATS_ERR_INVALID_NUMBER,
+    STATS_ERR_NUMBER_TOO_LARGE,
+    STATS_ERR_CAPACITY_EXCEEDED,
+    STATS_ERR_NOT_ENOUGH_CARBON,
+    STATS_ERR_NOT_ENOUGH_OXYGEN,
+    STATS_ERR_NOT_ENOUGH_HYDROGEN,
+    STATS_ERR_INVALID_WAREHOUSE,
+    STATS_ERR_UNKNOWN_WAREHOUSE,
+    STATS_ERR_TOO_MANY_WAREHOUSES,
+    STATS_ERR_LINE_TOO_LONG,
+    STATS_ERR_REQUEST_TIMEOUT,
+    STATS_ERR_UNKNOWN,
+    STATS_ERRORS
+} StatsError;
+
+typedef struct {
+    uint64_t  requests;
+    uint64_t  bytes_in;
+    uint64_t  bytes_out;
+    uint64_t  conns_opened;            // stream transports only
+    uint64_t  conns_closed;
+    uint64_t  replies_dropped;         // datagram replies the client could not take
+    uint64_t  errors[STATS_ERRORS];
+    Histogram latency[STATS_OPS];      // nanoseconds
+} StatsCounters;
+
+typedef struct {
+    StatsCounters t[STATS_TRANSPORTS];
+} __attribute__((aligned(64))) StatsShard;
+
+// Allocate `shards` zeroed shards (one per event-loop thread). Exits on error.
+void stats_init(unsigned shards);
+
+StatsShard *stats_shard(unsigned i);
+
+// Stop the metrics endpoint (if any) and free the shards
+void stats_free(void);
+
+// counter += n, for the shard's own thread only
+static inline void stats_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// One served request of operation `op` that took `ns` nanoseconds;
+// `err` is STATS_ERR_NONE or the error it was answered with.
+void stats_request(StatsShard *s, StatsTransport t, StatsOp op, uint64_t ns, StatsError err);
+
+// An error that is not the answer to a request (e.g. a request timeout)
+void stats_error(StatsShard *s, StatsTransport t, StatsError err);
+
+// The StatsError of a text reply: STATS_ERR_NONE unless it is "ERROR: ..."
+StatsError stats_error_of(const char *reply);
+
+// Write every shard's sum into `buf`; return the length, truncated to
+// size - 1. The text form is "STAT <transport> <name> <value>" lines
+// (only non-zero errors, latency in microseconds) and a final "END".
+size_t stats_format_text(char *buf, size_t size);
+size_t stats_format_prometheus(char *buf, size_t size);
+
+// Answer every HTTP request on `port` with stats_format_prometheus(), from a
+// thread of its own. Exits the process if the port cannot be bound.
+void stats_http_start(const char *port);
+
+#endif // STATS_H
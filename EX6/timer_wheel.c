@@ -0,0 +1,181 @@
+/*
+** timer_wheel.c -- hierarchical timing wheel (see timer_wheel.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "timer_wheel.h"
+
+#include <limits.h>          // INT_MAX
+#include <time.h>            // clock_gettime
+
+#define TW_MASK (TW_SLOTS - 1)
+
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void list_init(Timer *head) {
+    head->next = head->prev = head;
+}
+
+static bool list_empty(const Timer *head) {
+    return head->next == head;
+}
+
+static void list_add(Timer *head, Timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void list_del(Timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *w, uint64_t now) {
+    w->now   = now;
+    w->count = 0;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (unsigned s = 0; s < TW_SLOTS; s++) {
+            list_init(&w->slots[l][s]);
+        }
+    }
+}
+
+void timer_init(Timer *t, void (*fn)(Timer *t, uint64_t now)) {
+    t->next = t->prev = NULL;
+    t->wheel   = NULL;
+    t->expires = 0;
+    t->fn      = fn;
+}
+
+// ----------------------------------------------------------------------------
+// place(): level 0 holds the next 63 ms, one slot per tick. Level L > 0 holds
+// 64^L ms per slot and is chosen so the timer's level-L block is less than 64
+// blocks ahead; its slot is moved down one level when that block starts.
+// `earliest` is the first tick whose slot has not been run yet.
+// ----------------------------------------------------------------------------
+static void place(TimerWheel *w, Timer *t, uint64_t earliest) {
+    uint64_t expires = t->expires > earliest ? t->expires : earliest;
+    if (expires - w->now < TW_SLOTS) {
+        list_add(&w->slots[0][expires & TW_MASK], t);
+        return;
+    }
+    for (int l = 1; l < TW_LEVELS; l++) {
+        uint64_t block = expires >> (TW_BITS * l);
+        uint64_t cur   = w->now >> (TW_BITS * l);
+        if (block - cur < TW_SLOTS) {
+            list_add(&w->slots[l][block & TW_MASK], t);
+            return;
+        }
+    }
+    // Beyond the wheel: park in the farthest top-level slot and try again later
+    uint64_t cur = w->now >> (TW_BITS * (TW_LEVELS - 1));
+    list_add(&w->slots[TW_LEVELS - 1][(cur + TW_MASK) & TW_MASK], t);
+}
+
+void timer_arm(TimerWheel *w, Timer *t, uint64_t expires) {
+    if (timer_armed(t)) timer_cancel(t);
+    t->wheel   = w;
+    t->expires = expires;
+    place(w, t, w->now + 1);
+    w->count++;
+}
+
+void timer_cancel(Timer *t) {
+    if (!timer_armed(t)) return;
+    list_del(t);
+    t->wheel->count--;
+}
+
+// Move every timer of a slot to the list `to`
+static void splice(Timer *from, Timer *to) {
+    list_init(to);
+    if (list_empty(from)) return;
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    list_init(from);
+}
+
+static void cascade(TimerWheel *w, int level) {
+    Timer pending;
+    splice(&w->slots[level][(w->now >> (TW_BITS * level)) & TW_MASK], &pending);
+    while (!list_empty(&pending)) {
+        Timer *t = pending.next;
+        list_del(t);
+        place(w, t, w->now);        // the current tick's slot runs right after
+    }
+}
+
+void timer_wheel_advance(TimerWheel *w, uint64_t now) {
+    if (w->count == 0) {
+        if (now > w->now) w->now = now;
+        return;
+    }
+    while (w->now < now) {
+        // Jump over the ticks where no slot has anything to run or cascade
+        if (list_empty(&w->slots[0][(w->now + 1) & TW_MASK])) {
+            uint64_t idle = (uint64_t)timer_wheel_timeout_ms(w);
+            if (idle > 1) {
+                if (w->now + idle - 1 >= now) {
+                    w->now = now;
+                    break;
+                }
+                w->now += idle - 1;
+            }
+        }
+        w->now++;
+        // Entering a new block: pull the matching higher-level slots down,
+        // top level first so the timers can trickle down in one step
+        for (int l = TW_LEVELS - 1; l > 0; l--) {
+            if ((w->now & ((1ull << (TW_BITS * l)) - 1)) == 0) {
+                cascade(w, l);
+            }
+        }
+
+        Timer due;
+        splice(&w->slots[0][w->now & TW_MASK], &due);
+        while (!list_empty(&due)) {
+            Timer *t = due.next;
+            list_del(t);
+            if (t->expires > w->now) {      // parked beyond the wheel's range
+                place(w, t, w->now + 1);
+                continue;
+            }
+            w->count--;
+            if (t->fn) t->fn(t, now);
+        }
+        if (w->count == 0) {
+            w->now = now;
+            break;
+        }
+    }
+}
+
+int timer_wheel_timeout_ms(const TimerWheel *w) {
+    if (w->count == 0) return -1;
+    uint64_t best = UINT64_MAX;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        unsigned shift = TW_BITS * (unsigned)l;
+        uint64_t cur   = w->now >> shift;
+        // Level 0 starts at the next tick, the others at the next block
+        for (unsigned j = 1; j <= TW_SLOTS; j++) {
+            if (!list_empty(&w->slots[l][(cur + j) & TW_MASK])) {
+                uint64_t at = (cur + j) << shift;      // due (level 0) or cascaded
+                if (at < best) best = at;
+                break;
+            }
+        }
+    }
+    if (best == UINT64_MAX) return 0;
+    uint64_t wait = best > w->now ? best - w->now : 0;
+    return wait > (uint64_t)INT_MAX ? INT_MAX : (int)wait;
+}
@@ -0,0 +1,69 @@
+/*
+** timer_wheel.h -- hierarchical timing wheel for the drinks_bar event loops
+**
+** Every worker owns one wheel and drives it from its own loop: epoll_wait()
+** sleeps at most timer_wheel_timeout_ms(), then timer_wheel_advance() runs the
+** callbacks that are due. Nothing here makes a system call (the clock is
+** read through the vDSO) and nothing is shared between threads.
+**
+** Four levels of 64 slots with a 1 ms tick cover 64^4 ms (about 4.6 hours);
+** a later deadline waits in the last level and is placed again when that
+** slot comes up. Arming, re-arming and cancelling are O(1) list operations.
+**
+** Timers are intrusive: embed a Timer in the object it belongs to and get
+** back to it with offsetof() in the callback. A callback may arm, cancel or
+** free any timer, including its own (it is already unlinked when it runs).
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint64_t
+
+#define TW_BITS   6
+#define TW_SLOTS  (1u << TW_BITS)
+#define TW_LEVELS 4
+
+struct TimerWheel;
+
+typedef struct Timer {
+    struct Timer      *next, *prev;   // slot list, NULL while not armed
+    struct TimerWheel *wheel;         // the wheel it is armed on
+    uint64_t           expires;       // absolute time in ms (timer_now_ms())
+    void             (*fn)(struct Timer *t, uint64_t now);
+} Timer;
+
+typedef struct TimerWheel {
+    uint64_t now;                           // every timer up to here has fired
+    size_t   count;                         // armed timers
+    Timer    slots[TW_LEVELS][TW_SLOTS];    // list heads
+} TimerWheel;
+
+// Monotonic milliseconds (clock_gettime through the vDSO, no system call)
+uint64_t timer_now_ms(void);
+
+void timer_wheel_init(TimerWheel *w, uint64_t now);
+
+// A zeroed Timer is a valid, unarmed timer without callback.
+void timer_init(Timer *t, void (*fn)(Timer *t, uint64_t now));
+
+static inline bool timer_armed(const Timer *t) {
+    return t->next != NULL;
+}
+
+// (Re-)arm `t` to fire at `expires`; a time in the past fires on the next advance.
+void timer_arm(TimerWheel *w, Timer *t, uint64_t expires);
+
+// Disarm `t` if it is armed
+void timer_cancel(Timer *t);
+
+// Run every timer due at or before `now`
+void timer_wheel_advance(TimerWheel *w, uint64_t now);
+
+// Milliseconds until the next timer may be due, -1 if none is armed
+// (suitable as the epoll_wait() timeout)
+int timer_wheel_timeout_ms(const TimerWheel *w);
+
+#endif // TIMER_WHEEL_H
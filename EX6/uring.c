@@ -0,0 +1,306 @@
+/*
+** uring.c -- minimal io_uring wrapper (see uring.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "uring.h"
+
+#include <stdio.h>           // snprintf
+#include <stdlib.h>          // posix_memalign, free
+#include <string.h>          // memset, strerror
+#include <unistd.h>          // syscall, close, write, sysconf
+#include <errno.h>           // errno
+#include <signal.h>          // _NSIG
+#include <time.h>            // struct timespec
+#include <sys/mman.h>        // mmap, munmap
+#include <sys/syscall.h>     // __NR_io_uring_*
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                     const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ----------------------------------------------------------------------------
+// Setup. A single issuer whose deferred task work only runs when it waits
+// (Linux 6.1) is exactly how an event loop uses its ring; older kernels get
+// a plain ring. The ring starts disabled so that its issuer is the thread
+// that calls uring_enable(), not the one that created it.
+// ----------------------------------------------------------------------------
+int uring_init(Uring *r, unsigned entries, unsigned cq_entries) {
+    struct io_uring_params p;
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    p.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_R_DISABLED |
+                   IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = cq_entries;
+    int fd = sys_setup(entries, &p);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        p.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_R_DISABLED;
+        p.cq_entries = cq_entries;
+        fd = sys_setup(entries, &p);
+    }
+    if (fd < 0) return -1;
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        close(fd);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    r->fd = fd;
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_size > r->sq_map_size) r->sq_map_size = r->cq_map_size;
+        r->cq_map_size = 0;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) goto fail;
+    if (r->cq_map_size) {
+        r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) goto fail;
+    } else {
+        r->cq_map = r->sq_map;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head    = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail    = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask    = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sqe_tail   = *r->sq_tail;
+    r->cq_head    = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail    = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask    = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    // SQE i always sits in slot i of the indirection array
+    unsigned *array = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+    return 0;
+
+fail:;
+    int saved = errno;
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (r->cq_map_size && r->cq_map && r->cq_map != MAP_FAILED) munmap(r->cq_map, r->cq_map_size);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_size);
+    close(fd);
+    memset(r, 0, sizeof(*r));
+    errno = saved;
+    return -1;
+}
+
+int uring_enable(Uring *r) {
+    return sys_register(r->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0 ? -1 : 0;
+}
+
+// Closing the ring cancels whatever is still in flight
+void uring_free(Uring *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_map_size) munmap(r->cq_map, r->cq_map_size);
+    munmap(r->sq_map, r->sq_map_size);
+    close(r->fd);
+    memset(r, 0, sizeof(*r));
+}
+
+// ----------------------------------------------------------------------------
+// Submission
+// ----------------------------------------------------------------------------
+static unsigned publish(Uring *r) {
+    unsigned pending = r->sqe_tail - *r->sq_tail;
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    return pending;
+}
+
+struct io_uring_sqe *uring_sqe(Uring *r) {
+    while (uring_sq_full(r)) {
+        int rc = sys_enter(r->fd, publish(r), 0, 0, NULL, 0);
+        if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) return NULL;
+    }
+    struct io_uring_sqe *sqe = &r->sqes[r->sqe_tail & r->sq_mask];
+    r->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit_and_wait(Uring *r, unsigned wait_nr, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts         = timeout_ms >= 0 ? (uint64_t)(uintptr_t)&ts : 0;
+    int rc = sys_enter(r->fd, publish(r), wait_nr,
+                       IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    return rc < 0 ? -errno : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Operations
+// ----------------------------------------------------------------------------
+static void prep(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned len, uint64_t data) {
+    sqe->opcode    = (uint8_t)op;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)addr;
+    sqe->len       = len;
+    sqe->user_data = data;
+}
+
+void uring_prep_accept(struct io_uring_sqe *sqe, int fd, bool multishot, int flags, uint64_t data) {
+    prep(sqe, IORING_OP_ACCEPT, fd, NULL, 0, data);
+    sqe->accept_flags = (uint32_t)flags;
+    if (multishot) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+}
+
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid, uint64_t data) {
+    prep(sqe, IORING_OP_RECV, fd, NULL, 0, data);
+    sqe->ioprio   |= IORING_RECV_MULTISHOT;
+    sqe->flags    |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+}
+
+void uring_prep_recvmsg_multishot(struct io_uring_sqe *sqe, int fd, struct msghdr *msg, uint16_t bgid, uint64_t data) {
+    prep(sqe, IORING_OP_RECVMSG, fd, msg, 1, data);
+    sqe->ioprio   |= IORING_RECV_MULTISHOT;
+    sqe->flags    |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+}
+
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, size_t len, int flags, uint64_t data) {
+    prep(sqe, IORING_OP_SEND, fd, buf, (unsigned)len, data);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, int flags, uint64_t data) {
+    prep(sqe, IORING_OP_SENDMSG, fd, msg, 1, data);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t data) {
+    prep(sqe, IORING_OP_POLL_ADD, fd, NULL, 0, data);
+    sqe->poll32_events = events;
+}
+
+void uring_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t data) {
+    prep(sqe, IORING_OP_ASYNC_CANCEL, -1, NULL, 0, data);
+    sqe->addr = target;
+}
+
+// ----------------------------------------------------------------------------
+// Provided buffer rings. The ring itself is page aligned, as the kernel
+// requires; every buffer starts out in it.
+// ----------------------------------------------------------------------------
+int uring_buf_ring_init(Uring *r, UringBufRing *br, uint16_t bgid, unsigned count, unsigned size) {
+    memset(br, 0, sizeof(*br));
+    void *ring, *bufs;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (posix_memalign(&ring, page, count * sizeof(struct io_uring_buf)) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (posix_memalign(&bufs, 64, (size_t)count * size) != 0) {
+        free(ring);
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(ring, 0, count * sizeof(struct io_uring_buf));
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = count;
+    reg.bgid         = bgid;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int saved = errno;
+        free(ring);
+        free(bufs);
+        errno = saved;
+        return -1;
+    }
+    br->ring  = ring;
+    br->bufs  = bufs;
+    br->count = count;
+    br->size  = size;
+    br->bgid  = bgid;
+    for (unsigned id = 0; id < count; id++) {
+        uring_buf_recycle(br, id);
+    }
+    return 0;
+}
+
+void uring_buf_ring_free(Uring *r, UringBufRing *br) {
+    if (!br->ring) return;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = br->bgid;
+    sys_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(br->ring);
+    free(br->bufs);
+    memset(br, 0, sizeof(*br));
+}
+
+void uring_buf_recycle(UringBufRing *br, unsigned id) {
+    struct io_uring_buf *b = &br->ring->bufs[br->tail & (br->count - 1)];
+    b->addr = (uint64_t)(uintptr_t)uring_buf(br, id);
+    b->len  = br->size;
+    b->bid  = (uint16_t)id;
+    br->tail++;
+    __atomic_store_n(&br->ring->tail, br->tail, __ATOMIC_RELEASE);
+}
+
+// ----------------------------------------------------------------------------
+// uring_probe(): run one multishot receive with a provided buffer over a
+// socket pair. That needs every feature the server relies on (multishot
+// accept and buffer rings are older).
+// ----------------------------------------------------------------------------
+const char *uring_probe(void) {
+    static char why[128];
+    Uring r;
+    UringBufRing br;
+    if (uring_init(&r, 4, 8) < 0) {
+        snprintf(why, sizeof(why), "io_uring_setup: %s", strerror(errno));
+        return why;
+    }
+    if (uring_enable(&r) < 0 || uring_buf_ring_init(&r, &br, 0, 2, 64) < 0) {
+        snprintf(why, sizeof(why), "enable / provided buffer ring: %s", strerror(errno));
+        uring_free(&r);
+        return why;
+    }
+    const char *result = NULL;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) {
+        snprintf(why, sizeof(why), "socketpair: %s", strerror(errno));
+        result = why;
+    } else {
+        uring_prep_recv_multishot(uring_sqe(&r), sv[0], 0, 1);
+        int rc = (write(sv[1], "x", 1) == 1) ? uring_submit_and_wait(&r, 1, 1000) : -errno;
+        struct io_uring_cqe *cqe = uring_cqe(&r);
+        if (rc < 0 && !cqe) {
+            snprintf(why, sizeof(why), "io_uring_enter: %s", strerror(-rc));
+            result = why;
+        } else if (!cqe || cqe->res != 1 || !(cqe->flags & IORING_CQE_F_MORE) ||
+                   !(cqe->flags & IORING_CQE_F_BUFFER)) {
+            snprintf(why, sizeof(why), "no multishot recv (%s)",
+                     cqe && cqe->res < 0 ? strerror(-cqe->res) : "unexpected completion");
+            result = why;
+        }
+        close(sv[0]);
+        close(sv[1]);
+    }
+    uring_buf_ring_free(&r, &br);
+    uring_free(&r);
+    return result;
+}
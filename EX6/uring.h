@@ -0,0 +1,120 @@
+/*
+** uring.h -- a minimal io_uring wrapper for the drinks_bar event loops
+**
+** Raw io_uring_setup / io_uring_enter / io_uring_register system calls and
+** the shared rings, so the server needs no liburing. One Uring belongs to
+** one thread: it prepares SQEs, submits them together with the wait for the
+** next completions (one io_uring_enter per loop iteration) and consumes the
+** CQEs itself. A ring may be set up by another thread; the one that runs it
+** calls uring_enable() first.
+**
+** UringBufRing is a provided buffer ring (IORING_REGISTER_PBUF_RING): the
+** kernel picks a buffer for every multishot receive and names it in the
+** CQE; uring_buf_recycle() hands it back once its bytes have been used.
+**
+** Needs Linux 6.0 (multishot recv / recvmsg); uring_probe() tells whether
+** the running kernel (and its io_uring_disabled setting) supports all of it.
+*/
+
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint16_t, uint64_t
+#include <sys/socket.h>      // struct msghdr
+#include <linux/io_uring.h>  // struct io_uring_sqe, io_uring_cqe, io_uring_buf_ring
+
+typedef struct {
+    int       fd;
+    // submission queue (shared with the kernel)
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned  sq_mask;
+    unsigned  sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned  sqe_tail;               // SQEs handed out, published on submit
+    // completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned  cq_mask;
+    struct io_uring_cqe *cqes;
+    // mappings, for uring_free()
+    void     *sq_map;
+    size_t    sq_map_size;
+    void     *cq_map;
+    size_t    cq_map_size;
+    size_t    sqes_size;
+} Uring;
+
+typedef struct {
+    struct io_uring_buf_ring *ring;   // shared with the kernel
+    char     *bufs;                   // `count` buffers of `size` bytes
+    unsigned  count;                  // power of two
+    unsigned  size;
+    uint16_t  bgid;                   // buffer group id (sqe->buf_group)
+    uint16_t  tail;
+} UringBufRing;
+
+// Create a ring with `entries` SQEs and `cq_entries` CQEs. Returns 0, or -1
+// with errno set (ENOSYS / EPERM when io_uring is missing or disabled).
+// Nothing can be submitted before uring_enable().
+int  uring_init(Uring *r, unsigned entries, unsigned cq_entries);
+
+// Start the ring; the calling thread becomes its only issuer. Returns 0, or
+// -1 with errno set.
+int  uring_enable(Uring *r);
+void uring_free(Uring *r);
+
+// A zeroed SQE; a full queue is submitted first. Returns NULL only if that
+// submission fails.
+struct io_uring_sqe *uring_sqe(Uring *r);
+
+// uring_sqe() would have to submit first
+static inline bool uring_sq_full(const Uring *r) {
+    return r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries;
+}
+
+// Submit every prepared SQE and wait until `wait_nr` CQEs are ready or
+// `timeout_ms` has passed (-1 = no limit). Returns 0 or -errno (-ETIME on
+// timeout, -EINTR on a signal).
+int uring_submit_and_wait(Uring *r, unsigned wait_nr, int timeout_ms);
+
+// Next completion, or NULL; uring_cqe_seen() releases it
+static inline struct io_uring_cqe *uring_cqe(Uring *r) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+static inline void uring_cqe_seen(Uring *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// Operations. `data` comes back as cqe->user_data.
+// With `multishot` one SQE accepts every client until it is cancelled
+void uring_prep_accept(struct io_uring_sqe *sqe, int fd, bool multishot, int flags, uint64_t data);
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid, uint64_t data);
+void uring_prep_recvmsg_multishot(struct io_uring_sqe *sqe, int fd, struct msghdr *msg, uint16_t bgid, uint64_t data);
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, size_t len, int flags, uint64_t data);
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, int flags, uint64_t data);
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t data);
+void uring_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t data);
+
+// Register `count` (a power of two) buffers of `size` bytes as group `bgid`.
+// Returns 0, or -1 with errno set.
+int  uring_buf_ring_init(Uring *r, UringBufRing *br, uint16_t bgid, unsigned count, unsigned size);
+void uring_buf_ring_free(Uring *r, UringBufRing *br);
+
+static inline char *uring_buf(const UringBufRing *br, unsigned id) {
+    return br->bufs + (size_t)id * br->size;
+}
+
+// Give buffer `id` back to the kernel
+void uring_buf_recycle(UringBufRing *br, unsigned id);
+
+// NULL if this kernel runs everything the drinks_bar io_uring loop uses,
+// otherwise why not.
+const char *uring_probe(void);
+
+#endif // URING_H
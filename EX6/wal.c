@@ -0,0 +1,272 @@
+/*
+** wal.c -- write-ahead log with group commit (see wal.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "wal.h"
+
+#include <stdio.h>           // perror, fprintf, snprintf
+#include <stdlib.h>          // malloc, free, exit
+#include <string.h>          // strlen, memcpy
+#include <stdbool.h>         // bool
+#include <stddef.h>          // offsetof
+#include <errno.h>           // errno, ETIMEDOUT
+#include <unistd.h>          // write, fdatasync, ftruncate, close
+#include <fcntl.h>           // open, O_*
+#include <time.h>            // clock_gettime
+#include <pthread.h>         // pthread_*
+#include <sys/file.h>        // flock
+
+#include "atoms.h"           // atoms_count
+#include "crc32c.h"          // crc32c
+#include "snapshot.h"        // snapshot_write
+
+// CRC-32C over everything after the crc field of a `size`-byte record
+static uint32_t record_crc(const WalRecord *r, size_t size) {
+    return crc32c(0, &r->lsn, size - offsetof(WalRecord, lsn));
+}
+
+// ----------------------------------------------------------------------------
+// Log state. Appenders fill `queue`; the writer thread swaps it with `batch`
+// and writes + fdatasync()s the batch without holding the lock. Both are
+// arrays of `rec_size`-byte records.
+// ----------------------------------------------------------------------------
+static struct {
+    char            *snap_path;
+    char            *log_path;
+    int              fd;
+    WalConfig        cfg;
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;           // writer: work pending / batch full / stop
+    pthread_cond_t   space;          // appenders: the queue was drained
+    unsigned char   *queue;
+    unsigned char   *batch;
+    size_t           rec_size;       // header + one lane per atom type
+    size_t           count;          // records in `queue`
+    size_t           cap;
+    uint64_t         since_compact;  // records written since the last snapshot
+    uint64_t         newest_lsn;     // highest-lsn record on disk ...
+    AtomStock        newest;         // ... and its stock
+    bool             stop;
+    pthread_t        thread;
+} wal = { .fd = -1 };
+
+static bool write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p   += w;
+        len -= (size_t)w;
+    }
+    return true;
+}
+
+// Snapshot the newest state and start a fresh (empty) log. Returns false
+// (the log is kept as it is) if either step fails.
+static bool compact(void) {
+    SnapshotEntry snap = { .name = "", .stock = wal.newest };
+    if (!snapshot_write(wal.snap_path, &snap, 1, true)) return false;
+    if (ftruncate(wal.fd, 0) < 0) {
+        perror("ftruncate (wal)");
+        return false;
+    }
+    fdatasync(wal.fd);
+    wal.since_compact = 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// writer_thread(): the group-commit loop
+// ----------------------------------------------------------------------------
+static void *writer_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&wal.lock);
+    for (;;) {
+        while (wal.count == 0 && !wal.stop) {
+            pthread_cond_wait(&wal.wake, &wal.lock);
+        }
+        if (wal.count == 0 && wal.stop) break;
+
+        // Give the batch up to sync_ms to fill before committing it
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += (long)wal.cfg.sync_ms * 1000000L;
+        deadline.tv_sec  += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (wal.count < wal.cfg.sync_ops && !wal.stop) {
+            if (pthread_cond_timedwait(&wal.wake, &wal.lock, &deadline) == ETIMEDOUT) break;
+        }
+
+        unsigned char *batch = wal.queue;
+        size_t n = wal.count;
+        wal.queue = wal.batch;
+        wal.batch = batch;
+        wal.count = 0;
+        pthread_cond_broadcast(&wal.space);
+        pthread_mutex_unlock(&wal.lock);
+
+        if (!write_all(wal.fd, batch, n * wal.rec_size)) {
+            perror("write (wal)");
+        } else if (fdatasync(wal.fd) < 0) {
+            perror("fdatasync (wal)");
+        }
+        for (size_t i = 0; i < n; i++) {
+            const WalRecord *r = (const WalRecord *)(batch + i * wal.rec_size);
+            if (r->lsn > wal.newest_lsn) {
+                wal.newest_lsn = r->lsn;
+                memcpy(wal.newest.count, r->stock, wal.rec_size - sizeof(WalRecord));
+            }
+        }
+        wal.since_compact += n;
+        if (wal.since_compact >= wal.cfg.compact_ops) {
+            compact();
+        }
+
+        pthread_mutex_lock(&wal.lock);
+    }
+    pthread_mutex_unlock(&wal.lock);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// recover(): scan the log, the valid record with the highest lsn wins.
+// Torn or corrupt records (crash in the middle of a write) are skipped.
+// *bytes receives the length of the log.
+// ----------------------------------------------------------------------------
+static bool recover(int fd, AtomStock *best, size_t *bytes) {
+    static unsigned char buf[64 * 1024];
+    size_t chunk = sizeof(buf) / wal.rec_size * wal.rec_size;
+    uint64_t best_lsn = 0;
+    bool found = false;
+    *bytes = 0;
+    for (;;) {
+        ssize_t r = read(fd, buf, chunk);
+        if (r <= 0) break;
+        *bytes += (size_t)r;
+        size_t n = (size_t)r / wal.rec_size;
+        for (size_t i = 0; i < n; i++) {
+            const WalRecord *rec = (const WalRecord *)(buf + i * wal.rec_size);
+            if (rec->magic != WAL_RECORD_MAGIC || rec->crc != record_crc(rec, wal.rec_size)) continue;
+            if (!found || rec->lsn > best_lsn) {
+                best_lsn = rec->lsn;
+                memcpy(best->count, rec->stock, wal.rec_size - sizeof(WalRecord));
+                found = true;
+            }
+        }
+        if ((size_t)r % wal.rec_size != 0) break;   // torn tail
+    }
+    return found;
+}
+
+void wal_open(const char *snapshot_path, const WalConfig *cfg, AtomStock *stock) {
+    size_t len = strlen(snapshot_path);
+    wal.snap_path = malloc(len + 1);
+    wal.log_path  = malloc(len + 5);
+    if (!wal.snap_path || !wal.log_path) {
+        perror("malloc (wal)");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(wal.snap_path, snapshot_path, len + 1);
+    snprintf(wal.log_path, len + 5, "%s.wal", snapshot_path);
+    wal.cfg = *cfg;
+    if (wal.cfg.sync_ops == 0)    wal.cfg.sync_ops = 1;
+    if (wal.cfg.compact_ops == 0) wal.cfg.compact_ops = 1;
+
+    wal.fd = open(wal.log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (wal.fd < 0) {
+        perror("open (wal)");
+        exit(EXIT_FAILURE);
+    }
+    // The log has exactly one writer process
+    if (flock(wal.fd, LOCK_EX | LOCK_NB) < 0) {
+        fprintf(stderr, "Error: %s is in use by another drinks_bar\n", wal.log_path);
+        exit(EXIT_FAILURE);
+    }
+
+    wal.rec_size = sizeof(WalRecord) + atoms_count() * sizeof(uint64_t);
+    size_t bytes;
+    if (recover(wal.fd, stock, &bytes)) {
+        printf("WAL: recovered inventory from %s\n", wal.log_path);
+    } else if (bytes >= wal.rec_size) {
+        // Whole records, none of them valid: not a torn write
+        fprintf(stderr, "Error: %s holds no record for this --atoms list\n", wal.log_path);
+        exit(EXIT_FAILURE);
+    }
+    // Versions restart at 0 in this process: fold everything into the snapshot.
+    // A record left over from the previous process would outrank every new
+    // one at the next recovery, so an empty log is a must.
+    wal.newest_lsn = 0;
+    wal.newest     = *stock;
+    if (!compact()) {
+        fprintf(stderr, "Error: could not fold %s into %s\n", wal.log_path, wal.snap_path);
+        exit(EXIT_FAILURE);
+    }
+
+    wal.cap   = (size_t)wal.cfg.sync_ops * 2;
+    wal.queue = malloc(wal.cap * wal.rec_size);
+    wal.batch = malloc(wal.cap * wal.rec_size);
+    if (!wal.queue || !wal.batch) {
+        perror("malloc (wal queue)");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&wal.wake, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_cond_init(&wal.space, NULL);
+    pthread_mutex_init(&wal.lock, NULL);
+
+    int rc = pthread_create(&wal.thread, NULL, writer_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "pthread_create (wal): %s\n", strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+}
+
+void wal_append(uint64_t lsn, const AtomStock *after) {
+    // Built on the stack, so the CRC is computed outside the lock
+    union {
+        WalRecord     r;
+        unsigned char bytes[sizeof(WalRecord) + ATOM_TYPES_MAX * sizeof(uint64_t)];
+    } rec;
+    rec.r.magic = WAL_RECORD_MAGIC;
+    rec.r.lsn   = lsn;
+    memcpy(rec.r.stock, after->count, wal.rec_size - sizeof(WalRecord));
+    rec.r.crc   = record_crc(&rec.r, wal.rec_size);
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.count == wal.cap) {
+        // Disk is behind: apply back-pressure instead of growing without bound
+        pthread_cond_signal(&wal.wake);
+        pthread_cond_wait(&wal.space, &wal.lock);
+    }
+    memcpy(wal.queue + wal.count++ * wal.rec_size, &rec, wal.rec_size);
+    if (wal.count == 1 || wal.count == wal.cfg.sync_ops) {
+        pthread_cond_signal(&wal.wake);
+    }
+    pthread_mutex_unlock(&wal.lock);
+}
+
+void wal_close(void) {
+    if (wal.fd < 0) return;
+    pthread_mutex_lock(&wal.lock);
+    wal.stop = true;
+    pthread_cond_signal(&wal.wake);
+    pthread_mutex_unlock(&wal.lock);
+    pthread_join(wal.thread, NULL);
+
+    compact();
+    close(wal.fd);
+    wal.fd = -1;
+    free(wal.queue);
+    free(wal.batch);
+    free(wal.snap_path);
+    free(wal.log_path);
+}
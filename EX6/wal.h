@@ -0,0 +1,62 @@
+/*
+** wal.h -- append-only operation log for drinks_bar -f (--wal mode)
+**
+** Instead of rewriting the whole -f file on every ADD / DELIVER, each
+** successful update appends one record to "<file>.wal". A
+** background thread writes the pending records and fdatasync()s them as one
+** group commit, either every --wal-sync-ms milliseconds or as soon as
+** --wal-sync-ops records are waiting, whichever comes first.
+**
+** Every record carries the inventory version and the full stock *after* the
+** operation, so recovery is "last valid record wins": replaying is idempotent
+** and a crash during compaction (snapshot rewrite + log truncate) is harmless.
+**
+** The -f file itself stays the snapshot (see snapshot.h); it is rewritten
+** atomically (temp file + rename) every --wal-compact-ops records, at startup
+** after recovery, and on shutdown.
+*/
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdint.h>          // uint32_t, uint64_t
+
+#include "inventory.h"       // AtomStock
+
+#define WAL_RECORD_MAGIC 0x4C415744u   // "DWAL"
+
+// One on-disk log record (host byte order): the header below, then the
+// stock after the operation, one uint64_t per configured atom type (see
+// atoms.h); 40 bytes with the built-in three. All records of a log have the
+// same size, so recovery needs the same --atoms list as the writer.
+typedef struct {
+    uint32_t  magic;     // WAL_RECORD_MAGIC
+    uint32_t  crc;       // CRC-32C over lsn + stock
+    uint64_t  lsn;       // inventory version after the operation
+    uint64_t  stock[];   // count per atom id
+} WalRecord;
+
+typedef struct {
+    unsigned sync_ms;       // group commit at least this often (ms)
+    unsigned sync_ops;      // ... or as soon as this many records are pending
+    unsigned compact_ops;   // rewrite the snapshot after this many records
+} WalConfig;
+
+#define WAL_DEFAULT_SYNC_MS      2
+#define WAL_DEFAULT_SYNC_OPS     4096
+#define WAL_DEFAULT_COMPACT_OPS  1000000
+
+// Recover "<snapshot_path>.wal" on top of `stock` (already loaded from the
+// snapshot), compact it, and start the group-commit thread.
+// Exits the process if the log is owned by another drinks_bar, holds
+// records of another atom type list, or cannot be folded into the snapshot.
+void wal_open(const char *snapshot_path, const WalConfig *cfg, AtomStock *stock);
+
+// Queue one record (thread-safe, does not wait for the disk unless the
+// in-memory queue is full).
+void wal_append(uint64_t lsn, const AtomStock *after);
+
+// Flush everything still queued, write a final snapshot and stop the thread.
+void wal_close(void);
+
+#endif // WAL_H
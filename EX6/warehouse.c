@@ -0,0 +1,124 @@
+/*
+** warehouse.c -- open-addressing table of named inventories (see warehouse.h)
+*/
+
+#define _GNU_SOURCE
+
+#include "warehouse.h"
+
+#include <stdio.h>           // fprintf
+#include <stdlib.h>          // posix_memalign, calloc, free, exit
+#include <string.h>          // memcpy, memcmp
+#include <stdint.h>          // uint32_t, uint64_t
+#include <pthread.h>         // pthread_mutex_*
+
+// ----------------------------------------------------------------------------
+// A slot is 0 (empty) or (hash tag << 32 | entry index + 1). Slots are only
+// ever filled, never cleared, so a probe that reaches an empty slot proves
+// the name is absent, even while another thread is creating it.
+// ----------------------------------------------------------------------------
+static struct {
+    uint64_t        *slots;                      // atomic words
+    size_t           mask;                       // slot count - 1
+    Inventory       *inv;                        // `capacity` entries, 64-byte aligned
+    char           (*names)[WAREHOUSE_NAME_MAX];
+    size_t           capacity;
+    size_t           count;                      // atomic: entries created
+    pthread_mutex_t  lock;                       // serialises creation
+} wh;
+
+// FNV-1a: the low bits pick the first slot, the high 32 are the tag
+static uint64_t hash_name(const char *name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+void warehouses_init(size_t capacity) {
+    if (capacity == 0) return;
+    size_t slots = 2;
+    while (slots < 2 * capacity) slots <<= 1;   // at most half full
+
+    void *mem = NULL;
+    if (posix_memalign(&mem, 64, capacity * sizeof(Inventory)) != 0 ||
+        (wh.slots = calloc(slots, sizeof(*wh.slots))) == NULL ||
+        (wh.names = calloc(capacity, sizeof(*wh.names))) == NULL) {
+        fprintf(stderr, "warehouse: cannot allocate %zu warehouses\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+    wh.inv      = mem;
+    wh.mask     = slots - 1;
+    wh.capacity = capacity;
+    pthread_mutex_init(&wh.lock, NULL);
+}
+
+size_t warehouses_capacity(void) {
+    return wh.capacity;
+}
+
+// Probe for `name`. Returns its entry index, or -1 with *empty set to the
+// empty slot that ends its probe sequence.
+static long find(const char *name, size_t len, uint64_t h, size_t *empty) {
+    uint32_t tag = (uint32_t)(h >> 32);
+    for (size_t i = h & wh.mask; ; i = (i + 1) & wh.mask) {
+        uint64_t s = __atomic_load_n(&wh.slots[i], __ATOMIC_ACQUIRE);
+        if (s == 0) {
+            *empty = i;
+            return -1;
+        }
+        size_t idx = (uint32_t)s - 1;
+        if ((uint32_t)(s >> 32) == tag && memcmp(wh.names[idx], name, len) == 0 &&
+            wh.names[idx][len] == '\0') {
+            return (long)idx;
+        }
+    }
+}
+
+Inventory *warehouse_get(const char *name, size_t len, bool create) {
+    if (wh.capacity == 0 || len == 0 || len >= WAREHOUSE_NAME_MAX) return NULL;
+    uint64_t h = hash_name(name, len);
+    size_t empty;
+    long idx = find(name, len, h, &empty);
+    if (idx >= 0) return &wh.inv[idx];
+    if (!create) return NULL;
+
+    pthread_mutex_lock(&wh.lock);
+    idx = find(name, len, h, &empty);            // somebody may have won the race
+    if (idx < 0 && wh.count < wh.capacity) {
+        idx = (long)wh.count;
+        memcpy(wh.names[idx], name, len);
+        wh.names[idx][len] = '\0';
+        const AtomStock none = {{ 0 }};
+        inventory_init(&wh.inv[idx], &none);
+        // Entry first, then the count (for warehouse_at()), then the slot
+        __atomic_store_n(&wh.count, wh.count + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&wh.slots[empty], (h >> 32) << 32 | (uint64_t)(idx + 1),
+                         __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&wh.lock);
+    return idx >= 0 ? &wh.inv[idx] : NULL;
+}
+
+size_t warehouse_count(void) {
+    return __atomic_load_n(&wh.count, __ATOMIC_ACQUIRE);
+}
+
+const char *warehouse_name(size_t i) {
+    return wh.names[i];
+}
+
+Inventory *warehouse_at(size_t i) {
+    return &wh.inv[i];
+}
+
+void warehouses_free(void) {
+    if (wh.capacity == 0) return;
+    pthread_mutex_destroy(&wh.lock);
+    free(wh.slots);
+    free(wh.names);
+    free(wh.inv);
+    wh.capacity = 0;
+    wh.count    = 0;
+}
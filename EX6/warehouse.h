@@ -0,0 +1,53 @@
+/*
+** warehouse.h -- named inventories ("ADD @bar42 CARBON 10", --warehouses N)
+**
+** One drinks_bar process serves many logical bars. Every warehouse is an
+** Inventory of its own (seqlock, own cache line, see inventory.h); the
+** unnamed default warehouse stays drinks_bar's global inventory and is not
+** stored here.
+**
+** The table is sized once for --warehouses N and never grows:
+**   • open addressing with linear probing over 8-byte slots (hash tag +
+**     entry index), at most half full, so a lookup usually reads one line
+**   • names and inventories live in two dense arrays indexed by creation
+**     order, which is also the order warehouse_at() walks them in
+**   • lookups are lock-free; creating a warehouse takes a mutex and
+**     publishes the finished slot with one release store
+** A warehouse costs its inventory (192 bytes by default, 64 when built with
+** ATOM_TYPES_MAX=4, see inventory.h), 32 bytes for its name and two slots
+** of 8 bytes.
+*/
+
+#ifndef WAREHOUSE_H
+#define WAREHOUSE_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+
+#include "inventory.h"       // Inventory
+
+#define WAREHOUSE_NAME_MAX 32          // bytes including the NUL
+#define WAREHOUSES_MAX     16777216u   // upper bound for --warehouses
+
+// Room for `capacity` named warehouses (0 = none). Exits on error.
+void warehouses_init(size_t capacity);
+
+// Warehouses the table can hold (0 = namespaces are off)
+size_t warehouses_capacity(void);
+
+// The warehouse called `name` (`len` bytes, 1 .. WAREHOUSE_NAME_MAX - 1).
+// With `create` a missing one is created empty. NULL if it does not exist
+// (or, with `create`, if the table is full). Thread-safe.
+Inventory *warehouse_get(const char *name, size_t len, bool create);
+
+// Number of warehouses created so far; entries 0 .. count-1 are complete.
+size_t warehouse_count(void);
+
+// Entry `i` in creation order
+const char *warehouse_name(size_t i);
+Inventory *warehouse_at(size_t i);
+
+// Release the table
+void warehouses_free(void);
+
+#endif // WAREHOUSE_H
@@ -0,0 +1,92 @@
+/*
+** wire.h -- compact binary framing for drinks_bar (alongside the text protocol)
+**
+** A binary request is a fixed 16-byte WireRequest, answered by a fixed
+** 32-byte WireReply. Both start with WIRE_MAGIC, a byte no text command can
+** start with, so the server tells the two protocols apart on its own:
+**   • TCP / UDS_STREAM: the first byte of a connection selects the protocol
+**     for the whole connection; frames may be pipelined back to back.
+**   • UDP / UDS_DGRAM: every datagram of exactly sizeof(WireRequest) bytes
+**     starting with WIRE_MAGIC is a binary request.
+** Both opcodes are accepted on every transport and always work on the
+** default inventory (named warehouses are text-only, see warehouse.h). A
+** reply carries the carbon, oxygen and hydrogen counts only, also when
+** --atoms adds more types.
+** Multi-byte fields are little-endian on the wire (wire_request() builds a
+** request).
+*/
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>          // uint8_t, uint32_t, uint64_t
+#include <endian.h>          // htole32, le32toh, htole64, le64toh
+
+#define WIRE_MAGIC 0xDBu
+
+// Opcodes
+enum {
+    WIRE_OP_ADD     = 1,     // item = WIRE_ATOM_*,     count = atoms to add
+    WIRE_OP_DELIVER = 2      // item = WIRE_MOLECULE_*, count = molecules
+};
+
+// Atom ids (WIRE_OP_ADD); --atoms types follow from 3 on (see atoms.h)
+enum {
+    WIRE_ATOM_CARBON   = 0,
+    WIRE_ATOM_OXYGEN   = 1,
+    WIRE_ATOM_HYDROGEN = 2
+};
+
+// Molecule ids (WIRE_OP_DELIVER)
+enum {
+    WIRE_MOLECULE_WATER          = 0,
+    WIRE_MOLECULE_CARBON_DIOXIDE = 1,
+    WIRE_MOLECULE_GLUCOSE        = 2,
+    WIRE_MOLECULE_ALCOHOL        = 3
+};
+
+// Reply status, the binary twin of the text "ERROR: ..." lines
+enum {
+    WIRE_OK                   = 0,
+    WIRE_ERR_INVALID_OPCODE   = 1,   // "invalid command"
+    WIRE_ERR_INVALID_ITEM     = 2,   // "invalid atom type" / "invalid molecule type"
+    WIRE_ERR_NUMBER_TOO_LARGE = 3,
+    WIRE_ERR_CAPACITY         = 4,   // "capacity exceeded"
+    WIRE_ERR_NOT_ENOUGH_C     = 5,
+    WIRE_ERR_NOT_ENOUGH_O     = 6,
+    WIRE_ERR_NOT_ENOUGH_H     = 7
+};
+
+typedef struct {
+    uint8_t  magic;        // WIRE_MAGIC
+    uint8_t  opcode;       // WIRE_OP_*
+    uint8_t  item;         // atom or molecule id
+    uint8_t  reserved;     // 0
+    uint32_t request_id;   // echoed in the reply
+    uint64_t count;
+} WireRequest;             // 16 bytes
+
+typedef struct {
+    uint8_t  magic;        // WIRE_MAGIC
+    uint8_t  status;       // WIRE_OK / WIRE_ERR_*
+    uint16_t reserved;     // 0
+    uint32_t request_id;   // from the request
+    uint64_t carbon;       // stock after the request (or the stock checked on error)
+    uint64_t oxygen;
+    uint64_t hydrogen;
+} WireReply;               // 32 bytes
+
+// Build a request in wire byte order
+static inline WireRequest wire_request(uint8_t opcode, uint8_t item,
+                                       uint64_t count, uint32_t request_id) {
+    WireRequest r;
+    r.magic      = WIRE_MAGIC;
+    r.opcode     = opcode;
+    r.item       = item;
+    r.reserved   = 0;
+    r.request_id = htole32(request_id);
+    r.count      = htole64(count);
+    return r;
+}
+
+#endif // WIRE_H